@@ -177,6 +177,9 @@ Communicator::ConnectToSite(Config::SiteInfo& site,
     Log_debug("connect to site: %s (attempt %d)", addr.c_str(), attempt++);
     auto connect_result = rpc_cli->connect(addr.c_str(), false);
     if (connect_result == SUCCESS) {
+      auto config = Config::GetConfig();
+      rpc_cli->set_flow_control(config->rpc_max_pending_,
+                                config->rpc_max_out_bytes_);
       ClassicProxy* rpc_proxy = new ClassicProxy(rpc_cli.get());
       rpc_clients_.insert(std::make_pair(site.id, rpc_cli));
       rpc_proxies_.insert(std::make_pair(site.id, rpc_proxy));
@@ -213,6 +216,18 @@ Communicator::NearestProxyForPartition(parid_t par_id) const {
   return partition_proxies[index];
 };
 
+bool Communicator::IsSlowReplica(parid_t par_id, siteid_t site_id) {
+  auto it = rpc_par_proxies_.find(par_id);
+  verify(it != rpc_par_proxies_.end());
+  vector<double> scores;
+  for (auto& p : it->second) {
+    scores.push_back(slow_detector_->Score(p.first));
+  }
+  std::sort(scores.begin(), scores.end());
+  double median = scores[scores.size() / 2];
+  return median > 0 && slow_detector_->Score(site_id) > SLOW_RATIO * median;
+}
+
 std::shared_ptr<QuorumEvent> Communicator::SendReelect(){
 	//paused = true;
 	//sleep(10);
@@ -457,7 +472,7 @@ Communicator::SendPrepare(Coordinator* coo,
         coo->aborted_ = true;
       }
       qe->n_voted_yes_++;
-      e->Test();
+      qe->Test();
     };
     
     ClassicProxy* proxy = LeaderProxyForPartition(partition_id).second;
@@ -560,6 +575,10 @@ Communicator::SendCommit(Coordinator* coo,
 
 	  	rrr::i64 curr = ((rrr::i64)end_.tv_sec - start_sec)*1000000000 + ((rrr::i64)end_.tv_nsec - start_nsec);
 	  	curr /= 1000;
+	  	// 0 means the server did not measure it.
+	  	if (profile.cpu_util > 0.0) {
+	  		slow_detector_->OnCpu(site_id, profile.cpu_util);
+	  	}
 	  	this->total_time += curr;
 	  	this->total++;
       if(this->index < 200){
@@ -583,7 +602,7 @@ Communicator::SendCommit(Coordinator* coo,
 
       if(coo->phase_ != phase) return;
       qe->n_voted_yes_++;
-      e->Test();
+      qe->Test();
     };
 
     ClassicProxy* proxy = LeaderProxyForPartition(rp).second;
@@ -668,6 +687,10 @@ Communicator::SendAbort(Coordinator* coo,
 
 	  	rrr::i64 curr = ((rrr::i64)end_.tv_sec - start_sec)*1000000000 + ((rrr::i64)end_.tv_nsec - start_nsec);
 	  	curr /= 1000;
+	  	// 0 means the server did not measure it.
+	  	if (profile.cpu_util > 0.0) {
+	  		slow_detector_->OnCpu(site_id, profile.cpu_util);
+	  	}
 	  	this->total_time += curr;
 	  	this->total++;
       if(this->index < 100){
@@ -691,7 +714,7 @@ Communicator::SendAbort(Coordinator* coo,
 
       if(coo->phase_ != phase) return;
       qe->n_voted_yes_++;
-      e->Test();
+      qe->Test();
     };
 
     ClassicProxy* proxy = LeaderProxyForPartition(rp).second;
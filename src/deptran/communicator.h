@@ -7,6 +7,7 @@
 #include "command_marshaler.h"
 #include "deptran/rcc/dep_graph.h"
 #include "rcc_rpc.h"
+#include "slow_detector.h"
 #include <unordered_map>
 
 namespace janus {
@@ -115,6 +116,10 @@ class Communicator {
   bool broadcasting_to_leaders_only_{true};
   bool follower_forwarding{false};
   std::recursive_mutex mtx_{};
+  // health of the other replicas, fed by rpc callbacks.
+  shared_ptr<SlowDetector> slow_detector_{std::make_shared<EwmaSlowDetector>()};
+  // a replica is slow when it scores this many times the partition median.
+  const double SLOW_RATIO = 3.0;
 	std::mutex lock_;
 	std::mutex count_lock_;
 	std::condition_variable cv_;
@@ -126,6 +131,13 @@ class Communicator {
   SiteProxyPair RandomProxyForPartition(parid_t partition_id) const;
   SiteProxyPair LeaderProxyForPartition(parid_t) const;
   SiteProxyPair NearestProxyForPartition(parid_t) const;
+  // whether site scores far worse than the median replica of the
+  // partition; the fpga_raft leader keeps such followers out of its quorum
+  // while the others can form one.
+  bool IsSlowReplica(parid_t par_id, siteid_t site_id);
+  void SetSlowDetector(shared_ptr<SlowDetector> detector) {
+    slow_detector_ = detector;
+  }
   void SetLeaderCache(parid_t par_id, SiteProxyPair& proxy) {
     leader_cache_[par_id] = proxy;
   }
@@ -315,6 +315,15 @@ void Config::LoadYML(std::string &filename) {
   if (config["failover"]) {
     LoadFailoverYML(config["failover"]);
   }
+  if (config["coroutine"]) {
+    LoadCoroutineYML(config["coroutine"]);
+  }
+  if (config["marshal"]) {
+    LoadMarshalYML(config["marshal"]);
+  }
+  if (config["replication"]) {
+    LoadReplicationYML(config["replication"]);
+  }
   if (config["n_concurrent"]) {
     n_concurrent_ = config["n_concurrent"].as<uint16_t>();
     Log_info("# of concurrent requests: %d", n_concurrent_);
@@ -705,6 +714,75 @@ void Config::LoadFailoverYML(YAML::Node config) {
   failover_stop_int_ = config["stop_interval"].as<int32_t>();
 }
 
+void Config::LoadCoroutineYML(YAML::Node config) {
+  // must run before any reactor starts creating coroutines.
+  if (config["stack_kb"]) {
+    auto stack_kb = config["stack_kb"].as<uint32_t>();
+    rrr::StackPool::SetStackSize(stack_kb * 1024);
+  }
+  if (config["guard_page"]) {
+    rrr::StackPool::SetGuardPage(config["guard_page"].as<bool>());
+  }
+  if (config["preallocate"]) {
+    rrr::StackPool::SetPreallocate(config["preallocate"].as<uint32_t>());
+  }
+  Log_info("coroutine stack size: %d bytes", (int) rrr::StackPool::StackSize());
+}
+
+void Config::LoadMarshalYML(YAML::Node config) {
+  // must run before the first message is marshaled.
+  if (config["hugepages"]) {
+    rrr::BufferPool::SetHugePages(config["hugepages"].as<bool>());
+  }
+}
+
+void Config::LoadReplicationYML(YAML::Node config) {
+  if (config["batch_size"]) {
+    repl_batch_size_ = std::max(1u, config["batch_size"].as<uint32_t>());
+  }
+  if (config["batch_timeout_us"]) {
+    repl_batch_timeout_us_ = config["batch_timeout_us"].as<uint64_t>();
+  }
+  if (config["append_window"]) {
+    repl_append_window_ = config["append_window"].as<uint32_t>();
+  }
+  if (config["append_max_entries"]) {
+    repl_append_max_entries_ =
+        std::max(1u, config["append_max_entries"].as<uint32_t>());
+  }
+  if (config["rpc_max_pending"]) {
+    rpc_max_pending_ = config["rpc_max_pending"].as<uint32_t>();
+  }
+  if (config["rpc_max_out_bytes"]) {
+    rpc_max_out_bytes_ = config["rpc_max_out_bytes"].as<uint64_t>();
+  }
+  if (config["rpc_io_threads"]) {
+    rpc_io_threads_ = std::max(1u, config["rpc_io_threads"].as<uint32_t>());
+  }
+  if (config["rpc_work_stealing"]) {
+    rpc_work_stealing_ = config["rpc_work_stealing"].as<bool>();
+  }
+  if (config["log_dir"]) {
+    repl_log_dir_ = config["log_dir"].as<string>();
+  }
+  if (config["snapshot_interval"]) {
+    repl_snapshot_interval_ = config["snapshot_interval"].as<uint64_t>();
+  }
+  if (config["lease_us"]) {
+    repl_lease_us_ = config["lease_us"].as<uint64_t>();
+  }
+  if (config["snapshot_chunk_bytes"]) {
+    repl_snapshot_chunk_ =
+        std::max(1u, config["snapshot_chunk_bytes"].as<uint32_t>());
+  }
+  Log_info("replication batch size: %d, timeout: %d us, "
+           "append window: %d, max entries: %d, "
+           "rpc max pending: %d, max out bytes: %d",
+           (int) repl_batch_size_, (int) repl_batch_timeout_us_,
+           (int) repl_append_window_, (int) repl_append_max_entries_,
+           (int) rpc_max_pending_, (int) rpc_max_out_bytes_);
+}
+
 void Config::InitTPCCD() {
   // TODO particular configuration for certain workloads.
   auto &tb_infos = sharding_->tb_infos_;
@@ -69,6 +69,32 @@ class Config {
   bool forwarding_enabled_ = false;
   int timestamp_{TimestampType::CLOCK};
 
+  // replication batching, a batch size of 1 proposes every command alone.
+  uint32_t repl_batch_size_{1};
+  uint64_t repl_batch_timeout_us_{1000};
+  uint32_t repl_append_window_{0};
+  uint32_t repl_append_max_entries_{64};
+  // where paxos/fpga_raft keep their persistent log, empty keeps the log in
+  // memory only.
+  string repl_log_dir_{};
+  // poll threads, and SO_REUSEPORT listeners, of a server's rpc endpoint.
+  // rrr::Server refuses more than one unless all its services are thread
+  // safe, which the paxos, fpga_raft and scheduler services are not.
+  uint32_t rpc_io_threads_{1};
+  // let idle poll threads of a server start thread safe handlers queued on
+  // busy ones, see rrr::Service::thread_safe().
+  bool rpc_work_stealing_{false};
+  // applied entries between two snapshots of the state machine (fpga_raft),
+  // 0 never compacts the log.
+  uint64_t repl_snapshot_interval_{0};
+  // bytes of snapshot carried by one InstallSnapshot.
+  uint32_t repl_snapshot_chunk_{1 << 20};
+  // leader lease for local reads, 0 sends every read through the log.
+  uint64_t repl_lease_us_{0};
+  // per connection flow control for replication rpcs, 0 is unlimited.
+  uint32_t rpc_max_pending_{0};
+  uint64_t rpc_max_out_bytes_{0};
+
   // failover configuration
   bool failover_{false};
   bool failover_soft_;
@@ -184,6 +210,9 @@ class Config {
   void LoadClientYML(YAML::Node client);
   void LoadSchemaYML(YAML::Node config);
   void LoadFailoverYML(YAML::Node config);
+  void LoadCoroutineYML(YAML::Node config);
+  void LoadMarshalYML(YAML::Node config);
+  void LoadReplicationYML(YAML::Node config);
   void LoadSchemaTableColumnYML(Sharding::tb_info_t &tb_info,
                                 YAML::Node column);
 
@@ -13,6 +13,31 @@ FpgaRaftCommo::FpgaRaftCommo(PollMgr* poll) : Communicator(poll) {
 //  verify(poll != nullptr);
 }
 
+ReplicaGroup* FpgaRaftCommo::GetReplicaGroup(parid_t par_id) {
+  auto it = replica_groups_.find(par_id);
+  if (it != replica_groups_.end()) {
+    return it->second;
+  }
+  auto& proxies = rpc_par_proxies_[par_id];
+  unordered_map<siteid_t, std::string> hosts;
+  unordered_set<std::string> ip_addrs;
+  for (auto& p : proxies) {
+    std::string ip = "";
+    auto cli_it = rpc_clients_.find(p.first);
+    if (cli_it != rpc_clients_.end()) {
+      ip = cli_it->second->host();
+    }
+    hosts[p.first] = ip;
+    ip_addrs.insert(ip);
+  }
+  auto group = ReplicaGroup::Intern(ip_addrs);
+  for (auto& pair : hosts) {
+    replica_index_[pair.first] = group->IndexOf(pair.second);
+  }
+  replica_groups_[par_id] = group;
+  return group;
+}
+
 shared_ptr<FpgaRaftForwardQuorumEvent> FpgaRaftCommo::SendForward(parid_t par_id, 
                                             parid_t self_id, shared_ptr<Marshallable> cmd)
 {
@@ -42,7 +67,9 @@ shared_ptr<FpgaRaftForwardQuorumEvent> FpgaRaftCommo::SendForward(parid_t par_id
 }
 
 void FpgaRaftCommo::BroadcastHeartbeat(parid_t par_id,
-																			 uint64_t logIndex) {
+																			 uint64_t currentTerm,
+																			 uint64_t logIndex,
+																			 LeaderLease* lease) {
   //std::lock_guard<std::recursive_mutex> lock(mtx_);
 	//Log_info("heartbeat for log index: %d", logIndex);
 	DepId di = { "hb", -1 };
@@ -55,21 +82,35 @@ void FpgaRaftCommo::BroadcastHeartbeat(parid_t par_id,
 		auto follower_id = p.first;
     auto proxy = (FpgaRaftProxy*) p.second;
     FutureAttr fuattr;
+    auto sent_at = LeaderLease::Now();
+    auto n_replicas = proxies.size();
     
-		fuattr.callback = [this, follower_id] (Future* fu) {
+		fuattr.callback = [this, follower_id, lease, sent_at, n_replicas, currentTerm] (Future* fu) {
+			uint64_t term = 0;
 			uint64_t index = 0;
+			uint64_t disk_us = 0;
+			if (fu->get_error_code() != 0) {
+				return;
+			}
+			fu->get_reply() >> term >> index >> disk_us;
+			if (lease != nullptr && term == currentTerm) {
+				lease->OnAck(follower_id, sent_at, n_replicas);
+			}
 			
-			fu->get_reply() >> index;
 			this->matchedIndex[follower_id] = std::max(index, this->matchedIndex[follower_id]);
+			if (disk_us > 0) {
+				this->slow_detector_->OnDisk(follower_id, disk_us);
+			}
     };
 
-    auto f = proxy->async_Heartbeat(logIndex, di, fuattr);
+    auto f = proxy->async_Heartbeat(currentTerm, logIndex, di, fuattr);
     Future::safe_release(f);
   }
 }
 
 void FpgaRaftCommo::SendHeartbeat(parid_t par_id,
 																	siteid_t site_id,
+																	uint64_t currentTerm,
 																  uint64_t logIndex) {
   //std::lock_guard<std::recursive_mutex> lock(mtx_);
   auto proxies = rpc_par_proxies_[par_id];
@@ -86,7 +127,7 @@ void FpgaRaftCommo::SendHeartbeat(parid_t par_id,
 		DepId di = { "dep",  -1 };
 		
 		//Log_info("heartbeat2 for log index: %d", logIndex);
-    auto f = proxy->async_Heartbeat(logIndex, di, fuattr);
+    auto f = proxy->async_Heartbeat(currentTerm, logIndex, di, fuattr);
     Future::safe_release(f);
   }
 }
@@ -133,6 +174,106 @@ void FpgaRaftCommo::SendAppendEntriesAgain(siteid_t site_id,
 
 }
 
+void FpgaRaftCommo::SendAppendEntriesBatch(siteid_t site_id,
+                                           parid_t par_id,
+                                           ballot_t ballot,
+                                           uint64_t currentTerm,
+                                           uint64_t prevLogIndex,
+                                           uint64_t prevLogTerm,
+                                           uint64_t commitIndex,
+                                           const vector<uint64_t>& entryTerms,
+                                           shared_ptr<Marshallable> cmds,
+                                           const function<void(bool, uint64_t, uint64_t)>& cb) {
+  auto& proxies = rpc_par_proxies_[par_id];
+  WAN_WAIT;
+  for (auto& p : proxies) {
+    if (p.first != site_id)
+        continue;
+    auto proxy = (FpgaRaftProxy*) p.second;
+    FutureAttr fuattr;
+    auto start = Time::now();
+    fuattr.callback = [this, cb, site_id, start] (Future* fu) {
+      if (fu->get_error_code() != 0) {
+        slow_detector_->OnFail(site_id);
+        cb(false, 0, 0);
+        return;
+      }
+      slow_detector_->OnReply(site_id, Time::now() - start);
+      uint64_t accept = 0;
+      uint64_t term = 0;
+      uint64_t index = 0;
+      fu->get_reply() >> accept;
+      fu->get_reply() >> term;
+      fu->get_reply() >> index;
+      cb(accept == 1, term, index);
+    };
+    MarshallDeputy md(cmds);
+    DepId di = { "dep", -1 };
+    slow_detector_->OnSend(site_id);
+    auto f = proxy->async_AppendEntriesBatch(ballot,
+                                             currentTerm,
+                                             prevLogIndex,
+                                             prevLogTerm,
+                                             commitIndex,
+                                             entryTerms,
+                                             di,
+                                             md,
+                                             fuattr);
+    if (f == nullptr) {
+      // closed or shed by flow control, the callback will never run.
+      slow_detector_->OnFail(site_id);
+      cb(false, 0, 0);
+    }
+    Future::safe_release(f);
+  }
+}
+
+void FpgaRaftCommo::SendInstallSnapshot(siteid_t site_id,
+                                        parid_t par_id,
+                                        uint64_t currentTerm,
+                                        uint64_t lastIncludedIndex,
+                                        uint64_t lastIncludedTerm,
+                                        uint64_t offset,
+                                        const std::string& data,
+                                        bool done,
+                                        const function<void(bool, uint64_t)>& cb) {
+  auto& proxies = rpc_par_proxies_[par_id];
+  bool found = false;
+  for (auto& p : proxies) {
+    if (p.first != site_id)
+        continue;
+    found = true;
+    auto proxy = (FpgaRaftProxy*) p.second;
+    FutureAttr fuattr;
+    fuattr.callback = [cb] (Future* fu) {
+      if (fu->get_error_code() != 0) {
+        cb(false, 0);
+        return;
+      }
+      uint64_t term = 0;
+      bool_t ok = 0;
+      fu->get_reply() >> term >> ok;
+      cb(ok == 1, term);
+    };
+    bool_t is_done = done;
+    auto f = proxy->async_InstallSnapshot(currentTerm,
+                                          lastIncludedIndex,
+                                          lastIncludedTerm,
+                                          offset,
+                                          data,
+                                          is_done,
+                                          fuattr);
+    if (f == nullptr) {
+      cb(false, 0);
+    }
+    Future::safe_release(f);
+  }
+  if (!found) {
+    // not connected to it, the caller retries later.
+    cb(false, 0);
+  }
+}
+
 shared_ptr<FpgaRaftAppendQuorumEvent>
 FpgaRaftCommo::BroadcastAppendEntries(parid_t par_id,
                                       slotid_t slot_id,
@@ -146,48 +287,28 @@ FpgaRaftCommo::BroadcastAppendEntries(parid_t par_id,
                                       shared_ptr<Marshallable> cmd) {
   //std::lock_guard<std::recursive_mutex> lock(mtx_);
   int n = Config::GetConfig()->GetPartitionSize(par_id);
-  auto proxies = rpc_par_proxies_[par_id];
+  auto& proxies = rpc_par_proxies_[par_id];
 	
-	unordered_set<std::string> ip_addrs {};
-	for (auto& p : proxies) {
-		auto id = p.first;
-    auto proxy = (FpgaRaftProxy*) p.second;
-
-		auto cli_it = rpc_clients_.find(id);
-		std::string ip = "";
-		if (cli_it != rpc_clients_.end()) {
-			ip = cli_it->second->host();
-			//cli = cli_it->second;
-		}
-		ip_addrs.insert(ip);
-		//clients.push_back(cli);
-	}
-  
 	DepId di = { "dep", dep_id };
-	auto e = Reactor::CreateSpEvent<FpgaRaftAppendQuorumEvent>(n, n/2 + 1, di, ip_addrs);
-	//auto e = Reactor::CreateSpEvent<FpgaRaftAppendQuorumEvent>(n, n, -1, ip_addrs);
-
-	std::vector<std::shared_ptr<rrr::Client>> clients;
+	auto group = GetReplicaGroup(par_id);
+	auto e = Reactor::CreateSpEvent<FpgaRaftAppendQuorumEvent>(n, n/2 + 1, di, group);
 
-  vector<Future*> fus;
   WAN_WAIT;
 
-	e->recordHistory(ip_addrs);
-	//e->clients_ = clients;
+	e->recordHistory();
+
+	MarshallDeputy md(cmd);
+	verify(md.sp_data_ != nullptr);
+	md.Freeze();
   
 	for (auto& p : proxies) {	
 		auto follower_id = p.first;
     auto proxy = (FpgaRaftProxy*) p.second;
-    
-		auto cli_it = rpc_clients_.find(follower_id);
-		std::string ip = "";
-		if (cli_it != rpc_clients_.end()) {
-			ip = cli_it->second->host();
-		}
+		int replica = replica_index_[follower_id];
 
 		if (p.first == this->loc_id_) {
         // fix the 1c1s1p bug
-        e->FeedResponse(true, prevLogIndex + 1, ip);
+        e->FeedResponse(true, prevLogIndex + 1, replica);
         continue;
     }
     FutureAttr fuattr;
@@ -195,8 +316,13 @@ FpgaRaftCommo::BroadcastAppendEntries(parid_t par_id,
 		struct timespec begin;
 		clock_gettime(CLOCK_MONOTONIC, &begin);
 
-    fuattr.callback = [this, e, isLeader, currentTerm, follower_id, n, ip, begin] (Future* fu) {
+    fuattr.callback = [this, e, isLeader, currentTerm, follower_id, n, replica, begin] (Future* fu) {
 			//Log_info("use_count: %d for %s and %d", e.use_count(), ip.c_str(), currentTerm);
+      if (fu->get_error_code() != 0) {
+        this->slow_detector_->OnFail(follower_id);
+        e->FeedResponse(false, 0, replica);
+        return;
+      }
       uint64_t accept = 0;
       uint64_t term = 0;
       uint64_t index = 0;
@@ -211,18 +337,23 @@ FpgaRaftCommo::BroadcastAppendEntries(parid_t par_id,
 			//Log_info("reply from server: %s and is_ready: %d", ip.c_str(), e->IsReady());
 			clock_gettime(CLOCK_MONOTONIC, &end);
 			//Log_info("time of reply on server %d: %ld", follower_id, (end.tv_sec - begin.tv_sec)*1000000000 + end.tv_nsec - begin.tv_nsec);
+			this->slow_detector_->OnReply(follower_id,
+					((end.tv_sec - begin.tv_sec)*1000000000 + end.tv_nsec - begin.tv_nsec) / 1000);
 			
       bool y = ((accept == 1) && (isLeader) && (currentTerm == term));
-      e->FeedResponse(y, index, ip);
+      if (accept == 0 && term == currentTerm) {
+        // a gap, the leader catches it up with what it has after index.
+        this->behind_[follower_id] = index;
+      }
+      e->FeedResponse(y, index, replica);
 			//Log_info("use_count2: %d for %s and %d", e.use_count(), ip.c_str(), currentTerm);
     };	
 		/*fuattr.delete_callback = [this, e] (Future* fu) {
 			//Log_info("use_count final");
 		};*/
 
-    MarshallDeputy md(cmd);
-		verify(md.sp_data_ != nullptr);
 		//outbound++;
+		slow_detector_->OnSend(follower_id);
     auto f = proxy->async_AppendEntries(slot_id,
                                         ballot,
                                         currentTerm,
@@ -232,6 +363,9 @@ FpgaRaftCommo::BroadcastAppendEntries(parid_t par_id,
 																				di,
                                         md, 
                                         fuattr);
+    if (f == nullptr) {
+      slow_detector_->OnFail(follower_id);
+    }
     Future::safe_release(f);
   }
 
@@ -280,11 +414,12 @@ void FpgaRaftCommo::BroadcastDecide(const parid_t par_id,
   //std::lock_guard<std::recursive_mutex> lock(mtx_);
   auto proxies = rpc_par_proxies_[par_id];
   vector<Future*> fus;
+  MarshallDeputy md(cmd);
+  md.Freeze();
   for (auto& p : proxies) {
     auto proxy = (FpgaRaftProxy*) p.second;
     FutureAttr fuattr;
     fuattr.callback = [](Future* fu) {};
-    MarshallDeputy md(cmd);
 		DepId di = { "dep", dep_id };
     auto f = proxy->async_Decide(slot_id, ballot, di, md, fuattr);
     Future::safe_release(f);
@@ -95,15 +95,15 @@ class FpgaRaftAppendQuorumEvent: public QuorumEvent {
  public:
     uint64_t minIndex;
     using QuorumEvent::QuorumEvent;
-    void FeedResponse(bool appendOK, uint64_t index, std::string ip_addr = "") {
+    void FeedResponse(bool appendOK, uint64_t index, int replica = -1) {
         if (appendOK) {
             if ((n_voted_yes_ == 0) && (n_voted_no_ == 0))
                 minIndex = index;
             else
                 minIndex = std::min(minIndex, index);
-            VoteYes(ip_addr);
+            VoteYes(replica);
         } else {
-            VoteNo(ip_addr);
+            VoteNo(replica);
         }
         /*Log_debug("fpga-raft comm accept event, "
                   "yes vote: %d, no vote: %d, min index: %d",
@@ -118,17 +118,29 @@ class FpgaRaftCommo : public Communicator {
 friend class FpgaRaftProxy;
  public:
 	std::unordered_map<siteid_t, uint64_t> matchedIndex {};
+	// last index of followers that rejected a non-pipelined append for a gap.
+	std::unordered_map<siteid_t, uint64_t> behind_ {};
 	std::unordered_map<siteid_t, bool> resend {};
 	int index;
+	// replica group of each partition and each site's index in it, built on
+	// first use so that broadcasts do not look up addresses.
+	std::unordered_map<parid_t, ReplicaGroup*> replica_groups_ {};
+	std::unordered_map<siteid_t, int> replica_index_ {};
+
+	ReplicaGroup* GetReplicaGroup(parid_t par_id);
 	
   FpgaRaftCommo() = delete;
   FpgaRaftCommo(PollMgr*);
   shared_ptr<FpgaRaftForwardQuorumEvent>
   SendForward(parid_t par_id, parid_t self_id, shared_ptr<Marshallable> cmd);  
+	// acks of followers in currentTerm extend lease, unless it is nullptr.
 	void BroadcastHeartbeat(parid_t par_id,
-													uint64_t logIndex);
+													uint64_t currentTerm,
+													uint64_t logIndex,
+													LeaderLease* lease = nullptr);
 	void SendHeartbeat(parid_t par_id,
 										 siteid_t site_id,
+										 uint64_t currentTerm,
 										 uint64_t logIndex);
 	//ONLY FOR SIMULATION
   void SendAppendEntriesAgain(siteid_t site_id,
@@ -141,6 +153,29 @@ friend class FpgaRaftProxy;
 															uint64_t prevLogTerm,
 															uint64_t commitIndex,
 															shared_ptr<Marshallable> cmd);
+  // one pipelined AppendEntries carrying a BulkPaxosCmd of consecutive
+  // entries after prevLogIndex and the term of each; cb gets (ok, follower
+  // term, follower index).
+  void SendAppendEntriesBatch(siteid_t site_id,
+                              parid_t par_id,
+                              ballot_t ballot,
+                              uint64_t currentTerm,
+                              uint64_t prevLogIndex,
+                              uint64_t prevLogTerm,
+                              uint64_t commitIndex,
+                              const vector<uint64_t>& entryTerms,
+                              shared_ptr<Marshallable> cmds,
+                              const function<void(bool, uint64_t, uint64_t)> &cb);
+  // one chunk of the snapshot at offset; cb gets (ok, follower term).
+  void SendInstallSnapshot(siteid_t site_id,
+                           parid_t par_id,
+                           uint64_t currentTerm,
+                           uint64_t lastIncludedIndex,
+                           uint64_t lastIncludedTerm,
+                           uint64_t offset,
+                           const std::string& data,
+                           bool done,
+                           const function<void(bool, uint64_t)> &cb);
   shared_ptr<FpgaRaftPrepareQuorumEvent>
   BroadcastPrepare(parid_t par_id,
                    slotid_t slot_id,
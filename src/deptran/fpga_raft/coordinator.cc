@@ -65,6 +65,15 @@ void CoordinatorFpgaRaft::AppendEntries() {
     verify(!in_append_entries);
     // verify(this->sch_->IsLeader()); TODO del it yidawu
     in_append_entries = true;
+    if (this->sch_->IsPipelined()) {
+      // the server streams the entry to the followers together with its
+      // neighbours, we only wait for a majority to have it.
+      auto index = this->sch_->AppendLocal(cmd_, slot_id_, curr_ballot_);
+      this->sch_->WaitReplicated(index);
+      minIndex = std::max(this->sch_->quorum_index_, this->sch_->commitIndex);
+      committed_ = true;
+      return;
+    }
     Log_debug("fpga-raft coordinator broadcasts append entries, "
                   "par_id_: %lx, slot_id: %llx, lastLogIndex: %d",
               par_id_, slot_id_, this->sch_->lastLogIndex);
@@ -95,6 +104,7 @@ void CoordinatorFpgaRaft::AppendEntries() {
 
 		struct timespec start_;
 		clock_gettime(CLOCK_MONOTONIC, &start_);
+    auto lease_start = LeaderLease::Now();
     sp_quorum->Wait();
 		struct timespec end_;
 		clock_gettime(CLOCK_MONOTONIC, &end_);
@@ -145,6 +155,8 @@ void CoordinatorFpgaRaft::AppendEntries() {
         minIndex = sp_quorum->minIndex;
         verify(minIndex >= this->sch_->commitIndex) ;
         committed_ = true;
+        this->sch_->lease_.OnQuorum(lease_start);
+        this->sch_->CatchUpFollowers();
         Log_debug("fpga-raft append commited loc:%d minindex:%d", loc_id_, minIndex ) ;
     }
     else if (sp_quorum->No()) {
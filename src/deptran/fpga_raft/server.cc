@@ -1,11 +1,14 @@
 
 
+#include <fstream>
+
 #include "server.h"
 // #include "paxos_worker.h"
 #include "exec.h"
 #include "frame.h"
 #include "coordinator.h"
 #include "../classic/tpc_command.h"
+#include "../paxos/commo.h"
 
 
 namespace janus {
@@ -21,6 +24,19 @@ FpgaRaftServer::FpgaRaftServer(Frame * frame) {
   frame_ = frame ;
   setIsFPGALeader(frame_->site_info_->locale_id == 0) ;
   setIsLeader(frame_->site_info_->locale_id == 0) ;
+  append_window_ = Config::GetConfig()->repl_append_window_;
+  append_max_entries_ = Config::GetConfig()->repl_append_max_entries_;
+  lease_.SetDuration(Config::GetConfig()->repl_lease_us_);
+  if (SegLog() != nullptr && seg_log_recovered_end_ > 1) {
+    // pick up where the last run stopped, entries are read back lazily.
+    lastLogIndex = seg_log_recovered_end_ - 1;
+    currentTerm = GetFpgaRaftInstance(lastLogIndex)->term;
+  }
+  snapshot_interval_ = Config::GetConfig()->repl_snapshot_interval_;
+  snapshot_chunk_ = Config::GetConfig()->repl_snapshot_chunk_;
+  if (SegLog() != nullptr) {
+    LoadSnapshot();
+  }
   stop_ = false ;
   //timer_ = new Timer() ;
 }
@@ -46,6 +62,10 @@ void* FpgaRaftServer::HeartbeatLoop(void* args) {
 	while(FpgaRaftServer::looping) {
 		usleep(5*1000);
     std::lock_guard<std::recursive_mutex> lock(hb_loop_args->sch->mtx_);
+		if (!hb_loop_args->sch->IsLeader()) {
+			// stepped down, acks to our heartbeats would not make a lease.
+			continue;
+		}
 		uint64_t prevLogIndex = hb_loop_args->sch->lastLogIndex;	
 		
 		auto instance = hb_loop_args->sch->GetFpgaRaftInstance(prevLogIndex);
@@ -57,7 +77,10 @@ void* FpgaRaftServer::HeartbeatLoop(void* args) {
 		
 		
 		parid_t partition_id = hb_loop_args->sch->partition_id_;
-		hb_loop_args->commo->BroadcastHeartbeat(partition_id, prevLogIndex);
+		hb_loop_args->commo->BroadcastHeartbeat(partition_id,
+																						hb_loop_args->sch->currentTerm,
+																						prevLogIndex,
+																						&hb_loop_args->sch->lease_);
 
 		auto matcheds = hb_loop_args->commo->matchedIndex;
 		for (auto it = matcheds.begin(); it != matcheds.end(); it++) {
@@ -109,7 +132,6 @@ void FpgaRaftServer::RequestVote2FPGA() {
 
   Log_debug("fpga raft server %d in request vote to fpga", loc_id );
 
-  uint32_t lstoff = 0  ;
   slotid_t lst_idx = 0 ;
   ballot_t lst_term = 0 ;
 
@@ -118,10 +140,8 @@ void FpgaRaftServer::RequestVote2FPGA() {
     // TODO set fpga isleader false, recheck 
     setIsFPGALeader(false) ;
     currentTerm++ ;
-    lstoff = lastLogIndex - snapidx_ ;
-    auto log = GetFpgaRaftInstance(lstoff) ;
-    lst_idx = lstoff + snapidx_ ;
-    lst_term = log->term ;
+    lst_idx = lastLogIndex ;
+    lst_term = LastLogTerm() ;
   }
   
   auto sp_quorum = ((FpgaRaftCommo *)(this->commo_))->BroadcastVote2FPGA(par_id,lst_idx,lst_term,loc_id, currentTerm );
@@ -157,7 +177,7 @@ void FpgaRaftServer::OnVote2FPGA(const slotid_t& lst_log_idx,
   Log_debug("fpga raft receives vote from candidate: %llx", can_id);
 
   uint64_t cur_term = currentTerm ;
-  if( can_term < cur_term)
+  if( can_term < cur_term || lease_.Granted())
   {
     doVote(lst_log_idx, lst_log_term, can_id, can_term, reply_term, vote_granted, false, cb) ;
     return ;
@@ -172,23 +192,10 @@ void FpgaRaftServer::OnVote2FPGA(const slotid_t& lst_log_idx,
     return ;
   }
 
-  // lstoff starts from 1
-  uint32_t lstoff = lastLogIndex - snapidx_ ;
-
-  ballot_t curlstterm = snapterm_ ;
+  ballot_t curlstterm = LastLogTerm() ;
   slotid_t curlstidx = lastLogIndex ;
 
-  if(lstoff > 0 )
-  {
-    auto log = GetFpgaRaftInstance(lstoff) ;
-    curlstterm = log->term ;
-  }
-
-  Log_debug("vote for lstoff %d, curlstterm %d, curlstidx %d", lstoff, curlstterm, curlstidx  );
-
-
-  // TODO del only for test 
-  verify(lstoff == lastLogIndex ) ;
+  Log_debug("vote for curlstterm %d, curlstidx %d", curlstterm, curlstidx  );
 
   if( lst_log_term > curlstterm || (lst_log_term == curlstterm && lst_log_idx >= curlstidx) )
   {
@@ -220,7 +227,6 @@ bool FpgaRaftServer::RequestVote() {
 
   Log_debug("fpga raft server %d in request vote", loc_id );
 
-  uint32_t lstoff = 0  ;
   slotid_t lst_idx = 0 ;
   ballot_t lst_term = 0 ;
 
@@ -229,10 +235,8 @@ bool FpgaRaftServer::RequestVote() {
     // TODO set fpga isleader false, recheck 
     setIsFPGALeader(false) ;
     currentTerm++ ;
-    lstoff = lastLogIndex - snapidx_ ;
-    auto log = GetFpgaRaftInstance(lstoff) ;
-    lst_idx = lstoff + snapidx_ ;
-    lst_term = log->term ;
+    lst_idx = lastLogIndex ;
+    lst_term = LastLogTerm() ;
   }
   
   auto sp_quorum = ((FpgaRaftCommo *)(this->commo_))->BroadcastVote(par_id,lst_idx,lst_term,loc_id, currentTerm );
@@ -297,7 +301,7 @@ void FpgaRaftServer::OnVote(const slotid_t& lst_log_idx,
   // TODO wait all the log pushed to fpga host
 
   uint64_t cur_term = currentTerm ;
-  if( can_term < cur_term)
+  if( can_term < cur_term || lease_.Granted())
   {
     doVote(lst_log_idx, lst_log_term, can_id, can_term, reply_term, vote_granted, false, cb) ;
     return ;
@@ -312,23 +316,10 @@ void FpgaRaftServer::OnVote(const slotid_t& lst_log_idx,
     return ;
   }
 
-  // lstoff starts from 1
-  uint32_t lstoff = lastLogIndex - snapidx_ ;
-
-  ballot_t curlstterm = snapterm_ ;
+  ballot_t curlstterm = LastLogTerm() ;
   slotid_t curlstidx = lastLogIndex ;
 
-  if(lstoff > 0 )
-  {
-    auto log = GetFpgaRaftInstance(lstoff) ;
-    curlstterm = log->term ;
-  }
-
-  Log_debug("vote for lstoff %d, curlstterm %d, curlstidx %d", lstoff, curlstterm, curlstidx  );
-
-
-  // TODO del only for test 
-  verify(lstoff == lastLogIndex ) ;
+  Log_debug("vote for curlstterm %d, curlstidx %d", curlstterm, curlstidx  );
 
   if( lst_log_term > curlstterm || (lst_log_term == curlstterm && lst_log_idx >= curlstidx) )
   {
@@ -395,9 +386,11 @@ void FpgaRaftServer::StartTimer()
                 "slot_id: %llx, loc: %d, PrevLogIndex: %d",
                 slot_id, this->loc_id_, leaderPrevLogIndex);
         if ((leaderCurrentTerm >= this->currentTerm) &&
-                (leaderPrevLogIndex <= this->lastLogIndex)
+                (leaderPrevLogIndex <= this->lastLogIndex) &&
+                (leaderPrevLogIndex >= (uint64_t) snapidx_)
                 /* TODO: log[leaderPrevLogidex].term == leaderPrevLogTerm */) {
             //resetTimer() ;
+            lease_.Grant();
             if (leaderCurrentTerm > this->currentTerm) {
                 currentTerm = leaderCurrentTerm;
                 Log_debug("server %d, set to be follower", loc_id_ ) ;
@@ -433,35 +426,14 @@ void FpgaRaftServer::StartTimer()
             *followerCurrentTerm = this->currentTerm;
             *followerLastLogIndex = this->lastLogIndex;
             
-						if (cmd->kind_ == MarshallDeputy::CMD_TPC_PREPARE){
-              auto p_cmd = dynamic_pointer_cast<TpcPrepareCommand>(cmd);
-              auto sp_vec_piece = dynamic_pointer_cast<VecPieceData>(p_cmd->cmd_)->sp_vec_piece_data_;
-              
-							vector<struct KeyValue> kv_vector;
-							int index = 0;
-							for (auto it = sp_vec_piece->begin(); it != sp_vec_piece->end(); it++){
-								auto cmd_input = (*it)->input.values_;
-								for (auto it2 = cmd_input->begin(); it2 != cmd_input->end(); it2++) {
-									struct KeyValue key_value = {it2->first, it2->second.get_i32()};
-									kv_vector.push_back(key_value);
-								}
-							}
-
-							struct KeyValue key_values[kv_vector.size()];
-							std::copy(kv_vector.begin(), kv_vector.end(), key_values);
-
-							auto de = IO::write("/db/data.txt", key_values, sizeof(struct KeyValue), kv_vector.size());
-							de->Wait();
-            } else {
-							int value = -1;
-							auto de = IO::write("/db/data.txt", &value, sizeof(int), 1);
-              de->Wait();
-            }
+            PersistLogs(lastLogIndex, {cmd});
         }
         else {
             Log_debug("reject append loc: %d, leader term %d last idx %d, server term: %d last idx: %d",
                 this->loc_id_, leaderCurrentTerm, leaderPrevLogIndex, currentTerm, lastLogIndex);          
             *followerAppendOK = 0;
+            *followerCurrentTerm = this->currentTerm;
+            *followerLastLogIndex = this->lastLogIndex;
         }
 
 				/*if (rand() % 1000 == 0) {
@@ -472,6 +444,545 @@ void FpgaRaftServer::StartTimer()
         cb();
     }
 
+  void FpgaRaftServer::PersistLogs(uint64_t first_index,
+                                   const vector<shared_ptr<Marshallable>>& cmds) {
+    auto start = Time::now();
+    if (SegLog() != nullptr) {
+      for (size_t i = 0; i < cmds.size(); i++) {
+        auto instance = GetFpgaRaftInstance(first_index + i);
+        Marshal m;
+        MarshallDeputy md(cmds[i]);
+        m << instance->term << instance->ballot << instance->slot_id << md;
+        AppendSegLog(first_index + i, m);
+      }
+      SyncSegLog();
+    } else {
+      std::string buf;
+      for (auto& cmd : cmds) {
+        if (cmd->kind_ == MarshallDeputy::CMD_TPC_PREPARE) {
+          auto p_cmd = dynamic_pointer_cast<TpcPrepareCommand>(cmd);
+          auto sp_vec_piece = dynamic_pointer_cast<VecPieceData>(p_cmd->cmd_)->sp_vec_piece_data_;
+          for (auto it = sp_vec_piece->begin(); it != sp_vec_piece->end(); it++) {
+            auto cmd_input = (*it)->input.values_;
+            for (auto it2 = cmd_input->begin(); it2 != cmd_input->end(); it2++) {
+              struct KeyValue key_value = {it2->first, it2->second.get_i32()};
+              buf.append((const char*) &key_value, sizeof(struct KeyValue));
+            }
+          }
+        } else {
+          int value = -1;
+          buf.append((const char*) &value, sizeof(int));
+        }
+      }
+      auto de = IO::write("/db/data.txt", (void*) buf.data(), 1, buf.size());
+      de->Wait();
+    }
+    uint64_t latency = Time::now() - start;
+    uint64_t smoothed = disk_us_;
+    disk_us_ = smoothed == 0 ? latency : (smoothed * 7 + latency) / 8;
+  }
+
+
+  void FpgaRaftServer::LoadInstance(slotid_t id, FpgaRaftData& instance) {
+    const char* data;
+    size_t len;
+    if (!SegLog()->Read(id, &data, &len)) {
+      return;
+    }
+    Marshal m;
+    m.write(data, len);
+    MarshallDeputy md;
+    m >> instance.term >> instance.ballot >> instance.slot_id >> md;
+    instance.prevTerm = instance.term;
+    instance.log_ = md.sp_data_;
+  }
+
+  uint64_t FpgaRaftServer::AppendLocal(shared_ptr<Marshallable>& cmd,
+                                       slotid_t slot_id,
+                                       ballot_t ballot) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    uint64_t index = NewLocalEntry(cmd, slot_id, ballot);
+    // the followers write the entry while the leader does.
+    PumpAppendEntries();
+    PersistLogs(index, {cmd});
+    persisted_.insert(index);
+    while (!persisted_.empty() && *persisted_.begin() == durable_index_ + 1) {
+      persisted_.erase(persisted_.begin());
+      durable_index_++;
+    }
+    AdvanceQuorumIndex();
+    return index;
+  }
+
+  void FpgaRaftServer::WaitReplicated(uint64_t index) {
+    if (quorum_index_ >= index) {
+      return;
+    }
+    auto sp_e = Reactor::CreateSpEvent<IntEvent>();
+    replicated_waiters_.emplace(index, sp_e);
+    sp_e->Wait();
+  }
+
+  void FpgaRaftServer::PumpAppendEntries() {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto commo = (FpgaRaftCommo*) commo_;
+    if (progress_.empty()) {
+      for (auto& p : commo->rpc_par_proxies_[partition_id_]) {
+        if (p.first != loc_id_) {
+          progress_[p.first].next_index = lastLogIndex;
+        }
+      }
+    }
+    // while the healthy replicas can form a majority by themselves, a slow
+    // follower gets one append at a time so that it does not hold back the
+    // leader, it still catches up.
+    std::set<siteid_t> slow;
+    for (auto& pair : progress_) {
+      if (commo->IsSlowReplica(partition_id_, pair.first)) {
+        slow.insert(pair.first);
+      }
+    }
+    size_t n_replicas = progress_.size() + 1;
+    if (n_replicas - slow.size() < n_replicas / 2 + 1) {
+      slow.clear();
+    }
+    for (auto& pair : progress_) {
+      auto site_id = pair.first;
+      auto& pg = pair.second;
+      if (pg.in_snapshot) {
+        continue;
+      }
+      uint32_t window = slow.count(site_id) > 0 ? 1 : append_window_;
+      if (pg.next_index <= (uint64_t) snapidx_ && pg.next_index <= lastLogIndex) {
+        // what the follower needs next is compacted away.
+        SendSnapshot(site_id, 0);
+        continue;
+      }
+      while (pg.n_inflight < window && pg.next_index <= lastLogIndex) {
+        uint64_t prev = pg.next_index - 1;
+        uint64_t last = std::min(lastLogIndex, prev + append_max_entries_);
+        uint64_t prev_term = prev > 0 ? GetFpgaRaftInstance(prev)->term : 0;
+        auto sp_bulk = std::make_shared<BulkPaxosCmd>();
+        vector<uint64_t> terms;
+        for (uint64_t i = prev + 1; i <= last; i++) {
+          auto instance = GetFpgaRaftInstance(i);
+          sp_bulk->cmds_.push_back(instance->log_);
+          terms.push_back(instance->term);
+        }
+        pg.next_index = last + 1;
+        pg.n_inflight++;
+        auto epoch = pg.epoch;
+        auto sent_at = LeaderLease::Now();
+        commo->SendAppendEntriesBatch(site_id,
+                                      partition_id_,
+                                      GetFpgaRaftInstance(last)->ballot,
+                                      currentTerm,
+                                      prev,
+                                      prev_term,
+                                      commitIndex,
+                                      terms,
+                                      sp_bulk,
+                                      [this, site_id, epoch, sent_at, last] (bool ok, uint64_t term, uint64_t index) {
+          OnAppendEntriesReply(site_id, epoch, sent_at, last, ok, term, index);
+        });
+        if (pg.epoch != epoch) {
+          // failed before it left, e.g. shed by flow control; leave the
+          // rest to the next append instead of spinning.
+          break;
+        }
+      }
+    }
+  }
+
+  void FpgaRaftServer::OnAppendEntriesReply(siteid_t site_id,
+                                            uint64_t epoch,
+                                            uint64_t sent_at,
+                                            uint64_t last,
+                                            bool ok,
+                                            uint64_t term,
+                                            uint64_t index) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto& pg = progress_[site_id];
+    verify(pg.n_inflight > 0);
+    pg.n_inflight--;
+    if (ok && term == currentTerm) {
+      pg.match_index = std::max(pg.match_index, last);
+      lease_.OnAck(site_id, sent_at, progress_.size() + 1);
+      AdvanceQuorumIndex();
+    } else if (term > currentTerm) {
+      Log_debug("fpga-raft loc %d sees term %d from %d, stop pipelining",
+                loc_id_, term, site_id);
+      return;
+    } else if (epoch == pg.epoch) {
+      // a gap or a lost connection: resend everything after what the
+      // follower has, in-flight sends of this epoch will be rejected.
+      pg.epoch++;
+      pg.next_index = std::max(pg.match_index, std::min(last, index)) + 1;
+      if (term == 0) {
+        // the rpc failed, retry on the next append instead of spinning.
+        return;
+      }
+    }
+    PumpAppendEntries();
+  }
+
+  void FpgaRaftServer::SendSnapshot(siteid_t site_id, uint64_t offset) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto commo = (FpgaRaftCommo*) commo_;
+    progress_[site_id].in_snapshot = true;
+    auto snap_idx = snapidx_;
+    uint64_t len = std::min<uint64_t>(snapshot_chunk_, snapshot_.size() - offset);
+    bool done = offset + len == snapshot_.size();
+    commo->SendInstallSnapshot(site_id,
+                               partition_id_,
+                               currentTerm,
+                               snapidx_,
+                               snapterm_,
+                               offset,
+                               snapshot_.substr(offset, len),
+                               done,
+                               [this, site_id, snap_idx, offset, len, done] (bool ok, uint64_t term) {
+      OnInstallSnapshotReply(site_id, snap_idx, offset + len, done, ok, term);
+    });
+  }
+
+  void FpgaRaftServer::OnInstallSnapshotReply(siteid_t site_id,
+                                              slotid_t snap_idx,
+                                              uint64_t next_offset,
+                                              bool done,
+                                              bool ok,
+                                              uint64_t term) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto& pg = progress_[site_id];
+    if (!ok || term != currentTerm) {
+      // the next append starts over.
+      pg.in_snapshot = false;
+      return;
+    }
+    if (snap_idx != snapidx_) {
+      // a newer snapshot was taken meanwhile, send that one instead.
+      SendSnapshot(site_id, 0);
+      return;
+    }
+    if (!done) {
+      SendSnapshot(site_id, next_offset);
+      return;
+    }
+    Log_info("fpga-raft loc %d installed snapshot at %d on site %d",
+             loc_id_, (int) snap_idx, site_id);
+    pg.in_snapshot = false;
+    if (!IsPipelined()) {
+      CatchUp(site_id, snap_idx);
+      return;
+    }
+    pg.epoch++;
+    pg.match_index = std::max(pg.match_index, (uint64_t) snap_idx);
+    pg.next_index = snap_idx + 1;
+    AdvanceQuorumIndex();
+    PumpAppendEntries();
+  }
+
+  void FpgaRaftServer::CatchUpFollowers() {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto commo = (FpgaRaftCommo*) commo_;
+    std::unordered_map<siteid_t, uint64_t> behind;
+    behind.swap(commo->behind_);
+    for (auto& pair : behind) {
+      CatchUp(pair.first, pair.second);
+    }
+  }
+
+  void FpgaRaftServer::CatchUp(siteid_t site_id, uint64_t follower_last) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    auto commo = (FpgaRaftCommo*) commo_;
+    auto& pg = progress_[site_id];
+    if (pg.in_snapshot || pg.n_inflight > 0 || follower_last >= lastLogIndex) {
+      return;
+    }
+    if (follower_last < (uint64_t) snapidx_) {
+      // what the follower needs next is compacted away.
+      SendSnapshot(site_id, 0);
+      return;
+    }
+    uint64_t prev = follower_last;
+    uint64_t last = std::min(lastLogIndex, prev + append_max_entries_);
+    uint64_t prev_term = prev > 0 ? GetFpgaRaftInstance(prev)->term : 0;
+    auto sp_bulk = std::make_shared<BulkPaxosCmd>();
+    vector<uint64_t> terms;
+    for (uint64_t i = prev + 1; i <= last; i++) {
+      auto instance = GetFpgaRaftInstance(i);
+      sp_bulk->cmds_.push_back(instance->log_);
+      terms.push_back(instance->term);
+    }
+    pg.n_inflight++;
+    commo->SendAppendEntriesBatch(site_id,
+                                  partition_id_,
+                                  GetFpgaRaftInstance(last)->ballot,
+                                  currentTerm,
+                                  prev,
+                                  prev_term,
+                                  commitIndex,
+                                  terms,
+                                  sp_bulk,
+                                  [this, site_id] (bool ok, uint64_t term, uint64_t index) {
+      std::lock_guard<std::recursive_mutex> lock(mtx_);
+      progress_[site_id].n_inflight--;
+      if (term != currentTerm) {
+        // a failed rpc or a newer leader, the next gap starts over.
+        return;
+      }
+      CatchUp(site_id, index);
+    });
+  }
+
+  void FpgaRaftServer::OnHeartbeat(const uint64_t leaderCurrentTerm,
+                                   uint64_t *followerCurrentTerm,
+                                   uint64_t *followerLastLogIndex) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    if (leaderCurrentTerm > currentTerm) {
+      currentTerm = leaderCurrentTerm;
+      setIsLeader(false) ;
+    }
+    if (leaderCurrentTerm == currentTerm) {
+      lease_.Grant();
+    }
+    *followerCurrentTerm = currentTerm;
+    *followerLastLogIndex = lastLogIndex;
+  }
+
+  void FpgaRaftServer::OnInstallSnapshot(const uint64_t leaderCurrentTerm,
+                                         const uint64_t lastIncludedIndex,
+                                         const uint64_t lastIncludedTerm,
+                                         const uint64_t offset,
+                                         const std::string& data,
+                                         const bool_t done,
+                                         uint64_t *followerCurrentTerm,
+                                         bool_t *followerOK,
+                                         const function<void()> &cb) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    if (offset == 0) {
+      snapshot_in_.clear();
+    }
+    if (leaderCurrentTerm < currentTerm || offset != snapshot_in_.size()) {
+      // a stale leader, or a chunk after a lost one.
+      *followerCurrentTerm = currentTerm;
+      *followerOK = 0;
+      cb();
+      return;
+    }
+    if (leaderCurrentTerm > currentTerm) {
+      currentTerm = leaderCurrentTerm;
+      setIsLeader(false) ;
+    }
+    snapshot_in_.append(data);
+    if (done) {
+      InstallSnapshot(lastIncludedIndex, lastIncludedTerm);
+    }
+    *followerCurrentTerm = currentTerm;
+    *followerOK = 1;
+    cb();
+  }
+
+  void FpgaRaftServer::InstallSnapshot(slotid_t snap_idx, ballot_t snap_term) {
+    if (snap_idx <= (slotid_t) executeIndex) {
+      // everything in it is applied here already.
+      snapshot_in_.clear();
+      return;
+    }
+    verify(app_restore_);
+    Marshal m;
+    m.write(snapshot_in_.data(), snapshot_in_.size());
+    app_restore_(m);
+    snapshot_ = std::move(snapshot_in_);
+    snapshot_in_.clear();
+    snapshot_pending_ = false;
+    // keep the entries after the snapshot if they are from the same history.
+    bool keep_tail = lastLogIndex > (uint64_t) snap_idx &&
+        GetFpgaRaftInstance(snap_idx)->term == snap_term;
+    if (!keep_tail) {
+      raft_logs_.Clear();
+      lastLogIndex = snap_idx;
+    }
+    snapidx_ = snap_idx;
+    snapterm_ = snap_term;
+    executeIndex = snap_idx;
+    commitIndex = std::max(commitIndex, (uint64_t) snap_idx);
+    executed_cv_.notify_all();
+    CompactLog();
+    GetFpgaRaftInstance(snap_idx)->term = snap_term;
+  }
+
+  void FpgaRaftServer::TakeSnapshot() {
+    Marshal m;
+    app_snapshot_(m);
+    auto n = m.content_size();
+    snapshot_.resize(n);
+    verify(m.read(&snapshot_[0], n) == n);
+    snapterm_ = GetFpgaRaftInstance(executeIndex)->term;
+    snapidx_ = executeIndex;
+    CompactLog();
+    Log_debug("fpga-raft loc %d snapshot at %d, %d bytes",
+              loc_id_, (int) snapidx_, (int) n);
+  }
+
+  void FpgaRaftServer::CompactLog() {
+    min_active_slot_ = snapidx_;
+    raft_logs_.TruncateBefore(snapidx_);
+    if (SegLog() != nullptr) {
+      // the snapshot has to be on disk before the log it replaces goes.
+      PersistSnapshot();
+      SegLog()->TruncateBefore(snapidx_);
+    }
+  }
+
+  void FpgaRaftServer::PersistSnapshot() {
+    auto path = SegLogDir() + "/snapshot";
+    uint64_t header[2] = {snapidx_, (uint64_t) snapterm_};
+    std::string buf((const char*) header, sizeof(header));
+    buf.append(snapshot_);
+    auto de = Reactor::CreateSpEvent<DiskEvent>([path, buf] () {
+      // written aside and renamed, so a crash leaves the old one intact.
+      auto tmp = path + ".tmp";
+      FILE* f = fopen(tmp.c_str(), "w");
+      verify(f != nullptr);
+      verify(fwrite(buf.data(), 1, buf.size(), f) == buf.size());
+      fflush(f);
+      fsync(fileno(f));
+      fclose(f);
+      verify(rename(tmp.c_str(), path.c_str()) == 0);
+    });
+    de->AddToList();
+    de->Wait();
+  }
+
+  void FpgaRaftServer::LoadSnapshot() {
+    std::ifstream in(SegLogDir() + "/snapshot", std::ios::binary);
+    if (!in) {
+      return;
+    }
+    std::string buf((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+    uint64_t header[2];
+    verify(buf.size() >= sizeof(header));
+    memcpy(header, buf.data(), sizeof(header));
+    snapidx_ = header[0];
+    snapterm_ = (ballot_t) header[1];
+    snapshot_ = buf.substr(sizeof(header));
+    snapshot_pending_ = true;
+    executeIndex = snapidx_;
+    commitIndex = snapidx_;
+    min_active_slot_ = snapidx_;
+    raft_logs_.TruncateBefore(snapidx_);
+    if (lastLogIndex < (uint64_t) snapidx_) {
+      lastLogIndex = snapidx_;
+      currentTerm = std::max(currentTerm, (uint64_t) snapterm_);
+    }
+    GetFpgaRaftInstance(snapidx_)->term = snapterm_;
+    Log_info("fpga-raft loc %d restarts from snapshot at %d, log ends at %d",
+             loc_id_, (int) snapidx_, (int) lastLogIndex);
+  }
+
+  bool FpgaRaftServer::WaitForRead() {
+    if (!IsLeader() || !lease_.Valid()) {
+      return false;
+    }
+    std::unique_lock<std::recursive_mutex> lock(mtx_);
+    uint64_t read_index = commitIndex;
+    executed_cv_.wait(lock, [this, read_index] () {
+      return executeIndex >= read_index;
+    });
+    return lease_.Valid();
+  }
+
+  void FpgaRaftServer::AdvanceQuorumIndex() {
+    vector<uint64_t> matched{durable_index_};
+    for (auto& pair : progress_) {
+      matched.push_back(pair.second.match_index);
+    }
+    std::sort(matched.begin(), matched.end(), std::greater<uint64_t>());
+    uint64_t index = matched[matched.size() / 2];
+    if (index <= quorum_index_) {
+      return;
+    }
+    quorum_index_ = index;
+    auto it = replicated_waiters_.begin();
+    while (it != replicated_waiters_.end() && it->first <= quorum_index_) {
+      it->second->Set(1);
+      it = replicated_waiters_.erase(it);
+    }
+  }
+
+  void FpgaRaftServer::OnAppendEntriesBatch(const ballot_t ballot,
+                                            const uint64_t leaderCurrentTerm,
+                                            const uint64_t leaderPrevLogIndex,
+                                            const uint64_t leaderPrevLogTerm,
+                                            const uint64_t leaderCommitIndex,
+                                            const vector<uint64_t> &entryTerms,
+                                            vector<shared_ptr<Marshallable>> &cmds,
+                                            uint64_t *followerAppendOK,
+                                            uint64_t *followerCurrentTerm,
+                                            uint64_t *followerLastLogIndex,
+                                            const function<void()> &cb) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
+    verify(entryTerms.size() == cmds.size());
+    if (leaderCurrentTerm > currentTerm) {
+      currentTerm = leaderCurrentTerm;
+      Log_debug("server %d, set to be follower", loc_id_ ) ;
+      setIsLeader(false) ;
+    }
+    // entries up to snapidx_ are committed, so they match whatever the
+    // leader has there.
+    bool gap = leaderPrevLogIndex > lastLogIndex;
+    bool prev_ok = !gap &&
+        (leaderPrevLogIndex <= (uint64_t) snapidx_ ||
+         GetFpgaRaftInstance(leaderPrevLogIndex)->term == leaderPrevLogTerm);
+    if (leaderCurrentTerm < currentTerm || !prev_ok) {
+      // a batch that arrived ahead of an earlier one is answered with the
+      // contiguous prefix, one whose previous entry is from another term
+      // with the index before it; the leader resends from there.
+      Log_debug("reject append batch loc: %d, leader term %d prev idx %d prev term %d, server term: %d last idx: %d",
+                loc_id_, leaderCurrentTerm, leaderPrevLogIndex, leaderPrevLogTerm, currentTerm, lastLogIndex);
+      *followerAppendOK = 0;
+      *followerCurrentTerm = currentTerm;
+      *followerLastLogIndex = gap || leaderCurrentTerm < currentTerm ?
+          lastLogIndex : leaderPrevLogIndex - 1;
+      cb();
+      return;
+    }
+    lease_.Grant();
+    uint64_t last = leaderPrevLogIndex + cmds.size();
+    // entries up to snapidx_ are in the snapshot already.
+    uint64_t skip = leaderPrevLogIndex < (uint64_t) snapidx_ ?
+        std::min<uint64_t>(snapidx_ - leaderPrevLogIndex, cmds.size()) : 0;
+    // a resend of entries we already have must not cut the log short, but
+    // an entry whose term differs from the leader's starts a stale tail.
+    bool conflict = false;
+    for (uint64_t i = skip; i < cmds.size(); i++) {
+      uint64_t idx = leaderPrevLogIndex + 1 + i;
+      auto instance = GetFpgaRaftInstance(idx);
+      if (idx <= lastLogIndex && instance->term != entryTerms[i]) {
+        conflict = true;
+      }
+      instance->log_ = cmds[i];
+      instance->term = entryTerms[i];
+      instance->ballot = ballot;
+    }
+    if (conflict || lastLogIndex < last) {
+      lastLogIndex = last;
+    }
+    commitIndex = std::max(commitIndex, std::min(leaderCommitIndex, last));
+    if (skip > 0) {
+      PersistLogs(leaderPrevLogIndex + 1 + skip,
+                  vector<shared_ptr<Marshallable>>(cmds.begin() + skip, cmds.end()));
+    } else {
+      PersistLogs(leaderPrevLogIndex + 1, cmds);
+    }
+    *followerAppendOK = 1;
+    *followerCurrentTerm = currentTerm;
+    *followerLastLogIndex = lastLogIndex;
+    cb();
+  }
+
     void FpgaRaftServer::OnForward(shared_ptr<Marshallable> &cmd, 
                                           uint64_t *cmt_idx,
                                           const function<void()> &cb) {
@@ -504,19 +1015,43 @@ void FpgaRaftServer::StartTimer()
       return;
     }
     in_applying_logs_ = true;
+    if (snapshot_pending_ && app_restore_) {
+      Marshal m;
+      m.write(snapshot_.data(), snapshot_.size());
+      app_restore_(m);
+      snapshot_pending_ = false;
+    }
     
-    for (slotid_t id = executeIndex + 1; id <= commitIndex; id++) {
+    for (;;) {
+      vector<shared_ptr<Marshallable>> batch;
+      auto from = executeIndex;
+      auto snap = snapidx_;
+      for (slotid_t id = executeIndex + 1; id <= commitIndex; id++) {
         auto next_instance = GetFpgaRaftInstance(id);
-        if (next_instance->log_) {
-            Log_debug("fpga-raft par:%d loc:%d executed slot %lx now", partition_id_, loc_id_, id);
-            app_next_(*next_instance->log_);
-            executeIndex++;
-        } else {
-						//Log_info("breaking: %d", id);
-            break;
+        if (!next_instance->log_) {
+          break;
         }
+        batch.push_back(next_instance->log_);
+      }
+      if (batch.empty()) {
+        break;
+      }
+      PrepareCommitted(batch);
+      if (executeIndex != from || snapidx_ != snap) {
+        // a snapshot was installed while the batch was prepared.
+        continue;
+      }
+      ApplyCommitted(batch);
+      executeIndex += batch.size();
+      executed_cv_.notify_all();
+      Log_debug("fpga-raft par:%d loc:%d executed slots up to %lx now",
+                partition_id_, loc_id_, executeIndex);
     }
 		//Log_info("OnCommit finish2");
+    if (snapshot_interval_ > 0 && app_snapshot_ &&
+        executeIndex >= snapidx_ + snapshot_interval_) {
+      TakeSnapshot();
+    }
     in_applying_logs_ = false;
 
 		/*clock_gettime(CLOCK_MONOTONIC, &end);
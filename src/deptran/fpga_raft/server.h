@@ -33,6 +33,18 @@ struct KeyValue {
 	i32 value;
 };
 
+// what the leader knows about one follower when AppendEntries are pipelined,
+// or while it catches up a follower without pipelining.
+struct AppendProgress {
+  uint64_t next_index = 0;  // first entry not sent yet
+  uint64_t match_index = 0; // highest entry the follower has acked
+  uint32_t n_inflight = 0;
+  // bumped on every rewind, so that replies to older sends are ignored.
+  uint64_t epoch = 0;
+  // streaming a snapshot, appends to this follower wait until it is done.
+  bool in_snapshot = false;
+};
+
 class FpgaRaftServer : public TxLogServer {
  private:
    std::vector<std::thread> timer_threads_ = {};
@@ -69,6 +81,9 @@ class FpgaRaftServer : public TxLogServer {
   {
     Log_debug("set loc_id %d is leader %d", loc_id_, isLeader) ;
     is_leader_ = isLeader ;
+    if (!isLeader) {
+      lease_.Revoke();
+    }
   }
 
   void setIsFPGALeader(bool isLeader)
@@ -150,11 +165,80 @@ class FpgaRaftServer : public TxLogServer {
   uint64_t currentTerm = 0;
   uint64_t commitIndex = 0;
   uint64_t executeIndex = 0;
-  map<slotid_t, shared_ptr<FpgaRaftData>> raft_logs_{};
-//  vector<shared_ptr<FpgaRaftData>> raft_logs_{};
+  SlotWindow<shared_ptr<FpgaRaftData>> raft_logs_{};
+
+  // pipelined AppendEntries (leader only), on when append_window_ > 0.
+  uint32_t append_window_ = 0;
+  uint32_t append_max_entries_ = 1;
+  map<siteid_t, AppendProgress> progress_{};
+  // highest index such that it and all before it are on the local disk.
+  uint64_t durable_index_ = 0;
+  std::set<uint64_t> persisted_{};
+  // highest index stored on a majority.
+  uint64_t quorum_index_ = 0;
+  // smoothed latency of local log writes, reported to the leader in
+  // heartbeat replies.
+  std::atomic<uint64_t> disk_us_{0};
+  std::multimap<uint64_t, shared_ptr<IntEvent>> replicated_waiters_{};
+
+  // the state machine after applying every entry up to snapidx_, taken
+  // each snapshot_interval_ applied entries; the log before snapidx_ is
+  // dropped then.
+  uint64_t snapshot_interval_ = 0;
+  uint32_t snapshot_chunk_ = 0;
+  std::string snapshot_{};
+  // read back at restart, restored into the application before the first
+  // entry is applied.
+  bool snapshot_pending_ = false;
+  // chunks of the snapshot being installed by the leader.
+  std::string snapshot_in_{};
+
+  // term of the last entry, which may be in the snapshot.
+  ballot_t LastLogTerm() {
+    if (lastLogIndex > (uint64_t) snapidx_) {
+      return GetFpgaRaftInstance(lastLogIndex)->term;
+    }
+    return snapterm_;
+  }
+  void TakeSnapshot();
+  // drops the log before snapidx_, the entry at snapidx_ is kept so that
+  // the next append can check its term.
+  void CompactLog();
+  void PersistSnapshot();
+  void LoadSnapshot();
+  void SendSnapshot(siteid_t site_id, uint64_t offset);
+  void OnInstallSnapshotReply(siteid_t site_id,
+                              slotid_t snap_idx,
+                              uint64_t next_offset,
+                              bool done,
+                              bool ok,
+                              uint64_t term);
+  void InstallSnapshot(slotid_t snap_idx, ballot_t snap_term);
+  // without pipelining, a follower that rejected an append for a gap is
+  // sent what it misses, one batch at a time, or the snapshot if that is
+  // compacted away.
+  void CatchUpFollowers();
+  void CatchUp(siteid_t site_id, uint64_t follower_last);
+
+  bool IsPipelined() {
+    return append_window_ > 0;
+  }
+  uint64_t AppendLocal(shared_ptr<Marshallable>& cmd, slotid_t slot_id, ballot_t ballot);
+  void WaitReplicated(uint64_t index);
+  void PumpAppendEntries();
+  void OnAppendEntriesReply(siteid_t site_id,
+                            uint64_t epoch,
+                            uint64_t sent_at,
+                            uint64_t last,
+                            bool ok,
+                            uint64_t term,
+                            uint64_t index);
+  void AdvanceQuorumIndex();
 
   void StartTimer() ;
 
+  bool WaitForRead() override;
+
   bool IsLeader()
   {
     return is_leader_ ;
@@ -168,6 +252,15 @@ class FpgaRaftServer : public TxLogServer {
   void SetLocalAppend(shared_ptr<Marshallable>& cmd, uint64_t* term, uint64_t* index, slotid_t slot_id = -1, ballot_t ballot = 1 ){
     std::lock_guard<std::recursive_mutex> lock(mtx_);
     *index = lastLogIndex ;
+    NewLocalEntry(cmd, slot_id, ballot);
+    PersistLogs(lastLogIndex, {cmd});
+    *term = currentTerm ;
+  }
+
+  // appends cmd to the local log and returns its index, nothing is written
+  // to disk yet.
+  uint64_t NewLocalEntry(shared_ptr<Marshallable>& cmd, slotid_t slot_id, ballot_t ballot) {
+    std::lock_guard<std::recursive_mutex> lock(mtx_);
     lastLogIndex += 1;
     auto instance = GetFpgaRaftInstance(lastLogIndex);
 		//Log_info("setting log here: %d", lastLogIndex);
@@ -177,44 +270,16 @@ class FpgaRaftServer : public TxLogServer {
     instance->term = currentTerm;
 		instance->slot_id = slot_id;
 		instance->ballot = ballot;
-
-    if (cmd->kind_ == MarshallDeputy::CMD_TPC_PREPARE){
-      auto p_cmd = dynamic_pointer_cast<TpcPrepareCommand>(cmd);
-      auto sp_vec_piece = dynamic_pointer_cast<VecPieceData>(p_cmd->cmd_)->sp_vec_piece_data_;
-			vector<struct KeyValue> kv_vector;
-			int index = 0;
-			for (auto it = sp_vec_piece->begin(); it != sp_vec_piece->end(); it++){
-				auto cmd_input = (*it)->input.values_;
-				for (auto it2 = cmd_input->begin(); it2 != cmd_input->end(); it2++) {
-					struct KeyValue key_value = {it2->first, it2->second.get_i32()};
-					kv_vector.push_back(key_value);
-				}
-			}
-
-			struct KeyValue key_values[kv_vector.size()];
-			std::copy(kv_vector.begin(), kv_vector.end(), key_values);
-
-			struct KeyValue key_value_[2];
-			auto de = IO::write("/db/data.txt", key_values, sizeof(struct KeyValue), kv_vector.size());
-			
-			struct timespec begin, end;
-			//clock_gettime(CLOCK_MONOTONIC, &begin);
-      de->Wait();
-			//clock_gettime(CLOCK_MONOTONIC, &end);
-			//Log_info("Time of Write: %d", end.tv_nsec - begin.tv_nsec);
-    } else {
-			int value = -1;
-			int value_;
-			auto de = IO::write("/db/data.txt", &value, sizeof(int), 1);
-			struct timespec begin, end;
-			//clock_gettime(CLOCK_MONOTONIC, &begin);
-      de->Wait();
-			//clock_gettime(CLOCK_MONOTONIC, &end);
-			//Log_info("Time of Write: %d", end.tv_nsec - begin.tv_nsec);
-    }
-    *term = currentTerm ;
+    return lastLogIndex;
   }
-  
+
+  // writes the entries first_index, first_index + 1, ... to disk with one
+  // group write and waits for it.
+  void PersistLogs(uint64_t first_index,
+                   const vector<shared_ptr<Marshallable>>& cmds);
+  // fills in what the persistent log has for an index after a restart.
+  void LoadInstance(slotid_t id, FpgaRaftData& instance);
+
   shared_ptr<FpgaRaftData> GetInstance(slotid_t id) {
     verify(id >= min_active_slot_);
     auto& sp_instance = logs_[id];
@@ -235,8 +300,12 @@ class FpgaRaftServer : public TxLogServer {
    shared_ptr<FpgaRaftData> GetFpgaRaftInstance(slotid_t id) {
      verify(id >= min_active_slot_);
      auto& sp_instance = raft_logs_[id];
-     if(!sp_instance)
+     if(!sp_instance) {
        sp_instance = std::make_shared<FpgaRaftData>();
+       if (id < seg_log_recovered_end_) {
+         LoadInstance(id, *sp_instance);
+       }
+     }
      return sp_instance;
    }
 
@@ -274,6 +343,34 @@ class FpgaRaftServer : public TxLogServer {
                        uint64_t *followerLastLogIndex,
                        const function<void()> &cb);
 
+  void OnAppendEntriesBatch(const ballot_t ballot,
+                            const uint64_t leaderCurrentTerm,
+                            const uint64_t leaderPrevLogIndex,
+                            const uint64_t leaderPrevLogTerm,
+                            const uint64_t leaderCommitIndex,
+                            const vector<uint64_t> &entryTerms,
+                            vector<shared_ptr<Marshallable>> &cmds,
+                            uint64_t *followerAppendOK,
+                            uint64_t *followerCurrentTerm,
+                            uint64_t *followerLastLogIndex,
+                            const function<void()> &cb);
+
+  // only a leader of the current term extends the lease, a stale one
+  // learns the newer term from the reply.
+  void OnHeartbeat(const uint64_t leaderCurrentTerm,
+                   uint64_t *followerCurrentTerm,
+                   uint64_t *followerLastLogIndex);
+
+  void OnInstallSnapshot(const uint64_t leaderCurrentTerm,
+                         const uint64_t lastIncludedIndex,
+                         const uint64_t lastIncludedTerm,
+                         const uint64_t offset,
+                         const std::string& data,
+                         const bool_t done,
+                         uint64_t *followerCurrentTerm,
+                         bool_t *followerOK,
+                         const function<void()> &cb);
+
   void OnCommit(const slotid_t slot_id,
                 const ballot_t ballot,
                 shared_ptr<Marshallable> &cmd);
@@ -1,6 +1,7 @@
 
 #include "service.h"
 #include "server.h"
+#include "../paxos/commo.h"
 
 namespace janus {
 
@@ -11,13 +12,15 @@ FpgaRaftServiceImpl::FpgaRaftServiceImpl(TxLogServer *sched)
 	srand(curr_time.tv_nsec);
 }
 
-void FpgaRaftServiceImpl::Heartbeat(const uint64_t& leaderPrevLogIndex,
+void FpgaRaftServiceImpl::Heartbeat(const uint64_t& leaderCurrentTerm,
+																		const uint64_t& leaderPrevLogIndex,
 																		const DepId& dep_id,
+																		uint64_t* followerCurrentTerm,
 																		uint64_t* followerPrevLogIndex,
-																		rrr::DeferredReply* defer) {
+																		uint64_t* disk_us) {
 	//Log_info("received heartbeat");
-	*followerPrevLogIndex = sched_->lastLogIndex;
-	defer->reply();
+	sched_->OnHeartbeat(leaderCurrentTerm, followerCurrentTerm, followerPrevLogIndex);
+	*disk_us = sched_->disk_us_;
 }
 
 void FpgaRaftServiceImpl::Forward(const MarshallDeputy& cmd,
@@ -120,6 +123,59 @@ void FpgaRaftServiceImpl::AppendEntries(const uint64_t& slot,
 	
 }
 
+void FpgaRaftServiceImpl::AppendEntriesBatch(const ballot_t& ballot,
+                                             const uint64_t& leaderCurrentTerm,
+                                             const uint64_t& leaderPrevLogIndex,
+                                             const uint64_t& leaderPrevLogTerm,
+                                             const uint64_t& leaderCommitIndex,
+                                             const vector<uint64_t>& entryTerms,
+                                             const DepId& dep_id,
+                                             const MarshallDeputy& cmds,
+                                             uint64_t *followerAppendOK,
+                                             uint64_t *followerCurrentTerm,
+                                             uint64_t *followerLastLogIndex,
+                                             rrr::DeferredReply* defer) {
+  verify(sched_ != nullptr);
+  Coroutine::CreateRun([&] () {
+    auto sp_bulk = dynamic_pointer_cast<BulkPaxosCmd>(cmds.sp_data_);
+    verify(sp_bulk != nullptr);
+    sched_->OnAppendEntriesBatch(ballot,
+                                 leaderCurrentTerm,
+                                 leaderPrevLogIndex,
+                                 leaderPrevLogTerm,
+                                 leaderCommitIndex,
+                                 entryTerms,
+                                 sp_bulk->cmds_,
+                                 followerAppendOK,
+                                 followerCurrentTerm,
+                                 followerLastLogIndex,
+                                 std::bind(&rrr::DeferredReply::reply, defer));
+  });
+}
+
+void FpgaRaftServiceImpl::InstallSnapshot(const uint64_t& leaderCurrentTerm,
+                                          const uint64_t& lastIncludedIndex,
+                                          const uint64_t& lastIncludedTerm,
+                                          const uint64_t& offset,
+                                          const std::string& data,
+                                          const bool_t& done,
+                                          uint64_t *followerCurrentTerm,
+                                          bool_t *followerOK,
+                                          rrr::DeferredReply* defer) {
+  verify(sched_ != nullptr);
+  Coroutine::CreateRun([&] () {
+    sched_->OnInstallSnapshot(leaderCurrentTerm,
+                              lastIncludedIndex,
+                              lastIncludedTerm,
+                              offset,
+                              data,
+                              done,
+                              followerCurrentTerm,
+                              followerOK,
+                              std::bind(&rrr::DeferredReply::reply, defer));
+  });
+}
+
 void FpgaRaftServiceImpl::Decide(const uint64_t& slot,
                                    const ballot_t& ballot,
 																	 const DepId& dep_id,
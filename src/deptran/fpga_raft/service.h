@@ -19,10 +19,12 @@ class FpgaRaftServiceImpl : public FpgaRaftService {
   std::recursive_mutex mtx_{};
   FpgaRaftServer* sched_;
   FpgaRaftServiceImpl(TxLogServer* sched);
-	void Heartbeat(const uint64_t& leaderPrevLogIndex,
+	void Heartbeat(const uint64_t& leaderCurrentTerm,
+								 const uint64_t& leaderPrevLogIndex,
 								 const DepId& dep_id,
+								 uint64_t* followerCurrentTerm,
 								 uint64_t* followerPrevLogIndex,
-								 rrr::DeferredReply* defer) override;
+								 uint64_t* disk_us) override;
   void Forward(const MarshallDeputy& cmd,
                uint64_t *cmt_idx,
                rrr::DeferredReply* defer) override;
@@ -43,6 +45,29 @@ class FpgaRaftServiceImpl : public FpgaRaftService {
                   bool_t *vote_granted,
                   rrr::DeferredReply* defer) override;
 
+  void AppendEntriesBatch(const ballot_t& ballot,
+                          const uint64_t& leaderCurrentTerm,
+                          const uint64_t& leaderPrevLogIndex,
+                          const uint64_t& leaderPrevLogTerm,
+                          const uint64_t& leaderCommitIndex,
+                          const vector<uint64_t>& entryTerms,
+                          const DepId& dep_id,
+                          const MarshallDeputy& cmds,
+                          uint64_t *followerAppendOK,
+                          uint64_t *followerCurrentTerm,
+                          uint64_t *followerLastLogIndex,
+                          rrr::DeferredReply* defer) override;
+
+  void InstallSnapshot(const uint64_t& leaderCurrentTerm,
+                       const uint64_t& lastIncludedIndex,
+                       const uint64_t& lastIncludedTerm,
+                       const uint64_t& offset,
+                       const std::string& data,
+                       const bool_t& done,
+                       uint64_t *followerCurrentTerm,
+                       bool_t *followerOK,
+                       rrr::DeferredReply* defer) override;
+
 	void AppendEntries2(const uint64_t& slot,
                       const ballot_t& ballot,
                       const uint64_t& leaderCurrentTerm,
@@ -0,0 +1,56 @@
+#include <chrono>
+
+#include "lease.h"
+
+namespace janus {
+
+uint64_t LeaderLease::Now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LeaderLease::OnAck(siteid_t site, uint64_t sent_at, size_t n_replicas) {
+  if (duration_us_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& acked = acked_[site];
+  if (sent_at <= acked) {
+    return;
+  }
+  acked = sent_at;
+  // the leader counts itself, so it needs n_replicas / 2 follower acks.
+  size_t need = n_replicas / 2;
+  if (need == 0) {
+    OnQuorum(sent_at);
+    return;
+  }
+  if (acked_.size() < need) {
+    return;
+  }
+  vector<uint64_t> times;
+  for (auto& pair : acked_) {
+    times.push_back(pair.second);
+  }
+  std::nth_element(times.begin(), times.begin() + (need - 1), times.end(),
+                   std::greater<uint64_t>());
+  OnQuorum(times[need - 1]);
+}
+
+void LeaderLease::OnQuorum(uint64_t sent_at) {
+  if (duration_us_ == 0) {
+    return;
+  }
+  uint64_t until = sent_at + (uint64_t) (duration_us_ * (1 - DRIFT));
+  uint64_t cur = until_;
+  while (cur < until && !until_.compare_exchange_weak(cur, until)) {
+  }
+}
+
+void LeaderLease::Revoke() {
+  until_ = 0;
+  std::lock_guard<std::mutex> lock(mtx_);
+  acked_.clear();
+}
+
+} // namespace janus
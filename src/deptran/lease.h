@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "__dep__.h"
+
+namespace janus {
+
+/**
+ * Time based leader lease. A follower that takes a message from the leader
+ * promises not to support another leader for duration_us after it got it.
+ * Counting from when it sent the message, the leader may then serve reads
+ * locally until the time a majority has acked, plus duration_us, minus a
+ * margin for clock drift.
+ *
+ * Times are taken from a monotonic clock, so they are only compared on
+ * the machine that took them. Thread safe, acks come from poll threads.
+ */
+class LeaderLease {
+ public:
+  // share of the lease the leader does not use, covers clock rate drift.
+  static constexpr double DRIFT = 0.1;
+
+  // monotonic, in microseconds.
+  static uint64_t Now();
+
+  // 0 turns leases off: Valid() and Granted() are always false.
+  void SetDuration(uint64_t duration_us) {
+    duration_us_ = duration_us;
+  }
+
+  uint64_t Duration() const {
+    return duration_us_;
+  }
+
+  // leader: site acked a message sent at sent_at, n_replicas counting the
+  // leader itself.
+  void OnAck(siteid_t site, uint64_t sent_at, size_t n_replicas);
+  // leader: a majority acked a message sent at sent_at.
+  void OnQuorum(uint64_t sent_at);
+  // leader: reads may be served locally.
+  bool Valid() const {
+    return duration_us_ > 0 && Now() < until_;
+  }
+  // leader: stepped down, or saw a higher term.
+  void Revoke();
+
+  // follower: took a message from the current leader.
+  void Grant() {
+    if (duration_us_ > 0) {
+      granted_until_ = Now() + duration_us_;
+    }
+  }
+  // follower: still bound to the current leader.
+  bool Granted() const {
+    return duration_us_ > 0 && Now() < granted_until_;
+  }
+
+ private:
+  uint64_t duration_us_ = 0;
+  std::atomic<uint64_t> until_{0};
+  std::atomic<uint64_t> granted_until_{0};
+  std::mutex mtx_{};
+  // send time of the newest message each follower acked.
+  std::map<siteid_t, uint64_t> acked_{};
+};
+
+} // namespace janus
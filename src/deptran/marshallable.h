@@ -30,6 +30,8 @@ class MarshallDeputy {
  public:
   shared_ptr<Marshallable> sp_data_{nullptr};
   int32_t kind_{0};
+  // serialized payload, see Freeze().
+  shared_ptr<Marshal> sp_frozen_{nullptr};
   enum Kind {
     UNKNOWN = 0,
     EMPTY_GRAPH = 1,
@@ -61,6 +63,21 @@ class MarshallDeputy {
     kind_ = m->kind_;
   }
 
+  /**
+   * Serializes the payload once, so that every later send attaches the same
+   * bytes by reference instead of marshaling the command again, e.g. when
+   * broadcasting it to all followers. sp_data_ must not change afterwards.
+   */
+  void Freeze() {
+    verify(kind_ != UNKNOWN);
+    verify(sp_data_);
+    if (sp_frozen_ == nullptr) {
+      sp_frozen_ = std::make_shared<Marshal>();
+      *sp_frozen_ << kind_;
+      sp_data_->ToMarshal(*sp_frozen_);
+    }
+  }
+
   ~MarshallDeputy() = default;
 };
 
@@ -72,6 +89,10 @@ inline Marshal& operator>>(Marshal& m, MarshallDeputy& rhs) {
 
 inline Marshal& operator<<(Marshal& m, const MarshallDeputy& rhs) {
   verify(rhs.kind_ != MarshallDeputy::UNKNOWN);
+  if (rhs.sp_frozen_) {
+    m.write_ref(*rhs.sp_frozen_);
+    return m;
+  }
   m << rhs.kind_;
   verify(rhs.sp_data_); // must be non-empty
   rhs.sp_data_->ToMarshal(m);
@@ -9,6 +9,33 @@
 
 namespace janus {
 
+static int volatile x_bulk =
+    MarshallDeputy::RegInitializer(MarshallDeputy::CMD_BLK_PXS,
+                                   []() -> Marshallable* {
+                                     return new BulkPaxosCmd;
+                                   });
+
+Marshal& BulkPaxosCmd::ToMarshal(Marshal& m) const {
+  m << (int32_t) cmds_.size();
+  for (auto& sp_cmd : cmds_) {
+    MarshallDeputy md(sp_cmd);
+    m << md;
+  }
+  return m;
+}
+
+Marshal& BulkPaxosCmd::FromMarshal(Marshal& m) {
+  int32_t n = 0;
+  m >> n;
+  cmds_.reserve(n);
+  for (int32_t i = 0; i < n; i++) {
+    MarshallDeputy md;
+    m >> md;
+    cmds_.push_back(md.sp_data_);
+  }
+  return m;
+}
+
 MultiPaxosCommo::MultiPaxosCommo(PollMgr* poll) : Communicator(poll) {
 //  verify(poll != nullptr);
 }
@@ -110,6 +137,8 @@ MultiPaxosCommo::BroadcastAccept(parid_t par_id,
   auto minutes = chrono::duration_cast<chrono::minutes>(start-midn);
 
   auto start_ = chrono::duration_cast<chrono::microseconds>(start-midn-hours-minutes).count();
+  MarshallDeputy md(cmd);
+  md.Freeze();
   WAN_WAIT;
   for (auto& p : proxies) {
     auto proxy = (MultiPaxosProxy*) p.second;
@@ -118,20 +147,29 @@ MultiPaxosCommo::BroadcastAccept(parid_t par_id,
     e->add_dep(leader_id, src_coroid, follower_id, -1);
 
     FutureAttr fuattr;
-    fuattr.callback = [e, start, ballot, leader_id, src_coroid, follower_id] (Future* fu) {
+    fuattr.callback = [this, e, start, ballot, leader_id, src_coroid, follower_id] (Future* fu) {
+      if (fu->get_error_code() != 0) {
+        slow_detector_->OnFail(follower_id);
+        e->FeedResponse(false);
+        return;
+      }
       ballot_t b = 0;
       uint64_t coro_id = 0;
       fu->get_reply() >> b >> coro_id;
       e->FeedResponse(b==ballot);
       auto end = chrono::system_clock::now();
       auto duration = chrono::duration_cast<chrono::microseconds>(end-start).count();
+      slow_detector_->OnReply(follower_id, duration);
       //Log_info("The duration of Accept() for %d is: %d", follower_id, duration);
       e->deps[leader_id][src_coroid][follower_id].erase(-1);
       e->deps[leader_id][src_coroid][follower_id].insert(coro_id);
     };
-    MarshallDeputy md(cmd);
     auto start1 = chrono::system_clock::now();
+    slow_detector_->OnSend(follower_id);
     auto f = proxy->async_Accept(slot_id, start_, ballot, md, fuattr);
+    if (f == nullptr) {
+      slow_detector_->OnFail(follower_id);
+    }
     auto end1 = chrono::system_clock::now();
     auto duration = chrono::duration_cast<chrono::microseconds>(end1-start1).count();
     Log_info("Time for Async_Accept() for %d is: %d", follower_id, duration);
@@ -168,15 +206,76 @@ void MultiPaxosCommo::BroadcastDecide(const parid_t par_id,
   auto proxies = rpc_par_proxies_[par_id];
   auto leader_id = LeaderProxyForPartition(par_id).first;
   vector<Future*> fus;
+  MarshallDeputy md(cmd);
+  md.Freeze();
   for (auto& p : proxies) {
     auto proxy = (MultiPaxosProxy*) p.second;
     FutureAttr fuattr;
     fuattr.callback = [](Future* fu) {};
-    MarshallDeputy md(cmd);
     auto f = proxy->async_Decide(slot_id, ballot, md, fuattr);
     //sp_quorum_event->add_dep(leader_id, p.first);
     Future::safe_release(f);
   }
 }
 
+shared_ptr<PaxosAcceptQuorumEvent>
+MultiPaxosCommo::BroadcastBulkAccept(parid_t par_id,
+                                     slotid_t start_slot,
+                                     ballot_t ballot,
+                                     shared_ptr<Marshallable> cmds) {
+  int n = Config::GetConfig()->GetPartitionSize(par_id);
+  auto e = Reactor::CreateSpEvent<PaxosAcceptQuorumEvent>(n, n/2+1);
+  auto src_coroid = e->GetCoroId();
+  auto proxies = rpc_par_proxies_[par_id];
+  auto leader_id = LeaderProxyForPartition(par_id).first;
+  auto start = Time::now();
+  MarshallDeputy md(cmds);
+  md.Freeze();
+  WAN_WAIT;
+  for (auto& p : proxies) {
+    auto proxy = (MultiPaxosProxy*) p.second;
+    auto follower_id = p.first;
+    e->add_dep(leader_id, src_coroid, follower_id, -1);
+
+    FutureAttr fuattr;
+    fuattr.callback = [this, e, start, ballot, leader_id, src_coroid, follower_id] (Future* fu) {
+      if (fu->get_error_code() != 0) {
+        slow_detector_->OnFail(follower_id);
+        e->FeedResponse(false);
+        return;
+      }
+      ballot_t b = 0;
+      uint64_t coro_id = 0;
+      fu->get_reply() >> b >> coro_id;
+      e->FeedResponse(b==ballot);
+      slow_detector_->OnReply(follower_id, Time::now() - start);
+      e->deps[leader_id][src_coroid][follower_id].erase(-1);
+      e->deps[leader_id][src_coroid][follower_id].insert(coro_id);
+    };
+    slow_detector_->OnSend(follower_id);
+    auto f = proxy->async_BulkAccept(start_slot, ballot, md, fuattr);
+    if (f == nullptr) {
+      slow_detector_->OnFail(follower_id);
+    }
+    Future::safe_release(f);
+  }
+  return e;
+}
+
+void MultiPaxosCommo::BroadcastBulkDecide(parid_t par_id,
+                                          slotid_t start_slot,
+                                          ballot_t ballot,
+                                          shared_ptr<Marshallable> cmds) {
+  auto proxies = rpc_par_proxies_[par_id];
+  MarshallDeputy md(cmds);
+  md.Freeze();
+  for (auto& p : proxies) {
+    auto proxy = (MultiPaxosProxy*) p.second;
+    FutureAttr fuattr;
+    fuattr.callback = [](Future* fu) {};
+    auto f = proxy->async_BulkDecide(start_slot, ballot, md, fuattr);
+    Future::safe_release(f);
+  }
+}
+
 } // namespace janus
@@ -41,6 +41,15 @@ class PaxosAcceptQuorumEvent: public QuorumEvent {
   }
 };
 
+// commands of a contiguous slot range, proposed and decided together.
+class BulkPaxosCmd : public Marshallable {
+ public:
+  vector<shared_ptr<Marshallable>> cmds_{};
+  BulkPaxosCmd() : Marshallable(MarshallDeputy::CMD_BLK_PXS) {}
+  Marshal& ToMarshal(Marshal& m) const override;
+  Marshal& FromMarshal(Marshal& m) override;
+};
+
 class MultiPaxosCommo : public Communicator {
  public:
   MultiPaxosCommo() = delete;
@@ -74,6 +83,15 @@ class MultiPaxosCommo : public Communicator {
                        const slotid_t slot_id,
                        const ballot_t ballot,
                        const shared_ptr<Marshallable> cmd);
+  shared_ptr<PaxosAcceptQuorumEvent>
+  BroadcastBulkAccept(parid_t par_id,
+                      slotid_t start_slot,
+                      ballot_t ballot,
+                      shared_ptr<Marshallable> cmds);
+  void BroadcastBulkDecide(parid_t par_id,
+                           slotid_t start_slot,
+                           ballot_t ballot,
+                           shared_ptr<Marshallable> cmds);
 };
 
 } // namespace janus
@@ -41,6 +41,12 @@ void CoordinatorMultiPaxos::Submit(shared_ptr<Marshallable>& cmd,
   in_submission_ = true;
   cmd_ = cmd;
   verify(cmd_->kind_ != MarshallDeputy::UNKNOWN);
+  if (IsBulk()) {
+    // the frame handed out slot_id_ already, reserve the rest of the range.
+    auto n = dynamic_pointer_cast<BulkPaxosCmd>(cmd_)->cmds_.size();
+    verify(n > 0);
+    *slot_hint_ += n - 1;
+  }
   commit_callback_ = func;
   GotoNextPhase();
 }
@@ -125,7 +131,13 @@ void CoordinatorMultiPaxos::Accept() {
                 "par_id_: %lx, slot_id: %llx",
             par_id_, slot_id_);
   auto start = chrono::system_clock::now();
-  auto sp_quorum = commo()->BroadcastAccept(par_id_, slot_id_, curr_ballot_, cmd_);
+  auto lease_start = LeaderLease::Now();
+  shared_ptr<PaxosAcceptQuorumEvent> sp_quorum;
+  if (IsBulk()) {
+    sp_quorum = commo()->BroadcastBulkAccept(par_id_, slot_id_, curr_ballot_, cmd_);
+  } else {
+    sp_quorum = commo()->BroadcastAccept(par_id_, slot_id_, curr_ballot_, cmd_);
+  }
   sp_quorum->id_ = dep_id_;
 	Log_info("current coroutine's dep_id: %d", Coroutine::CurrentCoroutine()->dep_id_);
   //Log_info("Accept(): %d", dep_id_);
@@ -139,6 +151,10 @@ void CoordinatorMultiPaxos::Accept() {
   sp_quorum->log();
   if (sp_quorum->Yes()) {
     committed_ = true;
+    if (sch_ != nullptr) {
+      // the acceptors granted the lease when they took the accept.
+      sch_->lease_.OnQuorum(lease_start);
+    }
   } else if (sp_quorum->No()) {
     // TODO process the case: failed to get a majority.
     verify(0);
@@ -185,7 +201,11 @@ void CoordinatorMultiPaxos::Commit() {
   commit_callback_();
   Log_debug("multi-paxos broadcast commit for partition: %d, slot %d",
             (int) par_id_, (int) slot_id_);
-  commo()->BroadcastDecide(par_id_, slot_id_, curr_ballot_, cmd_);
+  if (IsBulk()) {
+    commo()->BroadcastBulkDecide(par_id_, slot_id_, curr_ballot_, cmd_);
+  } else {
+    commo()->BroadcastDecide(par_id_, slot_id_, curr_ballot_, cmd_);
+  }
   verify(phase_ == Phase::COMMIT);
   GotoNextPhase();
 }
@@ -32,6 +32,8 @@ class CoordinatorMultiPaxos : public Coordinator {
   uint32_t n_replica_ = 0;   // TODO
   slotid_t slot_id_ = 0;
   slotid_t *slot_hint_ = nullptr;
+  // the local server, nullptr when not created on a replica.
+  TxLogServer *sch_ = nullptr;
 
   uint32_t n_replica() {
     verify(n_replica_ > 0);
@@ -53,6 +55,11 @@ class CoordinatorMultiPaxos : public Coordinator {
     return n_replica() / 2 + 1;
   }
 
+  // a BulkPaxosCmd takes the slots slot_id_ .. slot_id_ + size - 1.
+  bool IsBulk() {
+    return cmd_ != nullptr && cmd_->kind_ == MarshallDeputy::CMD_BLK_PXS;
+  }
+
   void DoTxAsync(TxRequest &req) override {}
   void Submit(shared_ptr<Marshallable> &cmd,
               const std::function<void()> &func = []() {},
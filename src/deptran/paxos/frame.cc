@@ -64,6 +64,7 @@ Coordinator *MultiPaxosFrame::CreateCoordinator(cooid_t coo_id,
   coo->slot_id_ = slot_hint_++;
   coo->n_replica_ = config->GetPartitionSize(site_info_->partition_id_);
   coo->loc_id_ = this->site_info_->locale_id;
+  coo->sch_ = sch_;
   verify(coo->n_replica_ != 0); // TODO
   Log_debug("create new multi-paxos coord, coo_id: %d", (int) coo->coo_id_);
   return coo;
@@ -71,8 +72,8 @@ Coordinator *MultiPaxosFrame::CreateCoordinator(cooid_t coo_id,
 
 TxLogServer *MultiPaxosFrame::CreateScheduler() {
   TxLogServer *sch = nullptr;
-  sch = new PaxosServer();
-  sch->frame_ = this;
+  sch = new PaxosServer(this);
+  sch_ = sch;
   return sch;
 }
 
@@ -11,6 +11,7 @@ class MultiPaxosFrame : public Frame {
  private:
   slotid_t slot_hint_ = 1;
  public:
+  TxLogServer *sch_ = nullptr;
   MultiPaxosFrame(int mode);
   MultiPaxosCommo *commo_ = nullptr;
   Executor *CreateExecutor(cmdid_t cmd_id, TxLogServer *sched) override;
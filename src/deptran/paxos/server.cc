@@ -6,6 +6,15 @@
 
 namespace janus {
 
+PaxosServer::PaxosServer(Frame* frame) {
+  frame_ = frame;
+  lease_.SetDuration(Config::GetConfig()->repl_lease_us_);
+  if (SegLog() != nullptr) {
+    Log_info("multi-paxos recovered slots below %lld",
+             (long long) seg_log_recovered_end_);
+  }
+}
+
 
 void PaxosServer::OnForward(shared_ptr<Marshallable> &cmd,
                             uint64_t dep_id,
@@ -42,6 +51,13 @@ void PaxosServer::OnPrepare(slotid_t slot_id,
   Log_debug("multi-paxos scheduler receives prepare for slot_id: %llx",
             slot_id);
   auto instance = GetInstance(slot_id);
+  if (lease_.Granted()) {
+    // the current leader's lease has not run out, do not support another.
+    *coro_id = Coroutine::CurrentCoroutine()->id;
+    *max_ballot = instance->max_ballot_seen_;
+    cb();
+    return;
+  }
   verify(ballot != instance->max_ballot_seen_);
   if (instance->max_ballot_seen_ < ballot) {
     instance->max_ballot_seen_ = ballot;
@@ -49,6 +65,11 @@ void PaxosServer::OnPrepare(slotid_t slot_id,
     // TODO if accepted anything, return;
     verify(0);
   }
+  if (SegLog() != nullptr) {
+    // a promise must survive a restart like an accept.
+    PersistInstance(slot_id, *instance);
+    SyncSegLog();
+  }
   *coro_id = Coroutine::CurrentCoroutine()->id;
   *max_ballot = instance->max_ballot_seen_;
   n_prepare_++;
@@ -74,11 +95,18 @@ void PaxosServer::OnAccept(const slotid_t slot_id,
   if (instance->max_ballot_seen_ <= ballot) {
     instance->max_ballot_seen_ = ballot;
     instance->max_ballot_accepted_ = ballot;
+    instance->accepted_cmd_ = cmd;
+    lease_.Grant();
   } else {
     // TODO
     verify(0);
   }
 
+  if (SegLog() != nullptr) {
+    PersistInstance(slot_id, *instance);
+    SyncSegLog();
+  }
+
   *coro_id = Coroutine::CurrentCoroutine()->id;
   *max_ballot = instance->max_ballot_seen_;
   n_accept_++;
@@ -90,38 +118,144 @@ void PaxosServer::OnCommit(const slotid_t slot_id,
                            shared_ptr<Marshallable> &cmd) {
   std::lock_guard<std::recursive_mutex> lock(mtx_);
   Log_debug("multi-paxos scheduler decide for slot: %lx", slot_id);
+  CommitInstance(slot_id, cmd);
+  ExecuteCommitted();
+}
+
+void PaxosServer::OnBulkAccept(const slotid_t start_slot,
+                               const ballot_t ballot,
+                               vector<shared_ptr<Marshallable>> &cmds,
+                               ballot_t *max_ballot,
+                               uint64_t* coro_id,
+                               const function<void()> &cb) {
+  std::lock_guard<std::recursive_mutex> lock(mtx_);
+  Log_debug("multi-paxos scheduler bulk accept for slots: %llx-%llx",
+            start_slot, start_slot + cmds.size() - 1);
+  ballot_t max_seen = ballot;
+  for (size_t i = 0; i < cmds.size(); i++) {
+    auto instance = GetInstance(start_slot + i);
+    if (instance->max_ballot_seen_ <= ballot) {
+      instance->max_ballot_seen_ = ballot;
+      instance->max_ballot_accepted_ = ballot;
+      instance->accepted_cmd_ = cmds[i];
+      lease_.Grant();
+      if (SegLog() != nullptr) {
+        PersistInstance(start_slot + i, *instance);
+      }
+      n_accept_++;
+    } else if (instance->max_ballot_seen_ > max_seen) {
+      max_seen = instance->max_ballot_seen_;
+    }
+  }
+  if (SegLog() != nullptr) {
+    // one sync for the whole range.
+    SyncSegLog();
+  }
+  *coro_id = Coroutine::CurrentCoroutine()->id;
+  *max_ballot = max_seen;
+  cb();
+}
+
+void PaxosServer::OnBulkCommit(const slotid_t start_slot,
+                               const ballot_t ballot,
+                               vector<shared_ptr<Marshallable>> &cmds) {
+  std::lock_guard<std::recursive_mutex> lock(mtx_);
+  Log_debug("multi-paxos scheduler bulk decide for slots: %lx-%lx",
+            start_slot, start_slot + cmds.size() - 1);
+  for (size_t i = 0; i < cmds.size(); i++) {
+    CommitInstance(start_slot + i, cmds[i]);
+  }
+  ExecuteCommitted();
+}
+
+void PaxosServer::CommitInstance(slotid_t slot_id,
+                                 shared_ptr<Marshallable> &cmd) {
   auto instance = GetInstance(slot_id);
   instance->committed_cmd_ = cmd;
   if (slot_id > max_committed_slot_) {
     max_committed_slot_ = slot_id;
   }
   verify(slot_id > max_executed_slot_);
+}
+
+void PaxosServer::ExecuteCommitted() {
   // This prevents the log entry from being applied twice
   if (in_applying_logs_) {
     return;
   }
   in_applying_logs_ = true;
-  for (slotid_t id = max_executed_slot_ + 1; id <= max_committed_slot_; id++) {
-    auto next_instance = GetInstance(id);
-    if (next_instance->committed_cmd_) {
-      app_next_(*next_instance->committed_cmd_);
-      Log_debug("multi-paxos par:%d loc:%d executed slot %lx now", partition_id_, loc_id_, id);
-      max_executed_slot_++;
-      n_commit_++;
-    } else {
+  for (;;) {
+    // the run of committed slots right after the executed ones, slots that
+    // commit while it is prepared are picked up by the next round.
+    vector<shared_ptr<Marshallable>> batch;
+    for (slotid_t id = max_executed_slot_ + 1; id <= max_committed_slot_; id++) {
+      auto next_instance = GetInstance(id);
+      if (!next_instance->committed_cmd_) {
+        break;
+      }
+      batch.push_back(next_instance->committed_cmd_);
+    }
+    if (batch.empty()) {
       break;
     }
+    PrepareCommitted(batch);
+    ApplyCommitted(batch);
+    max_executed_slot_ += batch.size();
+    n_commit_ += batch.size();
+    executed_cv_.notify_all();
+    Log_debug("multi-paxos par:%d loc:%d executed slots up to %lx now",
+              partition_id_, loc_id_, max_executed_slot_);
   }
 
   // TODO should support snapshot for freeing memory.
-  // for now just free anything 1000 slots before.
-  int i = min_active_slot_;
-  while (i + 1000 < max_executed_slot_) {
-    logs_.erase(i);
-    i++;
+  // for now just free anything 1000 slots before. Only the memory: without
+  // a snapshot the persistent log is all a restarted replica has, so it is
+  // never truncated here.
+  if (min_active_slot_ + 1000 < max_executed_slot_) {
+    min_active_slot_ = max_executed_slot_ - 1000;
+    logs_.TruncateBefore(min_active_slot_);
   }
-  min_active_slot_ = i;
   in_applying_logs_ = false;
 }
 
+bool PaxosServer::WaitForRead() {
+  if (!lease_.Valid()) {
+    return false;
+  }
+  std::unique_lock<std::recursive_mutex> lock(mtx_);
+  slotid_t read_index = max_committed_slot_;
+  executed_cv_.wait(lock, [this, read_index] () {
+    return max_executed_slot_ >= read_index;
+  });
+  return lease_.Valid();
+}
+
+void PaxosServer::PersistInstance(slotid_t slot_id, PaxosData& instance) {
+  Marshal m;
+  bool_t has_cmd = instance.accepted_cmd_ != nullptr;
+  m << instance.max_ballot_seen_ << instance.max_ballot_accepted_ << has_cmd;
+  if (has_cmd) {
+    MarshallDeputy md(instance.accepted_cmd_);
+    m << md;
+  }
+  AppendSegLog(slot_id, m);
+}
+
+void PaxosServer::LoadInstance(slotid_t slot_id, PaxosData& instance) {
+  const char* data;
+  size_t len;
+  if (!SegLog()->Read(slot_id, &data, &len)) {
+    return;
+  }
+  Marshal m;
+  m.write(data, len);
+  bool_t has_cmd = 0;
+  m >> instance.max_ballot_seen_ >> instance.max_ballot_accepted_ >> has_cmd;
+  if (has_cmd) {
+    MarshallDeputy md;
+    m >> md;
+    instance.accepted_cmd_ = md.sp_data_;
+  }
+}
+
 } // namespace janus
@@ -26,12 +26,18 @@ class PaxosServer : public TxLogServer {
   slotid_t min_active_slot_ = 0; // anything before (lt) this slot is freed
   slotid_t max_executed_slot_ = 0;
   slotid_t max_committed_slot_ = 0;
-  map<slotid_t, shared_ptr<PaxosData>> logs_{};
+  SlotWindow<shared_ptr<PaxosData>> logs_{};
   int n_prepare_ = 0;
   int n_accept_ = 0;
   int n_commit_ = 0;
   bool in_applying_logs_{false};
 
+  bool WaitForRead() override;
+
+  // opens and recovers the persistent log, if any, before any instance is
+  // touched.
+  explicit PaxosServer(Frame* frame);
+
   ~PaxosServer() {
     Log_info("site par %d, loc %d: prepare %d, accept %d, commit %d", partition_id_, loc_id_, n_prepare_, n_accept_, n_commit_);
   }
@@ -39,11 +45,22 @@ class PaxosServer : public TxLogServer {
   shared_ptr<PaxosData> GetInstance(slotid_t id) {
     verify(id >= min_active_slot_);
     auto& sp_instance = logs_[id];
-    if(!sp_instance)
+    if(!sp_instance) {
       sp_instance = std::make_shared<PaxosData>();
+      if (id < seg_log_recovered_end_) {
+        LoadInstance(id, *sp_instance);
+      }
+    }
     return sp_instance;
   }
 
+  // the promised ballot, the accepted ballot and the accepted command of a
+  // slot go to the persistent log before a prepare or an accept is
+  // acknowledged; the caller syncs.
+  void PersistInstance(slotid_t slot_id, PaxosData& instance);
+  // fills in what the persistent log has for a slot after a restart.
+  void LoadInstance(slotid_t slot_id, PaxosData& instance);
+
   void OnForward(shared_ptr<Marshallable> &cmd,
                  uint64_t dep_id,
                  uint64_t* coro_id,
@@ -67,6 +84,24 @@ class PaxosServer : public TxLogServer {
                 const ballot_t ballot,
                 shared_ptr<Marshallable> &cmd);
 
+  // accepts cmds[i] for slot start_slot + i; *max_ballot is the highest
+  // ballot seen on any of them, so the leader sees a rejection of any slot.
+  void OnBulkAccept(const slotid_t start_slot,
+                    const ballot_t ballot,
+                    vector<shared_ptr<Marshallable>> &cmds,
+                    ballot_t *max_ballot,
+                    uint64_t* coro_id,
+                    const function<void()> &cb);
+
+  void OnBulkCommit(const slotid_t start_slot,
+                    const ballot_t ballot,
+                    vector<shared_ptr<Marshallable>> &cmds);
+
+  // marks one slot committed, the caller holds mtx_.
+  void CommitInstance(slotid_t slot_id, shared_ptr<Marshallable> &cmd);
+  // applies committed slots in order and frees old ones.
+  void ExecuteCommitted();
+
   virtual bool HandleConflicts(Tx& dtxn,
                                innid_t inn_id,
                                vector<string>& conflicts) {
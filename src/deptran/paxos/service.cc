@@ -1,6 +1,7 @@
 
 #include "service.h"
 #include "server.h"
+#include "commo.h"
 
 namespace janus {
 
@@ -86,5 +87,35 @@ void MultiPaxosServiceImpl::Decide(const uint64_t& slot,
   defer->reply();
 }
 
+void MultiPaxosServiceImpl::BulkAccept(const uint64_t& start_slot,
+                                       const ballot_t& ballot,
+                                       const MarshallDeputy& md_cmds,
+                                       ballot_t* max_ballot,
+                                       uint64_t* coro_id,
+                                       rrr::DeferredReply* defer) {
+  verify(sched_ != nullptr);
+  verify(md_cmds.kind_ == MarshallDeputy::CMD_BLK_PXS);
+  auto sp_bulk = dynamic_pointer_cast<BulkPaxosCmd>(md_cmds.sp_data_);
+  Coroutine::CreateRun([&] () {
+    sched_->OnBulkAccept(start_slot,
+                         ballot,
+                         sp_bulk->cmds_,
+                         max_ballot,
+                         coro_id,
+                         std::bind(&rrr::DeferredReply::reply, defer));
+  });
+}
+
+void MultiPaxosServiceImpl::BulkDecide(const uint64_t& start_slot,
+                                       const ballot_t& ballot,
+                                       const MarshallDeputy& md_cmds,
+                                       rrr::DeferredReply* defer) {
+  verify(sched_ != nullptr);
+  verify(md_cmds.kind_ == MarshallDeputy::CMD_BLK_PXS);
+  auto sp_bulk = dynamic_pointer_cast<BulkPaxosCmd>(md_cmds.sp_data_);
+  sched_->OnBulkCommit(start_slot, ballot, sp_bulk->cmds_);
+  defer->reply();
+}
+
 
 } // namespace janus;
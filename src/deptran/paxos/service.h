@@ -43,6 +43,18 @@ class MultiPaxosServiceImpl : public MultiPaxosService {
               const MarshallDeputy& cmd,
               rrr::DeferredReply* defer) override;
 
+  void BulkAccept(const uint64_t& start_slot,
+                  const ballot_t& ballot,
+                  const MarshallDeputy& cmds,
+                  ballot_t* max_ballot,
+                  uint64_t* coro_id,
+                  rrr::DeferredReply* defer) override;
+
+  void BulkDecide(const uint64_t& start_slot,
+                  const ballot_t& ballot,
+                  const MarshallDeputy& cmds,
+                  rrr::DeferredReply* defer) override;
+
 };
 
 } // namespace janus
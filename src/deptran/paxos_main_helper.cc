@@ -189,10 +189,7 @@ void submit(const char* log, int len, uint32_t par_id) {
     // worker->Submit(log, len);
     if (!worker->IsLeader(par_id)) continue;
     verify(worker->submit_pool != nullptr);
-    if (worker->submit_pool->add(
-            [=, &worker]() {
-              worker->Submit(log, len, par_id);
-            }) != 0) {
+    if (worker->submit_pool->add(log, len) != 0) {
       Log_fatal("paxos submit_pool error!");
     }
   }
@@ -207,6 +204,14 @@ void wait_for_submit(uint32_t par_id) {
   }
 }
 
+bool wait_for_read(uint32_t par_id) {
+  for (auto& worker : pxs_workers_g) {
+    if (!worker->IsLeader(par_id)) continue;
+    return worker->WaitForRead();
+  }
+  return false;
+}
+
 void microbench_paxos_queue() {
   // register callback
   for (auto& worker : pxs_workers_g) {
@@ -1,5 +1,6 @@
 #include "paxos_worker.h"
 #include "service.h"
+#include "paxos/commo.h"
 
 namespace janus {
 
@@ -57,7 +58,7 @@ void PaxosWorker::Next(Marshallable& cmd) {
 
 void PaxosWorker::SetupService() {
   std::string bind_addr = site_info_->GetBindAddress();
-  int n_io_threads = 1;
+  int n_io_threads = Config::GetConfig()->rpc_io_threads_;
   svr_poll_mgr_ = new rrr::PollMgr(n_io_threads);
   if (rep_frame_ != nullptr) {
     services_ = rep_frame_->CreateRpcServices(site_info_->id,
@@ -70,6 +71,8 @@ void PaxosWorker::SetupService() {
 
   // init rrr::Server
   rpc_server_ = new rrr::Server(svr_poll_mgr_, thread_pool_g);
+  rpc_server_->set_listeners(n_io_threads);
+  rpc_server_->enable_work_stealing(Config::GetConfig()->rpc_work_stealing_);
 
   // reg services
   for (auto service : services_) {
@@ -97,7 +100,17 @@ void PaxosWorker::SetupCommo() {
     rep_sched_->commo_ = rep_commo_;
   }
   if (IsLeader(site_info_->partition_id_))
-    submit_pool = new SubmitPool();
+    submit_pool = new SubmitPool(
+        std::bind(&PaxosWorker::SubmitBatch, this, std::placeholders::_1));
+  auto config = Config::GetConfig();
+  if (IsLeader(site_info_->partition_id_)
+      && config->replica_proto_ == MODE_MULTI_PAXOS
+      && config->repl_batch_size_ > 1) {
+    sp_batch_job_ = std::make_shared<rrr::BatchFlushJob>(
+        std::bind(&PaxosWorker::BatchDue, this),
+        std::bind(&PaxosWorker::FlushBatch, this));
+    svr_poll_mgr_->add(sp_batch_job_);
+  }
 }
 
 void PaxosWorker::SetupHeartbeat() {
@@ -128,6 +141,10 @@ void PaxosWorker::WaitForShutdown() {
     delete submit_pool;
     submit_pool = nullptr;
   }
+  if (sp_batch_job_ != nullptr) {
+    sp_batch_job_->done_ = true;
+    svr_poll_mgr_->remove(sp_batch_job_);
+  }
   if (hb_rpc_server_ != nullptr) {
 //    scsi_->server_heart_beat();
     scsi_->wait_for_shutdown();
@@ -178,6 +195,11 @@ void PaxosWorker::WaitForSubmit() {
   Log_debug("finish task.");
 }
 
+bool PaxosWorker::WaitForRead() {
+  verify(rep_sched_ != nullptr);
+  return rep_sched_->WaitForRead();
+}
+
 void PaxosWorker::Submit(const char* log_entry, int length, uint32_t par_id) {
   if (!IsLeader(par_id)) return;
   auto sp_cmd = make_shared<LogEntry>();
@@ -193,10 +215,42 @@ inline void PaxosWorker::_Submit(shared_ptr<Marshallable> sp_m) {
   // finish_mutex.lock();
   n_current++;
   // finish_mutex.unlock();
+  if (sp_batch_job_ != nullptr) {
+    batch_l_.lock();
+    if (batch_.empty()) {
+      tm_batch_first_ = Time::now();
+    }
+    batch_.push_back(sp_m);
+    batch_l_.unlock();
+    return;
+  }
+  Log_info("When is this happening");
+  Coordinator* coord = CreateRepCoordinator();
+  coord->Submit(sp_m);
+}
+
+// entries drained together by the submit pool go into the pending batch
+// under one lock, so they end up in the same proposal when batching is on.
+void PaxosWorker::SubmitBatch(vector<shared_ptr<Marshallable>>& cmds) {
+  if (sp_batch_job_ == nullptr) {
+    for (auto& sp_m : cmds) {
+      _Submit(sp_m);
+    }
+    return;
+  }
+  n_current += cmds.size();
+  batch_l_.lock();
+  if (batch_.empty()) {
+    tm_batch_first_ = Time::now();
+  }
+  batch_.insert(batch_.end(), cmds.begin(), cmds.end());
+  batch_l_.unlock();
+}
+
+Coordinator* PaxosWorker::CreateRepCoordinator() {
   static cooid_t cid = 1;
   static id_t id = 1;
   verify(rep_frame_ != nullptr);
-  Log_info("When is this happening");
   Coordinator* coord = rep_frame_->CreateCoordinator(cid++,
                                                      Config::GetConfig(),
                                                      0,
@@ -206,7 +260,29 @@ inline void PaxosWorker::_Submit(shared_ptr<Marshallable> sp_m) {
   coord->par_id_ = site_info_->partition_id_;
   coord->loc_id_ = site_info_->locale_id;
   created_coordinators_.push_back(coord);
-  coord->Submit(sp_m);
+  return coord;
+}
+
+bool PaxosWorker::BatchDue() {
+  auto config = Config::GetConfig();
+  batch_l_.lock();
+  bool due = !batch_.empty()
+      && (batch_.size() >= config->repl_batch_size_
+          || Time::now() - tm_batch_first_ >= config->repl_batch_timeout_us_);
+  batch_l_.unlock();
+  return due;
+}
+
+void PaxosWorker::FlushBatch() {
+  auto sp_bulk = std::make_shared<BulkPaxosCmd>();
+  batch_l_.lock();
+  sp_bulk->cmds_.swap(batch_);
+  batch_l_.unlock();
+  if (sp_bulk->cmds_.empty()) {
+    return;
+  }
+  auto sp_m = dynamic_pointer_cast<Marshallable>(sp_bulk);
+  CreateRepCoordinator()->Submit(sp_m);
 }
 
 bool PaxosWorker::IsLeader(uint32_t par_id) {
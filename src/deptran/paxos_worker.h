@@ -10,19 +10,49 @@
 
 namespace janus {
 
+class LogEntry : public Marshallable {
+public:
+  char* operation_ = nullptr;
+  int length = 0;
+  std::string log_entry;
+
+  LogEntry() : Marshallable(MarshallDeputy::CONTAINER_CMD) {}
+  virtual ~LogEntry() {
+    if (operation_ != nullptr) delete operation_;
+    operation_ = nullptr;
+  }
+  virtual Marshal& ToMarshal(Marshal&) const override;
+  virtual Marshal& FromMarshal(Marshal&) override;
+};
+
+/**
+ * Hands log entries from the extern C submit() callers to the paxos worker.
+ * Callers copy an entry into a preallocated ring slot without taking a lock;
+ * one thread drains whatever has piled up and passes it on as one batch, so
+ * the worker can propose it together.
+ */
 class SubmitPool {
+public:
+  static const size_t CAPACITY = 1 << 16;
+  // most entries handed to the worker at once.
+  static const size_t MAX_DRAIN = 4096;
+
 private:
   struct start_submit_pool_args {
     SubmitPool* subpool;
   };
 
-  int n_;
-  std::list<std::function<void()>*>* q_;
-  pthread_cond_t not_empty_;
-  pthread_mutex_t m_;
-  pthread_mutex_t run_;
+  rrr::MpscRing<std::string> ring_{CAPACITY};
+  std::function<void(vector<shared_ptr<Marshallable>>&)> consume_;
+  std::atomic<uint64_t> n_added_{0};
+  std::atomic<uint64_t> n_done_{0};
+  std::atomic<int> n_waiting_{0};
+  std::atomic<bool> sleeping_{false};
+  std::atomic<bool> should_stop_{false};
+  rrr::Mutex m_{};
+  rrr::CondVar not_empty_{};
+  rrr::CondVar drained_{};
   pthread_t th_;
-  bool should_stop_{false};
 
   static void* start_thread_pool(void* args) {
     start_submit_pool_args* t_args = (start_submit_pool_args *) args;
@@ -32,113 +62,106 @@ private:
     return nullptr;
   }
   void run_thread() {
+    vector<shared_ptr<Marshallable>> batch;
     for (;;) {
-      function<void()>* job = nullptr;
-      Pthread_mutex_lock(&m_);
-      while (q_->empty()) {
-        Pthread_cond_wait(&not_empty_, &m_);
+      ring_.PopBatch(MAX_DRAIN, [&batch] (std::string& entry) {
+        auto sp_cmd = std::make_shared<LogEntry>();
+        // copy rather than move, the slot keeps its buffer for the next lap.
+        sp_cmd->log_entry = entry;
+        sp_cmd->length = entry.size();
+        batch.push_back(sp_cmd);
+      });
+      if (!batch.empty()) {
+        auto n = batch.size();
+        consume_(batch);
+        batch.clear();
+        n_done_ += n;
+        if (n_waiting_ > 0) {
+          m_.lock();
+          drained_.bcast();
+          m_.unlock();
+        }
+        continue;
       }
-      Pthread_mutex_lock(&run_);
-      job = q_->front();
-      q_->pop_front();
-      Pthread_mutex_unlock(&m_);
-      if (job == nullptr) {
-        Pthread_mutex_unlock(&run_);
+      if (should_stop_) {
         break;
       }
-      (*job)();
-      delete job;
-      Pthread_mutex_unlock(&run_);
+      m_.lock();
+      sleeping_ = true;
+      if (ring_.Empty() && !should_stop_) {
+        // bounded, so a wakeup lost to a racing producer costs at most this.
+        not_empty_.timed_wait(m_, 0.001);
+      }
+      sleeping_ = false;
+      m_.unlock();
     }
   }
-  bool try_pop(std::function<void()>** t) {
-    bool ret = false;
-    if (!q_->empty()) {
-        ret = true;
-        *t = q_->front();
-        q_->pop_front();
-    }
-    return ret;
+  void wake() {
+    m_.lock();
+    not_empty_.signal();
+    m_.unlock();
   }
 
 public:
-  SubmitPool()
-  : n_(1), th_(0), q_(new std::list<std::function<void()>*>), not_empty_(), m_(), run_() {
-    verify(n_ >= 0);
-    Pthread_mutex_init(&m_, nullptr);
-    Pthread_mutex_init(&run_, nullptr);
-    Pthread_cond_init(&not_empty_, nullptr);
-    for (int i = 0; i < n_; i++) {
-      start_submit_pool_args* args = new start_submit_pool_args();
-      args->subpool = this;
-      Pthread_create(&th_, nullptr, SubmitPool::start_thread_pool, args);
-    }
+  SubmitPool(const std::function<void(vector<shared_ptr<Marshallable>>&)>& consume)
+  : consume_(consume), th_(0) {
+    start_submit_pool_args* args = new start_submit_pool_args();
+    args->subpool = this;
+    Pthread_create(&th_, nullptr, SubmitPool::start_thread_pool, args);
   }
   SubmitPool(const SubmitPool&) = delete;
   SubmitPool& operator=(const SubmitPool&) = delete;
   ~SubmitPool() {
     should_stop_ = true;
-    for (int i = 0; i < n_; i++) {
-      Pthread_mutex_lock(&m_);
-      q_->push_back(nullptr); //death pill
-      Pthread_cond_signal(&not_empty_);
-      Pthread_mutex_unlock(&m_);
-    }
-    for (int i = 0; i < n_; i++) {
-      Pthread_join(th_, nullptr);
-    }
-    Log_debug("%s: enter in wait_for_all", __FUNCTION__);
-    wait_for_all();
-    Pthread_cond_destroy(&not_empty_);
-    Pthread_mutex_destroy(&m_);
-    Pthread_mutex_destroy(&run_);
-    delete q_;
+    wake();
+    // the consumer drains the ring before it exits.
+    Pthread_join(th_, nullptr);
   }
+  // blocks until every entry added so far is handed to the worker.
   void wait_for_all() {
-    for (int i = 0; i < n_; i++) {
-      function<void()>* job;
-      Pthread_mutex_lock(&m_);
-      Pthread_mutex_lock(&run_);
-      while (try_pop(&job)) {
-        if (job != nullptr) {
-          (*job)();
-          delete job;
-        }
-      }
-      Pthread_mutex_unlock(&m_);
-      Pthread_mutex_unlock(&run_);
+    uint64_t target = n_added_;
+    n_waiting_++;
+    m_.lock();
+    while (n_done_ < target) {
+      drained_.timed_wait(m_, 0.001);
     }
+    m_.unlock();
+    n_waiting_--;
   }
-  int add(const std::function<void()>& f) {
+  // copies the entry, the caller may reuse log as soon as this returns.
+  int add(const char* log, int len) {
     if (should_stop_) {
       return -1;
     }
-    Pthread_mutex_lock(&m_);
-    q_->push_back(new function<void()>(f));
-    Pthread_cond_signal(&not_empty_);
-    Pthread_mutex_unlock(&m_);
+    while (!ring_.TryPush([log, len] (std::string& entry) {
+                            entry.assign(log, len);
+                          })) {
+      // full, let the consumer catch up instead of growing without bound.
+      wake();
+      std::this_thread::yield();
+    }
+    n_added_++;
+    if (sleeping_) {
+      wake();
+    }
     return 0;
   }
 };
 
-class LogEntry : public Marshallable {
-public:
-  char* operation_ = nullptr;
-  int length = 0;
-  std::string log_entry;
-
-  LogEntry() : Marshallable(MarshallDeputy::CONTAINER_CMD) {}
-  virtual ~LogEntry() {
-    if (operation_ != nullptr) delete operation_;
-    operation_ = nullptr;
-  }
-  virtual Marshal& ToMarshal(Marshal&) const override;
-  virtual Marshal& FromMarshal(Marshal&) override;
-};
-
 class PaxosWorker {
 private:
   inline void _Submit(shared_ptr<Marshallable>);
+  void SubmitBatch(vector<shared_ptr<Marshallable>>&);
+  Coordinator* CreateRepCoordinator();
+
+  // commands waiting to be proposed together as one BulkPaxosCmd; flushed
+  // by sp_batch_job_ on the server's poll thread.
+  rrr::SpinLock batch_l_{};
+  vector<shared_ptr<Marshallable>> batch_{};
+  uint64_t tm_batch_first_{0};
+  shared_ptr<rrr::BatchFlushJob> sp_batch_job_{};
+  bool BatchDue();
+  void FlushBatch();
 
   rrr::Mutex finish_mutex{};
   rrr::CondVar finish_cond{};
@@ -177,6 +200,7 @@ public:
   void ShutDown();
   void Next(Marshallable&);
   void WaitForSubmit();
+  bool WaitForRead();
 
   static const uint32_t CtrlPortDelta = 10000;
   void WaitForShutdown();
@@ -9,4 +9,7 @@ void register_for_follower(std::function<void(const char*, int)>, uint32_t);
 void register_for_leader(std::function<void(const char*, int)>, uint32_t);
 void submit(const char*, int, uint32_t);
 void wait_for_submit(uint32_t);
+// true once the local replica of the partition may serve a linearizable
+// read from its applied state, false if the read must be submitted.
+bool wait_for_read(uint32_t);
 void microbench_paxos_queue();
\ No newline at end of file
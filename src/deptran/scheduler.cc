@@ -214,6 +214,140 @@ Coordinator *TxLogServer::CreateRepCoord(const i64& dep_id) {
   return coord;
 }
 
+std::string TxLogServer::SegLogDir() {
+  auto& dir = Config::GetConfig()->repl_log_dir_;
+  if (dir.empty()) {
+    return "";
+  }
+  std::string name = (frame_ != nullptr && frame_->site_info_ != nullptr)
+      ? frame_->site_info_->name : std::to_string(site_id_);
+  return dir + "/" + name;
+}
+
+rrr::SegmentLog* TxLogServer::SegLog() {
+  if (seg_log_opened_) {
+    return seg_log_.get();
+  }
+  seg_log_opened_ = true;
+  auto dir = SegLogDir();
+  if (dir.empty()) {
+    return nullptr;
+  }
+  seg_log_.reset(new rrr::SegmentLog(dir));
+  auto n = seg_log_->Open();
+  seg_log_recovered_end_ = n > 0 ? seg_log_->EndSlot() : 0;
+  Log_info("%d log records recovered from %s", (int) n, dir.c_str());
+  return seg_log_.get();
+}
+
+void TxLogServer::PrepareCommitted(vector<shared_ptr<Marshallable>>& cmds) {
+  if (!app_prepare_ || cmds.empty()) {
+    return;
+  }
+  auto prepare = app_prepare_;
+  auto batch = cmds;
+  auto de = Reactor::CreateSpEvent<DiskEvent>([prepare, batch] () {
+    for (auto& cmd : batch) {
+      prepare(*cmd);
+    }
+  });
+  de->AddToList();
+  de->Wait();
+}
+
+void TxLogServer::ApplyCommitted(vector<shared_ptr<Marshallable>>& cmds) {
+  if (app_next_batch_) {
+    app_next_batch_(cmds);
+    return;
+  }
+  for (auto& cmd : cmds) {
+    app_next_(*cmd);
+  }
+}
+
+void TxLogServer::NextBatch(vector<shared_ptr<Marshallable>>& cmds) {
+  std::lock_guard<std::recursive_mutex> lock(mtx_);
+  for (auto& cmd : cmds) {
+    Next(*cmd);
+  }
+}
+
+void TxLogServer::SnapshotTables(Marshal& m) {
+  auto& tables = mdb_txn_mgr_->tables();
+  m << (int32_t) tables.size();
+  for (auto& pair : tables) {
+    auto tbl = pair.second;
+    vector<const mdb::Row*> rows;
+    if (tbl->rtti() == mdb::TBL_SORTED) {
+      auto cursor = ((mdb::SortedTable*) tbl)->all();
+      while (cursor.has_next()) {
+        rows.push_back(cursor.next());
+      }
+    } else if (tbl->rtti() == mdb::TBL_UNSORTED) {
+      auto cursor = ((mdb::UnsortedTable*) tbl)->all();
+      while (cursor.has_next()) {
+        rows.push_back(cursor.next());
+      }
+    } else {
+      // only the current version of each row, older ones are not needed
+      // to rebuild the table.
+      verify(tbl->rtti() == mdb::TBL_SNAPSHOT);
+      auto cursor = ((mdb::SnapshotTable*) tbl)->all();
+      while (cursor.has_next()) {
+        rows.push_back(cursor.next());
+      }
+    }
+    int n_columns = tbl->schema()->columns_count();
+    m << pair.first << (int64_t) rows.size();
+    for (auto row : rows) {
+      for (int i = 0; i < n_columns; i++) {
+        m << row->get_column(i);
+      }
+    }
+  }
+}
+
+void TxLogServer::RestoreTables(Marshal& m) {
+  int32_t n_tables = 0;
+  m >> n_tables;
+  for (int32_t t = 0; t < n_tables; t++) {
+    std::string name;
+    int64_t n_rows = 0;
+    m >> name >> n_rows;
+    auto tbl = mdb_txn_mgr_->get_table(name);
+    verify(tbl != nullptr);
+    if (tbl->rtti() == mdb::TBL_SORTED) {
+      ((mdb::SortedTable*) tbl)->clear();
+    } else if (tbl->rtti() == mdb::TBL_UNSORTED) {
+      ((mdb::UnsortedTable*) tbl)->clear();
+    } else {
+      verify(tbl->rtti() == mdb::TBL_SNAPSHOT);
+      ((mdb::SnapshotTable*) tbl)->clear();
+    }
+    auto schema = tbl->schema();
+    vector<Value> values(schema->columns_count());
+    for (int64_t r = 0; r < n_rows; r++) {
+      for (auto& v : values) {
+        m >> v;
+      }
+      tbl->insert(frame_->CreateRow(schema, values));
+    }
+  }
+}
+
+void TxLogServer::AppendSegLog(slotid_t slot, Marshal& m) {
+  auto n = m.content_size();
+  std::string buf(n, '\0');
+  verify(m.read(&buf[0], n) == n);
+  SegLog()->Append(slot, buf.data(), n);
+}
+
+void TxLogServer::SyncSegLog() {
+  auto de = Reactor::CreateSpEvent<DiskEvent>(seg_log_->SyncJob());
+  de->AddToList();
+  de->Wait();
+}
+
 TxLogServer::TxLogServer(int mode) : TxLogServer() {
   mode_ = mode;
   switch (mode) {
@@ -6,6 +6,7 @@
 #include "kvdb.h"
 #include "procedure.h"
 #include "tx.h"
+#include "lease.h"
 
 namespace janus {
 
@@ -23,11 +24,28 @@ class TxLogServer {
   unordered_map<txid_t, Executor *> executors_{};
 
   function<void(Marshallable &)> app_next_{};
+  // optional, applies a run of committed commands, in log order, in one call
+  // instead of one app_next_ call each.
+  function<void(vector<shared_ptr<Marshallable>>&)> app_next_batch_{};
+  // optional, pure per command work such as decoding a payload, run off the
+  // reactor thread before the command is applied. must not touch any state
+  // of the scheduler or of the application.
+  function<void(Marshallable&)> app_prepare_{};
   function<shared_ptr<vector<MultiValue>>(Marshallable&)> key_deps_{};
+  // write / load the application state, for compacting the replicated log.
+  function<void(Marshal&)> app_snapshot_{};
+  function<void(Marshal&)> app_restore_{};
+  LeaderLease lease_{};
 
   shared_ptr<mdb::TxnMgr> mdb_txn_mgr_{};
   int mode_;
   Recorder *recorder_ = nullptr;
+  // persistent replicated log, opened on first use by SegLog().
+  std::unique_ptr<rrr::SegmentLog> seg_log_{};
+  bool seg_log_opened_{false};
+  // one past the highest slot found in seg_log_ when it was opened, slots
+  // below it may be read back from disk.
+  slotid_t seg_log_recovered_end_{0};
   Frame *frame_ = nullptr;
   Frame *rep_frame_ = nullptr;
   TxLogServer *rep_sched_ = nullptr;
@@ -36,6 +54,8 @@ class TxLogServer {
   shared_ptr<TxnRegistry> txn_reg_{nullptr};
   parid_t partition_id_{};
   std::recursive_mutex mtx_{};
+  // notified, under mtx_, whenever the apply loop moves the executed index.
+  std::condition_variable_any executed_cv_{};
 
   bool epoch_enabled_{false};
   EpochMgr epoch_mgr_{};
@@ -107,6 +127,14 @@ class TxLogServer {
                        innid_t inn_id);
 
   Coordinator *CreateRepCoord(const i64& dep_id);
+
+  // where this site keeps its persistent log, empty if none.
+  std::string SegLogDir();
+  // nullptr unless a log dir is configured.
+  rrr::SegmentLog* SegLog();
+  void AppendSegLog(slotid_t slot, Marshal& m);
+  // makes the appended records durable, waiting on the disk thread.
+  void SyncSegLog();
   virtual shared_ptr<Tx> GetTx(txnid_t tx_id);
   virtual shared_ptr<Tx> CreateTx(txnid_t tx_id,
                                   bool ro = false);
@@ -155,7 +183,44 @@ class TxLogServer {
     app_next_ = learner_action;
   }
 
+  void RegLearnerBatchAction(
+      function<void(vector<shared_ptr<Marshallable>>&)> learner_action) {
+    app_next_batch_ = learner_action;
+  }
+
+  void RegPrepareAction(function<void(Marshallable&)> prepare_action) {
+    app_prepare_ = prepare_action;
+  }
+
+  // runs app_prepare_ over a run of committed commands on the reactor's disk
+  // thread; the calling coroutine yields meanwhile, so the reactor keeps
+  // serving rpcs. returns right away without app_prepare_.
+  void PrepareCommitted(vector<shared_ptr<Marshallable>>& cmds);
+  // hands a run of committed commands to the application, in log order, on
+  // the reactor thread.
+  void ApplyCommitted(vector<shared_ptr<Marshallable>>& cmds);
+
+  void RegSnapshotAction(function<void(Marshal&)> snapshot,
+                         function<void(Marshal&)> restore) {
+    app_snapshot_ = snapshot;
+    app_restore_ = restore;
+  }
+
+  // a linearizable read of the local state: on a leader holding a valid
+  // lease, waits until everything committed when it was called is applied
+  // and returns true. false means the read has to go through the log.
+  // blocks on executed_cv_, so only application threads may call it, never
+  // a reactor thread: the apply loop it waits for runs there.
+  virtual bool WaitForRead() { return false; }
+
+  // every row of the memdb tables, the state a replica's log applies to.
+  void SnapshotTables(Marshal& m);
+  // replaces the rows of every table with the ones in m.
+  void RestoreTables(Marshal& m);
+
   virtual void Next(Marshallable& cmd) { verify(0); };
+  // Next() for each command under one hold of mtx_.
+  virtual void NextBatch(vector<shared_ptr<Marshallable>>& cmds);
 
 	virtual void Setup() { verify(0); } ;
   virtual bool IsLeader() { verify(0); } ;
@@ -68,6 +68,15 @@ void ServerWorker::SetupBase() {
     rep_sched_->RegLearnerAction(std::bind(&TxLogServer::Next,
                                            tx_sched_,
                                            std::placeholders::_1));
+    rep_sched_->RegLearnerBatchAction(std::bind(&TxLogServer::NextBatch,
+                                                tx_sched_,
+                                                std::placeholders::_1));
+    rep_sched_->RegSnapshotAction(std::bind(&TxLogServer::SnapshotTables,
+                                            tx_sched_,
+                                            std::placeholders::_1),
+                                  std::bind(&TxLogServer::RestoreTables,
+                                            tx_sched_,
+                                            std::placeholders::_1));
   }
 }
 
@@ -127,8 +136,8 @@ void ServerWorker::SetupService() {
   // set running mode and initialize transaction manager.
   std::string bind_addr = site_info_->GetBindAddress();
 
-  // init rrr::PollMgr 1 threads
-  int n_io_threads = 1;
+  // init rrr::PollMgr, connections are spread over its threads
+  int n_io_threads = Config::GetConfig()->rpc_io_threads_;
   svr_poll_mgr_ = new rrr::PollMgr(n_io_threads);
 //  svr_thread_pool_ = new rrr::ThreadPool(1);
 
@@ -158,6 +167,8 @@ void ServerWorker::SetupService() {
 
   // init rrr::Server
   rpc_server_ = new rrr::Server(svr_poll_mgr_, svr_thread_pool_);
+  rpc_server_->set_listeners(n_io_threads);
+  rpc_server_->enable_work_stealing(Config::GetConfig()->rpc_work_stealing_);
 
   // reg services
   for (auto service : services_) {
@@ -144,17 +144,15 @@ void ClassicServiceImpl::SimpleCmd(
 }
 
 void ClassicServiceImpl::IsLeader(
-    const locid_t& can_id, bool_t* is_leader, rrr::DeferredReply* defer) {
+    const locid_t& can_id, bool_t* is_leader) {
   auto sched = (SchedulerClassic*)dtxn_sched_;
   *is_leader = sched->IsLeader();
-  defer->reply();
 }
 
 void ClassicServiceImpl::IsFPGALeader(
-    const locid_t& can_id, bool_t* is_leader, rrr::DeferredReply* defer) {
+    const locid_t& can_id, bool_t* is_leader) {
   auto sched = (SchedulerClassic*)dtxn_sched_;
   *is_leader = sched->IsFPGALeader();
-  defer->reply();
 }
 void ClassicServiceImpl::Prepare(const rrr::i64& tid,
                                  const std::vector<i32>& sids,
@@ -285,8 +283,7 @@ void ClassicServiceImpl::EarlyAbort(const rrr::i64& tid,
 //  Coroutine::CreateRun(func);
 }
 
-void ClassicServiceImpl::rpc_null(rrr::DeferredReply* defer) {
-  defer->reply();
+void ClassicServiceImpl::rpc_null() {
 }
 
 void ClassicServiceImpl::UpgradeEpoch(const uint32_t& curr_epoch,
@@ -38,7 +38,7 @@ class ClassicServiceImpl : public ClassicService {
     return dtxn_sched_;
   }
 
-  void rpc_null(DeferredReply* defer) override ;
+  void rpc_null() override ;
 
 	void ReElect(bool_t* success,
 							 DeferredReply* defer) override;
@@ -57,12 +57,10 @@ class ClassicServiceImpl : public ClassicService {
                         rrr::DeferredReply* defer) override ;
 
   void IsLeader(const locid_t& can_id,
-                 bool_t* is_leader,
-                 DeferredReply* defer_reply) override ;
+                 bool_t* is_leader) override ;
 
   void IsFPGALeader(const locid_t& can_id,
-                 bool_t* is_leader,
-                 DeferredReply* defer_reply) override ;
+                 bool_t* is_leader) override ;
 
   void SimpleCmd (const SimpleCommand& cmd, 
                       i32* res, DeferredReply* defer_reply) override ;
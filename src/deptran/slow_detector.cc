@@ -0,0 +1,61 @@
+#include "slow_detector.h"
+
+namespace janus {
+
+void EwmaSlowDetector::OnSend(siteid_t site) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  health_[site].n_outstanding++;
+}
+
+void EwmaSlowDetector::OnReply(siteid_t site, uint64_t latency_us) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& h = health_[site];
+  if (h.n_outstanding > 0) {
+    h.n_outstanding--;
+  }
+  h.lat_us = h.lat_us == 0 ? latency_us :
+      (1 - ALPHA) * h.lat_us + ALPHA * latency_us;
+}
+
+void EwmaSlowDetector::OnFail(siteid_t site) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& h = health_[site];
+  if (h.n_outstanding > 0) {
+    h.n_outstanding--;
+  }
+}
+
+void EwmaSlowDetector::OnCpu(siteid_t site, double util) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  health_[site].cpu_util = util;
+}
+
+void EwmaSlowDetector::OnDisk(siteid_t site, uint64_t latency_us) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto& h = health_[site];
+  h.disk_us = h.disk_us == 0 ? latency_us :
+      (1 - ALPHA) * h.disk_us + ALPHA * latency_us;
+}
+
+double EwmaSlowDetector::Score(siteid_t site) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = health_.find(site);
+  if (it == health_.end()) {
+    return 0;
+  }
+  auto& h = it->second;
+  // a replica that never answered still scores by its backlog.
+  double score = (std::max(h.lat_us, 1.0) + h.disk_us) *
+      (1 + h.n_outstanding / OUTSTANDING_SCALE);
+  if (h.cpu_util < CPU_SLOW) {
+    score /= std::max(h.cpu_util, 0.1);
+  }
+  return score;
+}
+
+EwmaSlowDetector::Health EwmaSlowDetector::Get(siteid_t site) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return health_[site];
+}
+
+} // namespace janus
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "__dep__.h"
+
+namespace janus {
+
+/**
+ * Turns what a site observes about its peers into one health score per
+ * replica, lower is healthier. The communicator feeds it from rpc callbacks
+ * and asks it whom to send to first and whom to read from.
+ *
+ * Implementations must be thread safe, feeds come from the poll threads.
+ */
+class SlowDetector {
+ public:
+  virtual ~SlowDetector() {}
+  // an rpc was sent to site.
+  virtual void OnSend(siteid_t site) = 0;
+  // site answered an rpc after latency_us.
+  virtual void OnReply(siteid_t site, uint64_t latency_us) = 0;
+  // an rpc to site failed or was never sent; every OnSend() is ended by
+  // exactly one OnReply() or OnFail().
+  virtual void OnFail(siteid_t site) = 0;
+  // cpu utilization reported by (or measured for) site, 1.0 means the
+  // process got all the cpu it asked for.
+  virtual void OnCpu(siteid_t site, double util) = 0;
+  // a disk write on site took latency_us, as reported by site.
+  virtual void OnDisk(siteid_t site, uint64_t latency_us) = 0;
+  virtual double Score(siteid_t site) = 0;
+};
+
+/**
+ * Default detector: exponentially weighted round trip and disk latencies,
+ * scaled up by the number of outstanding rpcs and by cpu starvation.
+ */
+class EwmaSlowDetector : public SlowDetector {
+ public:
+  struct Health {
+    double lat_us = 0;
+    double disk_us = 0;
+    int32_t n_outstanding = 0;
+    double cpu_util = 1.0;
+  };
+
+  // weight of a new sample.
+  const double ALPHA = 0.1;
+  // outstanding rpcs that double the score.
+  const double OUTSTANDING_SCALE = 16.0;
+  // utilization below which a replica counts as cpu starved.
+  const double CPU_SLOW = 0.85;
+
+  void OnSend(siteid_t site) override;
+  void OnReply(siteid_t site, uint64_t latency_us) override;
+  void OnFail(siteid_t site) override;
+  void OnCpu(siteid_t site, double util) override;
+  void OnDisk(siteid_t site, uint64_t latency_us) override;
+  double Score(siteid_t site) override;
+
+  Health Get(siteid_t site);
+
+ private:
+  std::mutex mtx_{};
+  std::unordered_map<siteid_t, Health> health_{};
+};
+
+} // namespace janus
@@ -287,6 +287,10 @@ class TxnMgr: public NoCopy {
     }
   }
 
+  const std::map<std::string, Table *>& tables() const {
+    return tables_;
+  }
+
   UnsortedTable *get_unsorted_table(const std::string &tbl_name) const;
   SortedTable *get_sorted_table(const std::string &tbl_name) const;
   SnapshotTable *get_snapshot_table(const std::string &tbl_name) const;
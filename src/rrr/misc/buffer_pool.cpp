@@ -0,0 +1,199 @@
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "base/all.hpp"
+#include "buffer_pool.hpp"
+
+namespace rrr {
+
+bool BufferPool::hugepages_ = false;
+
+namespace {
+
+// set by the first allocation; after that the backing is fixed.
+std::atomic<bool> buffers_used_{false};
+
+struct FreeBuffers {
+  std::vector<char*> lists_[BufferPool::N_CLASSES];
+};
+
+// never destroyed, a buffer may be released after its thread is gone.
+thread_local FreeBuffers* free_buffers_th_ = nullptr;
+
+// slab buffers given up by threads that free more than they allocate, or
+// that exit.
+struct SharedBuffers {
+  SpinLock l_;
+  std::vector<char*> lists_[BufferPool::N_CLASSES];
+};
+
+// empties the thread's lists when it exits.
+struct ThreadExit {
+  ~ThreadExit();
+};
+
+thread_local ThreadExit thread_exit_th_;
+
+} // namespace
+
+static SharedBuffers& GetSharedBuffers() {
+  // never destroyed either, threads may still free at exit. built in place
+  // since plain new does not honour the alignment of its SpinLock.
+  static std::aligned_storage<sizeof(SharedBuffers),
+                              alignof(SharedBuffers)>::type storage;
+  static SharedBuffers* shared = new (&storage) SharedBuffers();
+  return *shared;
+}
+
+// slab buffers moved at once between a thread's list and the shared one.
+static size_t BatchOf(size_t buf_size) {
+  return std::max<size_t>(1, BufferPool::MAX_FREE_BYTES / 2 / buf_size);
+}
+
+ThreadExit::~ThreadExit() {
+  auto free_buffers = free_buffers_th_;
+  if (free_buffers == nullptr) {
+    return;
+  }
+  auto& shared = GetSharedBuffers();
+  for (int cls = 0; cls < BufferPool::N_CLASSES; cls++) {
+    auto& list = free_buffers->lists_[cls];
+    if (BufferPool::HugePages()) {
+      shared.l_.lock();
+      auto& to = shared.lists_[cls];
+      to.insert(to.end(), list.begin(), list.end());
+      shared.l_.unlock();
+    } else {
+      for (auto p : list) {
+        delete[] p;
+      }
+    }
+    list.clear();
+  }
+}
+
+static FreeBuffers& GetFreeBuffers() {
+  if (free_buffers_th_ == nullptr) {
+    free_buffers_th_ = new FreeBuffers();
+    (void) &thread_exit_th_;
+  }
+  return *free_buffers_th_;
+}
+
+static int ClassOf(size_t size) {
+  int cls = 0;
+  size_t cap = BufferPool::MIN_CLASS_SIZE;
+  while (cap < size) {
+    cap <<= 1;
+    cls++;
+  }
+  return cls;
+}
+
+static size_t ClassSize(int cls) {
+  return BufferPool::MIN_CLASS_SIZE << cls;
+}
+
+// carves one slab into buffers of the class.
+static void RefillFromSlab(std::vector<char*>& list, int cls) {
+  size_t size = BufferPool::SLAB_SIZE;
+  void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p == MAP_FAILED) {
+    // no reserved huge pages, ask for transparent ones instead.
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    verify(p != MAP_FAILED);
+    ::madvise(p, size, MADV_HUGEPAGE);
+  }
+  size_t buf_size = ClassSize(cls);
+  for (size_t off = 0; off + buf_size <= size; off += buf_size) {
+    list.push_back(static_cast<char*>(p) + off);
+  }
+}
+
+void BufferPool::SetHugePages(bool enable) {
+  if (buffers_used_) {
+    Log_info("marshal buffers already in use, keeping the current backing");
+    return;
+  }
+  hugepages_ = enable;
+}
+
+bool BufferPool::HugePages() {
+  return hugepages_;
+}
+
+size_t BufferPool::Capacity(size_t size) {
+  if (size > MAX_CLASS_SIZE) {
+    return size;
+  }
+  return ClassSize(ClassOf(size));
+}
+
+char* BufferPool::Allocate(size_t size, size_t* capacity) {
+  if (size > MAX_CLASS_SIZE) {
+    *capacity = size;
+    return new char[size];
+  }
+  buffers_used_ = true;
+  int cls = ClassOf(size);
+  *capacity = ClassSize(cls);
+  auto& list = GetFreeBuffers().lists_[cls];
+  if (list.empty()) {
+    if (!hugepages_) {
+      return new char[*capacity];
+    }
+    auto& shared = GetSharedBuffers();
+    shared.l_.lock();
+    auto& from = shared.lists_[cls];
+    size_t n = std::min(from.size(), BatchOf(*capacity));
+    list.insert(list.end(), from.end() - n, from.end());
+    from.resize(from.size() - n);
+    shared.l_.unlock();
+    if (list.empty()) {
+      RefillFromSlab(list, cls);
+    }
+  }
+  char* p = list.back();
+  list.pop_back();
+  return p;
+}
+
+void BufferPool::Deallocate(char* ptr, size_t capacity) {
+  if (capacity > MAX_CLASS_SIZE) {
+    delete[] ptr;
+    return;
+  }
+  int cls = ClassOf(capacity);
+  auto& list = GetFreeBuffers().lists_[cls];
+  if (list.size() * capacity >= MAX_FREE_BYTES) {
+    if (!hugepages_) {
+      delete[] ptr;
+      return;
+    }
+    // slab buffers always stay in the pool, but a thread that only frees,
+    // e.g. the one sending what others marshal, must not hoard them.
+    size_t n = BatchOf(capacity);
+    auto& shared = GetSharedBuffers();
+    shared.l_.lock();
+    auto& to = shared.lists_[cls];
+    to.insert(to.end(), list.end() - n, list.end());
+    shared.l_.unlock();
+    list.resize(list.size() - n);
+  }
+  list.push_back(ptr);
+}
+
+size_t BufferPool::NumFree(size_t size) {
+  if (size > MAX_CLASS_SIZE) {
+    return 0;
+  }
+  return GetFreeBuffers().lists_[ClassOf(size)].size();
+}
+
+} // namespace rrr
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+namespace rrr {
+
+/**
+ * Per-thread, size-classed pool of byte buffers for Marshal.
+ *
+ * Requests are rounded up to a power of two between MIN_CLASS_SIZE and
+ * MAX_CLASS_SIZE and served from the calling thread's free list of that
+ * class; larger ones go straight to the heap. A buffer may be freed on any
+ * thread, it then joins that thread's list. With hugepages on, classes are
+ * refilled by carving 2MB slabs, preferably MAP_HUGETLB, and those buffers
+ * are never returned to the system: past MAX_FREE_BYTES a thread's list
+ * hands half of itself to a shared list, an exiting thread all of it, and
+ * threads refill from there before carving a new slab. Like StackPool, the
+ * setting is process wide and only takes effect before the first buffer is
+ * handed out.
+ */
+class BufferPool {
+ public:
+  static const size_t MIN_CLASS_SIZE = 64;
+  static const size_t MAX_CLASS_SIZE = 64 * 1024;
+  static const int N_CLASSES = 11;
+  // free bytes kept per class and thread, the rest goes back to the heap,
+  // or to the shared list for slab buffers.
+  static const size_t MAX_FREE_BYTES = 2 * 1024 * 1024;
+  static const size_t SLAB_SIZE = 2 * 1024 * 1024;
+
+  static void SetHugePages(bool enable);
+  static bool HugePages();
+
+  // the usable size of the buffer is returned in *capacity, it is at
+  // least size.
+  static char* Allocate(size_t size, size_t* capacity);
+  // capacity must be what Allocate() returned for ptr.
+  static void Deallocate(char* ptr, size_t capacity);
+
+  static size_t Capacity(size_t size);
+  // free buffers of the class holding size in the calling thread's pool.
+  static size_t NumFree(size_t size);
+
+ private:
+  static bool hugepages_;
+};
+
+} // namespace rrr
@@ -131,6 +131,8 @@ void stat_marshal_out(int fd, const void* buf, size_t nbytes, ssize_t ret) {
  * NOTE: this value directly affects how many read/write syscall will be issued.
  */
 const size_t Marshal::raw_bytes::min_size = 8192;
+const size_t Marshal::REF_MIN_SIZE = 1024;
+const size_t Marshal::FIRST_CHUNK_SIZE = 256;
 
 Marshal::~Marshal() {
     chunk* chnk = head_;
@@ -153,15 +155,22 @@ size_t Marshal::content_size_slow() const {
     return sz;
 }
 
+size_t Marshal::next_chunk_size() const {
+    if (tail_ == nullptr) {
+        return FIRST_CHUNK_SIZE;
+    }
+    return std::min(tail_->data->size * 2, raw_bytes::min_size);
+}
+
 size_t Marshal::write(const void* p, size_t n) {
     assert(tail_ == nullptr || tail_->next == nullptr);
     chrono::time_point<chrono::steady_clock> start;
     if (head_ == nullptr) {
         assert(tail_ == nullptr);
-        head_ = new chunk(p, n);
+        head_ = new chunk(p, n, next_chunk_size());
         tail_ = head_;
     } else if (tail_->fully_written()) {
-        tail_->next = new chunk(p, n);
+        tail_->next = new chunk(p, n, next_chunk_size());
         tail_ = tail_->next;
     } else {
         //if(timing) start = chrono::steady_clock::now();
@@ -178,7 +187,7 @@ size_t Marshal::write(const void* p, size_t n) {
 	    //Log_info("Less less less");
             const char* pc = (const char *) p;
 	    //if(timing) start = chrono::steady_clock::now();
-            tail_->next = new chunk(pc + n_write, n - n_write);
+            tail_->next = new chunk(pc + n_write, n - n_write, next_chunk_size());
             /*if(timing){
 	        auto end = chrono::steady_clock::now();
 		auto duration = chrono::duration_cast<chrono::microseconds>(end-start).count();
@@ -348,8 +357,38 @@ size_t Marshal::read_from_marshal(Marshal& m, size_t n) {
 size_t Marshal::write_to_fd(int fd) {
     size_t n_write = 0;
     while (!empty()) {
-        int cnt = head_->write_to_fd(fd);
-        if (head_->fully_read()) {
+        struct iovec iov[MAX_IOV];
+        int n_iov = 0;
+        size_t n_gather = 0;
+        for (chunk* chnk = head_; chnk != nullptr && n_iov < MAX_IOV; chnk = chnk->next) {
+            size_t sz = chnk->content_size();
+            if (sz == 0) {
+                continue;
+            }
+            iov[n_iov].iov_base = chnk->data->ptr + chnk->read_idx;
+            iov[n_iov].iov_len = sz;
+            n_iov++;
+            n_gather += sz;
+        }
+        if (n_iov == 0) {
+            break;
+        }
+        ssize_t cnt = ::writev(fd, iov, n_iov);
+
+#ifdef RPC_STATISTICS
+        stat_marshal_out(fd, iov[0].iov_base, n_gather, cnt);
+#endif // RPC_STATISTICS
+
+        if (cnt <= 0) {
+            // currently the fd cannot take more data, so stop
+            break;
+        }
+        size_t left = cnt;
+        while (head_ != nullptr) {
+            left -= head_->discard(left);
+            if (!head_->fully_read()) {
+                break;
+            }
             if (head_ == tail_) {
                 tail_ = nullptr;
             }
@@ -357,18 +396,46 @@ size_t Marshal::write_to_fd(int fd) {
             head_ = head_->next;
             delete chnk;
         }
-        if (cnt <= 0) {
-            // currently there's no data available, so stop
-            break;
-        }
+        verify(left == 0);
         assert(content_size_ >= (size_t) cnt);
         content_size_ -= cnt;
         n_write += cnt;
+        if ((size_t) cnt < n_gather) {
+            // short write, the socket buffer is full
+            break;
+        }
     }
     assert(content_size_ == content_size_slow());
     return n_write;
 }
 
+size_t Marshal::write_ref(const Marshal& m) {
+    assert(tail_ == nullptr || tail_->next == nullptr);
+    size_t n = 0;
+    for (chunk* src = m.head_; src != nullptr; src = src->next) {
+        size_t cnt = src->content_size();
+        if (cnt == 0) {
+            continue;
+        }
+        if (cnt < REF_MIN_SIZE) {
+            verify(this->write(src->data->ptr + src->read_idx, cnt) == cnt);
+        } else {
+            chunk* chnk = src->shared_copy();
+            if (head_ == nullptr) {
+                head_ = tail_ = chnk;
+            } else {
+                tail_->next = chnk;
+                tail_ = chnk;
+            }
+            write_cnt_ += cnt;
+            content_size_ += cnt;
+        }
+        n += cnt;
+    }
+    assert(content_size_ == content_size_slow());
+    return n;
+}
+
 Marshal::bookmark* Marshal::set_bookmark(size_t n) {
     verify(write_cnt_ == 0);
 
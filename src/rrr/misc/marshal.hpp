@@ -9,12 +9,17 @@
 #include <unordered_set>
 #include <limits>
 #include <chrono>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "base/all.hpp"
+#include "buffer_pool.hpp"
 
 namespace rrr {
 
@@ -25,23 +30,31 @@ void stat_marshal_out(int fd, const void* buf, size_t nbytes, ssize_t ret);
 
 // not thread safe, for better performance
 class Marshal: public NoCopy {
+  // the buffers and the raw_bytes and chunk objects themselves all come
+  // from the calling thread's BufferPool.
   struct raw_bytes: public RefCounted {
     char *ptr = nullptr;
     size_t size = 0;
     static const size_t min_size;
 
     raw_bytes(size_t sz = min_size) {
-      size = std::max(sz, min_size);
-      ptr = new char[size];
+      ptr = BufferPool::Allocate(sz, &size);
     }
-    raw_bytes(const void *p, size_t n) {
-      size = std::max(n, min_size);
-      ptr = new char[size];
+    raw_bytes(const void *p, size_t n, size_t sz = min_size) {
+      ptr = BufferPool::Allocate(std::max(n, sz), &size);
       memcpy(ptr, p, n);
     }
     raw_bytes(const raw_bytes &) = delete;
     raw_bytes &operator=(const raw_bytes &) = delete;
-    ~raw_bytes() { delete[] ptr; }
+    ~raw_bytes() { BufferPool::Deallocate(ptr, size); }
+
+    static void *operator new(size_t n) {
+      size_t capacity;
+      return BufferPool::Allocate(n, &capacity);
+    }
+    static void operator delete(void *p, size_t n) {
+      BufferPool::Deallocate((char *) p, BufferPool::Capacity(n));
+    }
   };
 
   struct chunk: public NoCopy {
@@ -49,7 +62,7 @@ class Marshal: public NoCopy {
    private:
     chunk(raw_bytes *dt, size_t rd_idx, size_t wr_idx)
         : data((raw_bytes *) dt->ref_copy()), read_idx(rd_idx),
-          write_idx(wr_idx), next(nullptr) {
+          write_idx(wr_idx), next(nullptr), sealed(true) {
       assert(write_idx <= data->size);
       assert(read_idx <= write_idx);
     }
@@ -59,16 +72,29 @@ class Marshal: public NoCopy {
     size_t read_idx;
     size_t write_idx;
     chunk *next;
-
-    chunk() : data(new raw_bytes), read_idx(0), write_idx(0), next(nullptr) {}
-    chunk(const void *p, size_t n)
-        : data(new raw_bytes(p, n)), read_idx(0),
-          write_idx(n), next(nullptr) {}
+    // data is shared with another chunk, never write past write_idx.
+    bool sealed;
+
+    chunk() : data(new raw_bytes), read_idx(0), write_idx(0), next(nullptr),
+              sealed(false) {}
+    // room for at least sz bytes, p[0..n) already written.
+    chunk(const void *p, size_t n, size_t sz)
+        : data(new raw_bytes(p, n, sz)), read_idx(0),
+          write_idx(n), next(nullptr), sealed(false) {}
     chunk(const chunk&) = delete;
     chunk& operator=(const chunk&) = delete;
     ~chunk() { data->release(); }
 
-    // NOTE: This function is only intended for Marshal::read_from_marshal.
+    static void *operator new(size_t n) {
+      size_t capacity;
+      return BufferPool::Allocate(n, &capacity);
+    }
+    static void operator delete(void *p, size_t n) {
+      BufferPool::Deallocate((char *) p, BufferPool::Capacity(n));
+    }
+
+    // NOTE: This function is only intended for Marshal::read_from_marshal
+    //       and Marshal::write_ref. The copy is sealed.
     chunk *shared_copy() const {
       //if(read_idx != 0 && write_idx != 0) Log_info("read_idx: %d and write_idx: %d", read_idx, write_idx);
       return new chunk(data, read_idx, write_idx);
@@ -146,31 +172,6 @@ class Marshal: public NoCopy {
       return n_discard;
     }
 
-    int write_to_fd(int fd) {
-      assert(write_idx <= data->size);
-			struct timespec begin2, begin2_cpu, end2, end2_cpu;
-			/*clock_gettime(CLOCK_MONOTONIC, &begin2);		
-			clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin2_cpu);*/
-      int cnt = ::write(fd, data->ptr + read_idx, write_idx - read_idx);
-
-#ifdef RPC_STATISTICS
-      stat_marshal_out(fd, data->ptr + write_idx, data->size - write_idx, cnt);
-#endif // RPC_STATISTICS
-
-      if (cnt > 0) {
-				/*clock_gettime(CLOCK_MONOTONIC, &end2);
-				clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end2_cpu);
-				long total_cpu2 = (end2_cpu.tv_sec - begin2_cpu.tv_sec)*1000000000 + (end2_cpu.tv_nsec - begin2_cpu.tv_nsec);
-				long total_time2 = (end2.tv_sec - begin2.tv_sec)*1000000000 + (end2.tv_nsec - begin2.tv_nsec);
-				double util2 = (double) total_cpu2/total_time2;
-				Log_info("elapsed CPU time (fd write of %d): %f", write_idx - read_idx, util2);*/
-        read_idx += cnt;
-      }
-
-      assert(write_idx <= data->size);
-      return cnt;
-    }
-
     int read_from_fd(int fd) {
       assert(write_idx <= data->size);
       assert(read_idx <= write_idx);
@@ -197,14 +198,14 @@ class Marshal: public NoCopy {
     bool fully_written() const {
       assert(write_idx <= data->size);
       assert(read_idx <= write_idx);
-      return write_idx == data->size;
+      return sealed || write_idx == data->size;
     }
 
     // check if it is not possible to read any data even if retry later
     bool fully_read() const {
       assert(write_idx <= data->size);
       assert(read_idx <= write_idx);
-      return read_idx == data->size;
+      return read_idx == write_idx && fully_written();
     }
   };
 
@@ -213,6 +214,10 @@ class Marshal: public NoCopy {
   i32 write_cnt_;
   size_t content_size_;
 
+  // room for the next chunk written to: small for the first one and
+  // doubling up to raw_bytes::min_size, so a tiny message stays tiny.
+  size_t next_chunk_size() const;
+
   // for debugging purpose
   size_t content_size_slow() const;
 
@@ -258,8 +263,21 @@ class Marshal: public NoCopy {
   // Use case 2: In Python extension, buffer message in Marshal object, and send to network.
   size_t read_from_marshal(Marshal &m, size_t n);
 
+  // gathers the pending chunks into writev() calls until the fd would block.
   size_t write_to_fd(int fd);
 
+  /**
+   * Appends the content of m without consuming it. Chunks holding at least
+   * REF_MIN_SIZE bytes are attached by reference (sealed, refcounted
+   * raw_bytes); smaller ones are copied. m must not be modified while the
+   * data is still pending here.
+   */
+  size_t write_ref(const Marshal &m);
+  static const size_t REF_MIN_SIZE;
+  static const size_t FIRST_CHUNK_SIZE;
+  // most chunks handed to a single writev().
+  static const int MAX_IOV = 64;
+
   bookmark *set_bookmark(size_t n);
   void write_bookmark(bookmark *bm, const void *p) {
     const char *pc = (const char *) p;
@@ -643,4 +661,164 @@ inline rrr::Marshal &operator>>(rrr::Marshal &m, std::unordered_map<K, V> &v) {
   return m;
 }
 
+/**
+ * Fixed-size values that are marshaled as their raw bytes. A run of them in
+ * write_args()/read_args() is packed on the stack and moved with a single
+ * write() or read() of a compile-time size, instead of one bounds-checked
+ * call per value; the bytes on the wire are the same either way. i64 is
+ * not one, its operator<< also picks up the id after a DepId (valid_id).
+ */
+template<class T> struct is_wire_pod: std::false_type {};
+template<> struct is_wire_pod<i8>: std::true_type {};
+template<> struct is_wire_pod<i16>: std::true_type {};
+template<> struct is_wire_pod<i32>: std::true_type {};
+template<> struct is_wire_pod<uint8_t>: std::true_type {};
+template<> struct is_wire_pod<uint16_t>: std::true_type {};
+template<> struct is_wire_pod<uint32_t>: std::true_type {};
+template<> struct is_wire_pod<uint64_t>: std::true_type {};
+template<> struct is_wire_pod<double>: std::true_type {};
+
+// number and total size of the leading wire pods in Ts.
+template<class... Ts>
+struct wire_pod_run {
+  static const size_t count = 0;
+  static const size_t size = 0;
+};
+
+template<class T, class... Ts>
+struct wire_pod_run<T, Ts...> {
+  static const bool pod = is_wire_pod<T>::value;
+  static const size_t count = pod ? 1 + wire_pod_run<Ts...>::count : 0;
+  static const size_t size = pod ? sizeof(T) + wire_pod_run<Ts...>::size : 0;
+};
+
+inline void write_args(Marshal &m) {}
+
+inline void read_args(Marshal &m) {}
+
+template<class T, class... Ts>
+typename std::enable_if<!is_wire_pod<T>::value>::type
+write_args(Marshal &m, const T &v, const Ts &... rest);
+
+template<class T, class... Ts>
+typename std::enable_if<is_wire_pod<T>::value>::type
+write_args(Marshal &m, const T &v, const Ts &... rest);
+
+template<class T, class... Ts>
+typename std::enable_if<!is_wire_pod<T>::value>::type
+read_args(Marshal &m, T &v, Ts &... rest);
+
+template<class T, class... Ts>
+typename std::enable_if<is_wire_pod<T>::value>::type
+read_args(Marshal &m, T &v, Ts &... rest);
+
+// moves the first K values between the stack buffer and their variables,
+// then goes on with the rest.
+template<size_t K>
+struct PodRun {
+  template<class T, class... Ts>
+  static void write(Marshal &m, char *buf, char *p, const T &v,
+                    const Ts &... rest) {
+    memcpy(p, &v, sizeof(T));
+    PodRun<K - 1>::write(m, buf, p + sizeof(T), rest...);
+  }
+
+  template<class T, class... Ts>
+  static void read(Marshal &m, const char *p, T &v, Ts &... rest) {
+    memcpy(&v, p, sizeof(T));
+    PodRun<K - 1>::read(m, p + sizeof(T), rest...);
+  }
+};
+
+template<>
+struct PodRun<0> {
+  template<class... Ts>
+  static void write(Marshal &m, char *buf, char *p, const Ts &... rest) {
+    size_t n = p - buf;
+    verify(m.write(buf, n) == n);
+    write_args(m, rest...);
+  }
+
+  template<class... Ts>
+  static void read(Marshal &m, const char *p, Ts &... rest) {
+    read_args(m, rest...);
+  }
+};
+
+template<class T, class... Ts>
+typename std::enable_if<!is_wire_pod<T>::value>::type
+write_args(Marshal &m, const T &v, const Ts &... rest) {
+  m << v;
+  write_args(m, rest...);
+}
+
+template<class T, class... Ts>
+typename std::enable_if<is_wire_pod<T>::value>::type
+write_args(Marshal &m, const T &v, const Ts &... rest) {
+  typedef wire_pod_run<T, Ts...> run;
+  char buf[run::size];
+  PodRun<run::count>::write(m, buf, buf, v, rest...);
+}
+
+template<class T, class... Ts>
+typename std::enable_if<!is_wire_pod<T>::value>::type
+read_args(Marshal &m, T &v, Ts &... rest) {
+  m >> v;
+  read_args(m, rest...);
+}
+
+template<class T, class... Ts>
+typename std::enable_if<is_wire_pod<T>::value>::type
+read_args(Marshal &m, T &v, Ts &... rest) {
+  typedef wire_pod_run<T, Ts...> run;
+  char buf[run::size];
+  verify(m.read(buf, run::size) == run::size);
+  PodRun<run::count>::read(m, buf, v, rest...);
+}
+
+// argument lists for operator<< and operator>>, as generated by rpcgen:
+//   m << pack_args(a, b, c);
+//   m >> tie_args(a, b, c);
+template<class... Ts>
+struct PackedArgs {
+  std::tuple<const Ts &...> args;
+};
+
+template<class... Ts>
+struct TiedArgs {
+  std::tuple<Ts &...> args;
+};
+
+template<class... Ts>
+inline PackedArgs<Ts...> pack_args(const Ts &... args) {
+  return PackedArgs<Ts...>{std::tuple<const Ts &...>(args...)};
+}
+
+template<class... Ts>
+inline TiedArgs<Ts...> tie_args(Ts &... args) {
+  return TiedArgs<Ts...>{std::tuple<Ts &...>(args...)};
+}
+
+template<class Tuple, size_t... I>
+inline void write_tuple(Marshal &m, const Tuple &t, std::index_sequence<I...>) {
+  write_args(m, std::get<I>(t)...);
+}
+
+template<class Tuple, size_t... I>
+inline void read_tuple(Marshal &m, const Tuple &t, std::index_sequence<I...>) {
+  read_args(m, std::get<I>(t)...);
+}
+
+template<class... Ts>
+inline rrr::Marshal &operator<<(rrr::Marshal &m, const PackedArgs<Ts...> &a) {
+  write_tuple(m, a.args, std::index_sequence_for<Ts...>());
+  return m;
+}
+
+template<class... Ts>
+inline rrr::Marshal &operator>>(rrr::Marshal &m, const TiedArgs<Ts...> &a) {
+  read_tuple(m, a.args, std::index_sequence_for<Ts...>());
+  return m;
+}
+
 } // namespace rrr
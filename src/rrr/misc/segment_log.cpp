@@ -0,0 +1,252 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+#include "segment_log.hpp"
+
+namespace rrr {
+
+struct SegmentLog::Segment {
+  std::string path;
+  int fd{-1};
+  char* base{nullptr};
+  size_t size{0};
+  // bytes holding records.
+  size_t used{0};
+  // bytes known to be on disk.
+  size_t synced{0};
+  int64_t max_slot{-1};
+
+  ~Segment() {
+    if (base != nullptr) {
+      munmap(base, size);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+};
+
+namespace {
+
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+struct Crc32cTable {
+  uint32_t t[256];
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+      }
+      t[i] = c;
+    }
+  }
+};
+
+std::string SegmentPath(const std::string& dir, int64_t seq) {
+  char name[32];
+  snprintf(name, sizeof(name), "%020lld.seg", (long long) seq);
+  return dir + "/" + name;
+}
+
+} // namespace
+
+uint32_t SegmentLog::Crc32c(uint32_t crc, const void* data, size_t len) {
+  static const Crc32cTable table;
+  auto p = (const uint8_t*) data;
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+SegmentLog::SegmentLog(const std::string& dir, size_t segment_size)
+    : dir_(dir), segment_size_(segment_size) {
+  // mkdir -p
+  for (size_t i = 1; i <= dir_.size(); i++) {
+    if (i == dir_.size() || dir_[i] == '/') {
+      mkdir(dir_.substr(0, i).c_str(), 0755);
+    }
+  }
+}
+
+SegmentLog::~SegmentLog() {
+}
+
+std::shared_ptr<SegmentLog::Segment> SegmentLog::NewSegment(int64_t seq,
+                                                            size_t size) {
+  auto sp_seg = std::make_shared<Segment>();
+  sp_seg->path = SegmentPath(dir_, seq);
+  sp_seg->fd = open(sp_seg->path.c_str(), O_RDWR | O_CREAT, 0644);
+  verify(sp_seg->fd >= 0);
+  struct stat st;
+  verify(fstat(sp_seg->fd, &st) == 0);
+  if ((size_t) st.st_size < size) {
+    // sparse, the unwritten tail reads back as zeros.
+    verify(ftruncate(sp_seg->fd, size) == 0);
+  } else {
+    size = st.st_size;
+  }
+  sp_seg->size = size;
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 sp_seg->fd, 0);
+  verify(p != MAP_FAILED);
+  sp_seg->base = (char*) p;
+  return sp_seg;
+}
+
+SegmentLog::Segment* SegmentLog::Get(int64_t seq) {
+  verify(seq >= first_seq_ && seq < first_seq_ + (int64_t) segments_.size());
+  return segments_[seq - first_seq_].get();
+}
+
+size_t SegmentLog::Open() {
+  verify(segments_.empty());
+  std::vector<int64_t> seqs;
+  DIR* d = opendir(dir_.c_str());
+  verify(d != nullptr);
+  while (struct dirent* ent = readdir(d)) {
+    long long seq;
+    char tail[8];
+    if (sscanf(ent->d_name, "%lld.%7s", &seq, tail) == 2 &&
+        strcmp(tail, "seg") == 0) {
+      seqs.push_back(seq);
+    }
+  }
+  closedir(d);
+  std::sort(seqs.begin(), seqs.end());
+
+  // headers only, payloads are not looked at beyond the crc.
+  std::vector<std::pair<int64_t, Loc>> records;
+  int64_t min_slot = INT64_MAX;
+  bool torn = false;
+  for (auto seq : seqs) {
+    if (torn) {
+      // written after the torn record, nothing in it can be trusted, and a
+      // new segment with its sequence number will be created later.
+      Log_info("segment log %s: behind a torn record, removed",
+               SegmentPath(dir_, seq).c_str());
+      verify(unlink(SegmentPath(dir_, seq).c_str()) == 0);
+      continue;
+    }
+    auto sp_seg = NewSegment(seq, 0);
+    if (segments_.empty()) {
+      first_seq_ = seq;
+    }
+    // a gap in the sequence means older files were removed half way.
+    verify(seq == first_seq_ + (int64_t) segments_.size());
+    size_t off = 0;
+    while (off + HEADER_SIZE <= sp_seg->size) {
+      uint32_t len, crc;
+      int64_t slot;
+      memcpy(&len, sp_seg->base + off, 4);
+      memcpy(&crc, sp_seg->base + off + 4, 4);
+      memcpy(&slot, sp_seg->base + off + 8, 8);
+      if (len == 0 && crc == 0) {
+        break;
+      }
+      if (off + HEADER_SIZE + len > sp_seg->size ||
+          Crc32c(0, sp_seg->base + off + 8, 8 + len) != crc) {
+        Log_info("segment log %s: torn record at offset %d, dropping the rest",
+                 sp_seg->path.c_str(), (int) off);
+        // so that stale bytes behind it never parse as records later.
+        memset(sp_seg->base + off, 0, sp_seg->size - off);
+        torn = true;
+        break;
+      }
+      Loc loc;
+      loc.seg = seq;
+      loc.off = off;
+      loc.len = len;
+      records.emplace_back(slot, loc);
+      min_slot = std::min(min_slot, slot);
+      sp_seg->max_slot = std::max(sp_seg->max_slot, slot);
+      off += HEADER_SIZE + len;
+    }
+    sp_seg->used = off;
+    sp_seg->synced = off;
+    segments_.push_back(sp_seg);
+  }
+  if (!records.empty()) {
+    index_.Clear();
+    index_.TruncateBefore(min_slot);
+  }
+  for (auto& r : records) {
+    // in file order, so a rewrite of a slot wins over the earlier record.
+    index_[r.first] = r.second;
+  }
+  return records.size();
+}
+
+void SegmentLog::Append(int64_t slot, const void* data, size_t len) {
+  size_t need = HEADER_SIZE + len;
+  if (segments_.empty() || segments_.back()->used + need > segments_.back()->size) {
+    int64_t seq = first_seq_ + (int64_t) segments_.size();
+    segments_.push_back(NewSegment(seq, std::max(segment_size_, need)));
+  }
+  auto& seg = *segments_.back();
+  int64_t seq = first_seq_ + (int64_t) segments_.size() - 1;
+  char* p = seg.base + seg.used;
+  uint32_t len32 = len;
+  memcpy(p, &len32, 4);
+  memcpy(p + 8, &slot, 8);
+  memcpy(p + HEADER_SIZE, data, len);
+  uint32_t crc = Crc32c(0, p + 8, 8 + len);
+  memcpy(p + 4, &crc, 4);
+  auto& loc = index_[slot];
+  loc.seg = seq;
+  loc.off = seg.used;
+  loc.len = len;
+  seg.used += need;
+  seg.max_slot = std::max(seg.max_slot, slot);
+}
+
+std::function<void()> SegmentLog::SyncJob() {
+  std::vector<std::shared_ptr<Segment>> dirty;
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (auto& sp_seg : segments_) {
+    if (sp_seg->synced < sp_seg->used) {
+      dirty.push_back(sp_seg);
+      ranges.emplace_back(sp_seg->synced, sp_seg->used);
+      sp_seg->synced = sp_seg->used;
+    }
+  }
+  // the segments stay mapped until the job is done even if truncated.
+  return [dirty, ranges] () {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < dirty.size(); i++) {
+      size_t from = ranges[i].first / page * page;
+      verify(msync(dirty[i]->base + from,
+                   ranges[i].second - from, MS_SYNC) == 0);
+    }
+  };
+}
+
+bool SegmentLog::Read(int64_t slot, const char** data, size_t* len) {
+  auto loc = index_.Find(slot);
+  if (loc == nullptr || loc->seg < first_seq_) {
+    return false;
+  }
+  auto seg = Get(loc->seg);
+  *data = seg->base + loc->off + HEADER_SIZE;
+  *len = loc->len;
+  return true;
+}
+
+void SegmentLog::TruncateBefore(int64_t slot) {
+  // keep the newest segment, appends go there.
+  while (segments_.size() > 1 && segments_.front()->max_slot < slot) {
+    unlink(segments_.front()->path.c_str());
+    segments_.pop_front();
+    first_seq_++;
+  }
+  index_.TruncateBefore(slot);
+}
+
+} // namespace rrr
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/all.hpp"
+
+namespace rrr {
+
+/**
+ * Dense slot-indexed window, a replacement for map<slot, T> when slots are
+ * (mostly) contiguous: lookup is O(1) and iteration walks a deque. Slots
+ * below Begin() have been truncated away; indexing past End() grows the
+ * window, filling any gap with default values.
+ */
+template <typename T>
+class SlotWindow {
+  std::deque<T> slots_{};
+  int64_t base_{0};
+
+ public:
+  int64_t Begin() const {
+    return base_;
+  }
+
+  int64_t End() const {
+    return base_ + (int64_t) slots_.size();
+  }
+
+  T& operator[](int64_t slot) {
+    verify(slot >= base_);
+    if (slot >= End()) {
+      slots_.resize(slot - base_ + 1);
+    }
+    return slots_[slot - base_];
+  }
+
+  // nullptr if slot is outside the window.
+  T* Find(int64_t slot) {
+    if (slot < base_ || slot >= End()) {
+      return nullptr;
+    }
+    return &slots_[slot - base_];
+  }
+
+  // drops every slot below slot.
+  void TruncateBefore(int64_t slot) {
+    while (base_ < slot && !slots_.empty()) {
+      slots_.pop_front();
+      base_++;
+    }
+    if (base_ < slot) {
+      base_ = slot;
+    }
+  }
+
+  void Clear() {
+    slots_.clear();
+  }
+};
+
+/**
+ * Append-only persistent log split into fixed-size mmap'ed segment files.
+ *
+ * Every record is framed as [len u32][crc32c u32][slot i64][payload], the
+ * crc covering slot and payload, so Open() can rebuild the slot index by
+ * walking headers only and stops at the first torn record, segments after
+ * it are removed. A later record for the same slot supersedes an earlier
+ * one. Reads hand out pointers into the mapping, valid until the slot's
+ * segment is truncated.
+ *
+ * Not thread safe, except that the closure returned by SyncJob() may run on
+ * another thread (e.g. the disk thread) while appends go on.
+ */
+class SegmentLog {
+ public:
+  static const size_t SEGMENT_SIZE = 64 * 1024 * 1024;
+  static const size_t HEADER_SIZE = 16;
+
+  struct Segment;
+
+  explicit SegmentLog(const std::string& dir,
+                      size_t segment_size = SEGMENT_SIZE);
+  SegmentLog(const SegmentLog&) = delete;
+  SegmentLog& operator=(const SegmentLog&) = delete;
+  ~SegmentLog();
+
+  // maps the existing segments in dir and rebuilds the slot index.
+  // returns the number of records recovered.
+  size_t Open();
+
+  void Append(int64_t slot, const void* data, size_t len);
+
+  // makes everything appended so far durable, to be run where blocking is
+  // fine; appends may continue meanwhile.
+  std::function<void()> SyncJob();
+  void Sync() {
+    SyncJob()();
+  }
+
+  // zero-copy view of the latest record for slot.
+  bool Read(int64_t slot, const char** data, size_t* len);
+
+  // unlinks whole segments whose slots are all below slot.
+  void TruncateBefore(int64_t slot);
+
+  int64_t FirstSlot() {
+    return index_.Begin();
+  }
+
+  // one past the highest slot recorded.
+  int64_t EndSlot() {
+    return index_.End();
+  }
+
+  size_t NumSegments() {
+    return segments_.size();
+  }
+
+  static uint32_t Crc32c(uint32_t crc, const void* data, size_t len);
+
+ private:
+  struct Loc {
+    int64_t seg{-1};
+    uint32_t off{0};
+    uint32_t len{0};
+  };
+
+  std::string dir_;
+  size_t segment_size_;
+  // segments_[i] has sequence number first_seq_ + i.
+  std::deque<std::shared_ptr<Segment>> segments_{};
+  int64_t first_seq_{0};
+  SlotWindow<Loc> index_{};
+
+  std::shared_ptr<Segment> NewSegment(int64_t seq, size_t size);
+  Segment* Get(int64_t seq);
+};
+
+} // namespace rrr
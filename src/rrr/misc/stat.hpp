@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+
 namespace rrr {
 
 class AvgStat {
@@ -43,4 +46,85 @@ public:
     }
 };
 
+/**
+ * Fixed size log-linear histogram (HDR style) for latency quantiles.
+ * sample() is O(1), quantile() scans the buckets, memory does not grow with
+ * the number of samples. Values below 2 * SUB are exact, larger ones are
+ * kept within 1 / SUB relative error. Values past 2^(MAX_MSB + 1) saturate.
+ */
+class LatencySketch {
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB = 1 << SUB_BITS;
+    static const int MAX_MSB = 40;
+    static const int N_BUCKETS = (MAX_MSB - SUB_BITS + 2) * SUB;
+
+private:
+    uint64_t buckets_[N_BUCKETS];
+    uint64_t count_;
+
+    static int bucket_of(int64_t v) {
+        if (v < 0) {
+            v = 0;
+        }
+        if (v < 2 * SUB) {
+            return (int) v;
+        }
+        int msb = 63 - __builtin_clzll((uint64_t) v);
+        if (msb > MAX_MSB) {
+            return N_BUCKETS - 1;
+        }
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB + (int) (v >> shift) - SUB;
+    }
+
+    // middle of the value range a bucket covers.
+    static int64_t value_of(int idx) {
+        if (idx < 2 * SUB) {
+            return idx;
+        }
+        int shift = idx / SUB - 1;
+        int64_t sub = idx % SUB + SUB;
+        return (sub << shift) + ((int64_t) 1 << shift) / 2;
+    }
+
+public:
+    LatencySketch() {
+        clear();
+    }
+
+    void sample(int64_t v) {
+        buckets_[bucket_of(v)]++;
+        count_++;
+    }
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    // q in [0, 1], returns 0 when there is no sample.
+    int64_t quantile(double q) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t) (q * count_);
+        if (rank >= count_) {
+            rank = count_ - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < N_BUCKETS; i++) {
+            seen += buckets_[i];
+            if (seen > rank) {
+                return value_of(i);
+            }
+        }
+        return value_of(N_BUCKETS - 1);
+    }
+
+    void clear() {
+        memset(buckets_, 0, sizeof(buckets_));
+        count_ = 0;
+    }
+};
+
 } // namespace rrr
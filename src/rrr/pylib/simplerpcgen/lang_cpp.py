@@ -7,17 +7,18 @@ def emit_struct(struct, f):
             f.writeln("%s %s;" % (field.type, field.name))
     f.writeln("};")
     f.writeln()
+    fields = ", ".join(["o.%s" % field.name for field in struct.fields])
     f.writeln("inline rrr::Marshal& operator <<(rrr::Marshal& m, const %s& o) {" % struct.name)
     with f.indent():
-        for field in struct.fields:
-            f.writeln("m << o.%s;" % field.name)
+        if len(struct.fields) > 0:
+            f.writeln("rrr::write_args(m, %s);" % fields)
         f.writeln("return m;")
     f.writeln("}")
     f.writeln()
     f.writeln("inline rrr::Marshal& operator >>(rrr::Marshal& m, %s& o) {" % struct.name)
     with f.indent():
-        for field in struct.fields:
-            f.writeln("m >> o.%s;" % field.name)
+        if len(struct.fields) > 0:
+            f.writeln("rrr::read_args(m, %s);" % fields)
         f.writeln("return m;")
     f.writeln("}")
     f.writeln()
@@ -38,6 +39,8 @@ def emit_service_and_proxy(service, f, rpc_table):
             for func in service.functions:
                 if func.attr == "raw":
                     f.writeln("if ((ret = svr->reg(%s, this, &%sService::%s)) != 0) {" % (func.name.upper(), service.name, func.name))
+                elif func.attr == "fast":
+                    f.writeln("if ((ret = svr->reg(%s, this, &%sService::__%s__wrapper__, true)) != 0) {" % (func.name.upper(), service.name, func.name))
                 else:
                     f.writeln("if ((ret = svr->reg(%s, this, &%sService::__%s__wrapper__)) != 0) {" % (func.name.upper(), service.name, func.name))
                 with f.indent():
@@ -52,6 +55,7 @@ def emit_service_and_proxy(service, f, rpc_table):
         f.writeln("}")
         f.writeln("// these RPC handler functions need to be implemented by user")
         f.writeln("// for 'raw' handlers, remember to reply req, delete req, and sconn->release(); use sconn->run_async for heavy job")
+        f.writeln("// 'fast' handlers run on the poll thread outside any coroutine, they must not block, yield or create events")
         for func in service.functions:
             if service.abstract or func.abstract:
                 postfix = " = 0"
@@ -76,43 +80,37 @@ def emit_service_and_proxy(service, f, rpc_table):
                 f.writeln("virtual void %s(%s)%s;" % (func.name, ", ".join(func_args), postfix))
     f.writeln("private:")
     with f.indent():
+        for func in service.functions:
+            if func.attr != "defer":
+                continue
+            # all arguments of a deferred call live in one pooled object
+            f.writeln("struct __%s__defer__: public rrr::DeferredReply {" % func.name)
+            with f.indent():
+                for i, in_arg in enumerate(func.input):
+                    f.writeln("%s in_%d;" % (in_arg.type, i))
+                for i, out_arg in enumerate(func.output):
+                    f.writeln("%s out_%d;" % (out_arg.type, i))
+                f.writeln("__%s__defer__(rrr::Request* req, rrr::ServerConnection* sconn): rrr::DeferredReply(req, sconn) { }" % func.name)
+                f.writeln("void marshal_reply(rrr::ServerConnection* sconn) override {")
+                with f.indent():
+                    if len(func.output) > 0:
+                        f.writeln("*sconn << rrr::pack_args(%s);" % ", ".join(["out_%d" % i for i in range(len(func.output))]))
+                f.writeln("}")
+            f.writeln("};")
         for func in service.functions:
             if func.attr == "raw":
                 continue
             f.writeln("void __%s__wrapper__(rrr::Request* req, rrr::ServerConnection* sconn) {" % func.name)
             with f.indent():
                 if func.attr == "defer":
+                    f.writeln("auto __defer__ = new __%s__defer__(req, sconn);" % func.name)
                     invoke_with = []
-                    in_counter = 0
-                    out_counter = 0
-                    for in_arg in func.input:
-                        f.writeln("%s* in_%d = new %s;" % (in_arg.type, in_counter, in_arg.type))
-                        f.writeln("req->m >> *in_%d;" % in_counter)
-                        invoke_with += "*in_%d" % in_counter,
-                        in_counter += 1
-                    for out_arg in func.output:
-                        f.writeln("%s* out_%d = new %s;" % (out_arg.type, out_counter, out_arg.type))
-                        invoke_with += "out_%d" % out_counter,
-                        out_counter += 1
-                    f.writeln("auto __marshal_reply__ = [=] {");
-                    with f.indent():
-                        out_counter = 0
-                        for out_arg in func.output:
-                            f.writeln("*sconn << *out_%d;" % out_counter)
-                            out_counter += 1
-                    f.writeln("};");
-                    f.writeln("auto __cleanup__ = [=] {");
-                    with f.indent():
-                        in_counter = 0
-                        out_counter = 0
-                        for in_arg in func.input:
-                            f.writeln("delete in_%d;" % in_counter)
-                            in_counter += 1
-                        for out_arg in func.output:
-                            f.writeln("delete out_%d;" % out_counter)
-                            out_counter += 1
-                    f.writeln("};");
-                    f.writeln("rrr::DeferredReply* __defer__ = new rrr::DeferredReply(req, sconn, __marshal_reply__, __cleanup__);")
+                    if len(func.input) > 0:
+                        f.writeln("req->m >> rrr::tie_args(%s);" % ", ".join(["__defer__->in_%d" % i for i in range(len(func.input))]))
+                    for i in range(len(func.input)):
+                        invoke_with += "__defer__->in_%d" % i,
+                    for i in range(len(func.output)):
+                        invoke_with += "&__defer__->out_%d" % i,
                     invoke_with += "__defer__",
                     f.writeln("this->%s(%s);" % (func.name, ", ".join(invoke_with)))
                 else: # normal and fast rpc
@@ -124,20 +122,24 @@ def emit_service_and_proxy(service, f, rpc_table):
                     out_counter = 0
                     for in_arg in func.input:
                         f.writeln("%s in_%d;" % (in_arg.type, in_counter))
-                        f.writeln("req->m >> in_%d;" % in_counter)
                         invoke_with += "in_%d" % in_counter,
                         in_counter += 1
+                    if in_counter > 0:
+                        f.writeln("req->m >> rrr::tie_args(%s);" % ", ".join(["in_%d" % i for i in range(in_counter)]))
                     for out_arg in func.output:
                         f.writeln("%s out_%d;" % (out_arg.type, out_counter))
                         invoke_with += "&out_%d" % out_counter,
                         out_counter += 1
                     f.writeln("this->%s(%s);" % (func.name, ", ".join(invoke_with)))
                     f.writeln("sconn->begin_reply(req);")
-                    for i in range(out_counter):
-                        f.writeln("*sconn << out_%d;" % i)
+                    if out_counter > 0:
+                        f.writeln("*sconn << rrr::pack_args(%s);" % ", ".join(["out_%d" % i for i in range(out_counter)]))
                     f.writeln("sconn->end_reply();")
-                    f.writeln("delete req;")
-                    f.writeln("sconn->release();")
+                    if func.attr == "fast":
+                        f.writeln("sconn->put_request(req);")
+                    else:
+                        f.writeln("delete req;")
+                        f.writeln("sconn->release();")
                     if func.attr != "fast":
                         f.decr_indent()
                         f.writeln("};")
@@ -183,8 +185,7 @@ def emit_service_and_proxy(service, f, rpc_table):
                 if len(async_call_params) > 0:
                     f.writeln("if (__fu__ != nullptr) {")
                     with f.indent():
-                        for param in async_call_params:
-                            f.writeln("*__cl__ << %s;" % param)
+                        f.writeln("*__cl__ << rrr::pack_args(%s);" % ", ".join(async_call_params))
                     f.writeln("}")
                 f.writeln("__cl__->end_request();")
                 f.writeln("return __fu__;")
@@ -200,8 +201,7 @@ def emit_service_and_proxy(service, f, rpc_table):
                 if len(sync_out_params) > 0:
                     f.writeln("if (__ret__ == 0) {")
                     with f.indent():
-                        for param in sync_out_params:
-                            f.writeln("__fu__->get_reply() >> *%s;" % param)
+                        f.writeln("__fu__->get_reply() >> rrr::tie_args(%s);" % ", ".join(["*%s" % param for param in sync_out_params]))
                     f.writeln("}")
                 f.writeln("__fu__->release();")
                 f.writeln("return __ret__;")
@@ -2,9 +2,9 @@
 
 #include <functional>
 #include <iostream>
-#include <boost/coroutine2/protected_fixedsize_stack.hpp>
 #include "../base/all.hpp"
 #include "coroutine.h"
+#include "stack_pool.h"
 #include "reactor.h"
 
 
@@ -76,9 +76,7 @@ void Coroutine::Run() {
 //  up_boost_coro_task_ = make_shared<boost_coro_task_t>(
 
   const auto x = new boost_coro_task_t(
-#ifdef USE_PROTECTED_STACK
-      boost::coroutines2::protected_fixedsize_stack(),
-#endif
+      PooledStack(),
       std::bind(&Coroutine::BoostRunWrapper, this, std::placeholders::_1)
 //    [this] (boost_coro_yield_t& yield) {
 //      this->BoostRunWrapper(yield);
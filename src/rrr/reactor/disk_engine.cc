@@ -0,0 +1,161 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <unordered_set>
+#include "disk_engine.h"
+#include "event.h"
+
+namespace rrr {
+
+DiskEngine::~DiskEngine() {
+  for (auto& it : fds_) {
+    ::close(it.second);
+  }
+  fds_.clear();
+}
+
+void DiskEngine::Submit(std::shared_ptr<DiskEvent> sp_ev) {
+  submit_m_.lock();
+  bool was_empty = submitted_.empty();
+  submitted_.push_back(sp_ev);
+  submit_m_.unlock();
+  // the disk thread only sleeps when the queue is empty.
+  if (was_empty) {
+    submit_cv_.signal();
+  }
+}
+
+bool DiskEngine::HasCompleted() {
+  return !completed_.Empty();
+}
+
+void DiskEngine::PopCompleted(std::list<std::shared_ptr<DiskEvent>>& out) {
+  std::shared_ptr<DiskEvent> sp_ev;
+  while (completed_.Pop(sp_ev)) {
+    out.push_back(std::move(sp_ev));
+  }
+}
+
+void DiskEngine::Stop() {
+  submit_m_.lock();
+  stop_ = true;
+  submit_m_.unlock();
+  submit_cv_.bcast();
+}
+
+int DiskEngine::GetFd(const std::string& file) {
+  auto it = fds_.find(file);
+  if (it != fds_.end()) {
+    // the cached fd is only good while the path still names its file; after
+    // an unlink or a rename it would write where nobody reads.
+    struct stat path_st, fd_st;
+    if (::stat(file.c_str(), &path_st) == 0 &&
+        ::fstat(it->second, &fd_st) == 0 &&
+        path_st.st_dev == fd_st.st_dev && path_st.st_ino == fd_st.st_ino) {
+      return it->second;
+    }
+    ::close(it->second);
+    fds_.erase(it);
+  }
+  int fd = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0777);
+  if (fd < 0) {
+    // the events of the group must not complete as if they were written.
+    Log_fatal("cannot open %s: %s", file.c_str(), strerror(errno));
+  }
+  fds_[file] = fd;
+  return fd;
+}
+
+void DiskEngine::Flush(const std::string& file,
+                       std::vector<struct iovec>& iovs) {
+  if (iovs.empty()) {
+    return;
+  }
+  int fd = GetFd(file);
+  size_t idx = 0;
+  while (idx < iovs.size()) {
+    int cnt = std::min(iovs.size() - idx, (size_t) IOV_MAX);
+    ssize_t n = ::writev(fd, &iovs[idx], cnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Log_fatal("writev to %s failed: %s", file.c_str(), strerror(errno));
+    }
+    // skip fully written buffers, then retry the rest of a partial one.
+    while (idx < iovs.size() && (size_t) n >= iovs[idx].iov_len) {
+      n -= iovs[idx].iov_len;
+      idx++;
+    }
+    if (n > 0) {
+      iovs[idx].iov_base = (char*) iovs[idx].iov_base + n;
+      iovs[idx].iov_len -= n;
+    }
+  }
+  iovs.clear();
+}
+
+size_t DiskEngine::RunOnce(uint64_t wait_us) {
+  std::vector<std::shared_ptr<DiskEvent>> group;
+  submit_m_.lock();
+  if (submitted_.empty() && !stop_) {
+    submit_cv_.timed_wait(submit_m_, wait_us / 1000000.0);
+  }
+  group.swap(submitted_);
+  submit_m_.unlock();
+  if (group.empty()) {
+    return 0;
+  }
+
+  // pending appends per file, flushed lazily so that everything queued for
+  // the same log goes out in as few writev() calls as possible.
+  std::unordered_map<std::string, std::vector<struct iovec>> appends{};
+  std::vector<std::string> files{};
+  std::unordered_set<std::string> sync_set{};
+  for (auto& sp_ev : group) {
+    auto& ev = *sp_ev;
+    if (ev.op & DiskEvent::READ) {
+      // keep read-after-write order for the same file.
+      auto it = appends.find(ev.file);
+      if (it != appends.end()) {
+        Flush(ev.file, it->second);
+      }
+      ev.Read();
+    }
+    if (ev.op & DiskEvent::SPECIAL) {
+      ev.Special();
+    }
+    if (ev.IsAppend()) {
+      auto& iovs = appends[ev.file];
+      if (iovs.empty()) {
+        files.push_back(ev.file);
+      }
+      ev.Gather(iovs);
+    }
+    if (ev.op & DiskEvent::FSYNC) {
+      ev.sync = true;
+      sync_set.insert(ev.file);
+    }
+  }
+  for (auto& file : files) {
+    Flush(file, appends[file]);
+  }
+  for (auto& file : sync_set) {
+    int fd = GetFd(file);
+    if (::fdatasync(fd) != 0) {
+      Log_fatal("fdatasync of %s failed: %s", file.c_str(), strerror(errno));
+    }
+    n_syncs_++;
+  }
+  n_groups_++;
+
+  for (auto& sp_ev : group) {
+    completed_.Push(sp_ev);
+  }
+  return group.size();
+}
+
+} // namespace rrr
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/uio.h>
+#include "../base/all.hpp"
+#include "mpsc_queue.h"
+
+namespace rrr {
+
+class DiskEvent;
+
+/**
+ * Group-commit engine behind the per-reactor disk thread.
+ *
+ * The reactor thread submits DiskEvents; the disk thread sleeps on a
+ * condition variable until something is pending and then drains the whole
+ * submission queue as one group. Appends to the same file are gathered into
+ * writev() calls on a cached fd, and every file that asked for durability
+ * gets a single fdatasync() per group instead of one open/fsync/close per
+ * event. Finished events go to a lock-free completion queue, which
+ * Reactor::Loop() drains on the reactor thread.
+ */
+class DiskEngine {
+ public:
+  // how long the disk thread sleeps before rechecking its stop flag.
+  static const uint64_t IDLE_WAIT_US = 50 * 1000;
+
+  DiskEngine() = default;
+  DiskEngine(const DiskEngine&) = delete;
+  DiskEngine& operator=(const DiskEngine&) = delete;
+  ~DiskEngine();
+
+  // reactor thread (the only consumer of completions)
+  void Submit(std::shared_ptr<DiskEvent> sp_ev);
+  bool HasCompleted();
+  void PopCompleted(std::list<std::shared_ptr<DiskEvent>>& out);
+
+  // disk thread; returns the number of events handled in this group.
+  size_t RunOnce(uint64_t wait_us = IDLE_WAIT_US);
+  void Stop();
+
+  uint64_t n_groups_{0};
+  uint64_t n_syncs_{0};
+
+ private:
+  Mutex submit_m_;
+  CondVar submit_cv_;
+  std::vector<std::shared_ptr<DiskEvent>> submitted_{};
+  bool stop_{false};
+
+  MpscQueue<std::shared_ptr<DiskEvent>> completed_{};
+
+  // only touched by the disk thread. an fd is dropped once its path no
+  // longer names the same file, e.g. after the file was removed or renamed.
+  std::unordered_map<std::string, int> fds_{};
+
+  int GetFd(const std::string& file);
+  void Flush(const std::string& file, std::vector<struct iovec>& iovs);
+};
+
+} // namespace rrr
@@ -77,8 +77,10 @@ void Event::Wait(uint64_t timeout) {
 //    _dbg_p_scheduler_ = Reactor::GetReactor().get();
 //    auto& waiting_events = Reactor::GetReactor()->waiting_events_; // Timeout???
 //    waiting_events.push_back(shared_from_this());
+    // events such as TimeoutEvent carry their own deadline.
+    uint64_t deadline = Deadline();
 #ifdef EVENT_TIMEOUT_CHECK
-    if (timeout == 0) {
+    if (timeout == 0 && deadline == 0) {
       __debug_timeout_ = true;
       timeout = 200 * 1000 * 1000;
 //#ifdef SIMULATE_WAN
@@ -87,23 +89,13 @@ void Event::Wait(uint64_t timeout) {
     }
 #endif
     if (timeout > 0) {
-      wakeup_time_ = Time::now() + timeout;
+      deadline = Time::now() + timeout;
+    }
+    if (deadline > 0) {
+      wakeup_time_ = deadline;
       //Log_info("WAITING: %p", shared_from_this());
-      auto& timeout_events = Reactor::GetReactor()->timeout_events_;
-      timeout_events.push_back(shared_from_this());
+      Reactor::GetReactor()->timeout_events_.Schedule(this);
     }
-    // TODO optimize timeout_events, sort by wakeup time.
-//      auto it = timeout_events.end();
-//      timeout_events.push_back(shared_from_this());
-//      while (it != events.begin()) {
-//        it--;
-//        auto& it_event = *it;
-//        if (it_event->wakeup_time_ < wakeup_time_) {
-//          it++; // list insert happens before position.
-//          break;
-//        }
-//      }
-//      events.insert(it, shared_from_this());
 
     wp_coro_ = sp_coro;
     status_ = WAIT;
@@ -115,12 +107,18 @@ void Event::Wait(uint64_t timeout) {
       verify(0);
     }
 #endif
+    // woken before the deadline, the timer is no longer needed. the last
+    // reference may be the wheel's, so it is dropped on the way out.
+    auto sp_self = TimerWheel::Cancel(this);
   }
 }
 
 bool Event::Test() {
   verify(__debug_creator); // if this fails, the event is not created by reactor.
   if (IsReady()) {
+    if (!notified_) {
+      UpdateParents(true);
+    }
     if (status_ == INIT) {
       // wait has not been called, do nothing until wait happens.
     } else if (status_ == WAIT) {
@@ -144,6 +142,9 @@ bool Event::Test() {
     return true;
   }
   else{
+    if (notified_) {
+      UpdateParents(false);
+    }
     if(status_ == DONE){
       status_ = INIT;
     }
@@ -151,10 +152,66 @@ bool Event::Test() {
   return false;
 }
 
+bool Event::AddParent(Event* parent) {
+  if (!notified_ && IsReady()) {
+    // became ready without a Test(), catch up the existing parents first.
+    UpdateParents(true);
+  }
+  parents_.push_back(parent);
+  uint64_t deadline = Deadline();
+  if (!notified_ && deadline > 0 && status_ == INIT &&
+      !timeout_hook_.Linked()) {
+    // nothing calls Test() on an event that is ready by time alone, so arm
+    // its timer here; the reactor tests it when the timer fires.
+    wakeup_time_ = deadline;
+    Reactor::GetReactor()->timeout_events_.Schedule(this);
+  }
+  return notified_;
+}
+
+void Event::RemoveParent(Event* parent) {
+  auto it = std::find(parents_.begin(), parents_.end(), parent);
+  if (it != parents_.end()) {
+    parents_.erase(it);
+  }
+}
+
+void Event::UpdateParents(bool ready) {
+  notified_ = ready;
+  for (auto parent : parents_) {
+    parent->OnChildReady(ready);
+  }
+}
+
+void CompositeEvent::OnChildReady(bool ready) {
+  bool before = IsReady();
+  if (ready) {
+    n_ready_++;
+  } else {
+    verify(n_ready_ > 0);
+    n_ready_--;
+  }
+  if (before != IsReady()) {
+    Test();
+  }
+}
+
+CompositeEvent::~CompositeEvent() {
+  for (auto& sp_ev : events_) {
+    sp_ev->RemoveParent(this);
+  }
+}
+
 Event::Event() {
-  auto coro = Coroutine::CurrentCoroutine();
-//  verify(coro);
-  wp_coro_ = coro;
+  if (!Reactor::sp_running_coro_th_) {
+    Log_fatal("rrr::Event: created outside a coroutine, e.g. in a fast rpc "
+              "handler; start a coroutine for work that needs events");
+  }
+  wp_coro_ = Reactor::sp_running_coro_th_;
+}
+
+Event::~Event() {
+  timeout_hook_.Unlink();
 }
 
 DiskEvent::DiskEvent(std::string file_, std::vector<std::map<int, i32>> cmd_, Operation op_): Event(),
@@ -173,15 +230,13 @@ DiskEvent::DiskEvent(std::string file_, void* ptr, size_t size, size_t count, Op
 }
 
 DiskEvent::DiskEvent(std::function<void()> f): Event(),
+																							 op(SPECIAL),
 																							 func_(f){
 }
 
 void DiskEvent::AddToList(){
-  rrr::Reactor::GetReactor()->disk_job_.lock();
-  auto& disk_events = rrr::Reactor::GetReactor()->disk_events_;
-  disk_events.push_back(shared_from_this());
-  //Log_info("thread of disk events: %d", rrr::Reactor::GetReactor()->thread_id_);
-  rrr::Reactor::GetReactor()->disk_job_.unlock();
+  auto sp_ev = std::static_pointer_cast<DiskEvent>(shared_from_this());
+  rrr::Reactor::GetReactor()->disk_engine_.Submit(sp_ev);
 }
 
 
@@ -11,8 +11,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/uio.h>
 //#include "../../deptran/client_worker.h"
 #include "../base/all.hpp"
+#include "intrusive_list.h"
 
 #define SUCCESS (0)
 #define REPEAT (-5)
@@ -43,7 +45,7 @@ class Event : public std::enable_shared_from_this<Event> {
 	int timeout_{0};
 	static int begin_time;
 	static int invalid_ids;
-  uint64_t wakeup_time_; // calculated by timeout, unit: microsecond
+  uint64_t wakeup_time_{0}; // calculated by timeout, unit: microsecond
 
   // An event is usually allocated on a coroutine stack, thus it cannot own a
   //   shared_ptr to the coroutine it is.
@@ -51,6 +53,18 @@ class Event : public std::enable_shared_from_this<Event> {
   // When the stack that contains the event frees, the event frees.
   std::weak_ptr<Coroutine> wp_coro_{};
 
+  // links the event into the reactor's timeout list while it waits.
+  ListHook<Event> timeout_hook_{this};
+  // held by the timer wheel while timeout_hook_ is linked, so the event is
+  // never destroyed, possibly by another thread, while the wheel links it.
+  std::shared_ptr<Event> sp_wheel_ref_{};
+
+  // composite events this one is a child of. a parent always holds a
+  // shared_ptr to its children and unlinks itself when it goes away.
+  std::vector<Event*> parents_{};
+  // whether parents_ currently count this event as ready.
+  bool notified_{false};
+
   virtual void Wait(uint64_t timeout=0) final;
 
   void Wait(function<bool(int)> f) {
@@ -64,6 +78,11 @@ class Event : public std::enable_shared_from_this<Event> {
 	virtual void AddFinalize();
 	virtual void FreeDangling(std::string ip);
   virtual uint64_t GetCoroId();
+  // absolute wakeup time used when Wait() is called without a timeout,
+  // 0 means wait until triggered.
+  virtual uint64_t Deadline() {
+    return 0;
+  }
   virtual bool Test();
 	virtual bool IsSlow();
   virtual bool IsReady() {
@@ -71,9 +90,18 @@ class Event : public std::enable_shared_from_this<Event> {
     return test_(0);
   }
 
+  // link a composite parent, returns whether this event is ready already.
+  bool AddParent(Event* parent);
+  void RemoveParent(Event* parent);
+  // tell every parent that this event became ready, or stopped being ready.
+  void UpdateParents(bool ready);
+  // called by a child on every readiness change it reports.
+  virtual void OnChildReady(bool ready) {}
+
   friend Reactor;
 // protected:
   Event();
+  virtual ~Event();
 };
 
 class DiskEvent : public Event {
@@ -92,6 +120,8 @@ class DiskEvent : public Event {
 	std::function<void()> func_;
 	//create a more generic write instead of a map
   std::vector<std::map<int, i32>> cmd;
+	// serialized form of cmd, kept alive until the group is written.
+	std::string cmd_buf_;
 	
 	friend inline Operation operator | (Operation op1, Operation op2) {
 		return static_cast<Operation>(static_cast<int>(op1) | static_cast<int>(op2));
@@ -107,26 +137,34 @@ class DiskEvent : public Event {
 
   void AddToList();
 
-  void Write() {
-		int fd = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0777);
-		std::string str;	
-		int num1;
-		i32 num2;
-		for(int i = 0; i < cmd.size(); i++){
-			for(auto it2 = cmd[i].begin(); it2 != cmd[i].end(); it2++){	
-				num1 = it2->first;
-				::write(fd, &num1, sizeof(int));
-				str = ": ";
-				::write(fd, str.c_str(), str.length());
-				num2 = it2->second;
-				::write(fd, &num2, sizeof(i32));
-				str = "\n";
-				::write(fd, str.c_str(), str.length());
+	bool IsAppend() {
+		return op & (WRITE | WRITE_SPEC);
+	}
+
+	// append what this event writes to iovs; the memory stays owned by the
+	// event (or by the waiting caller) until the group commit is done.
+	void Gather(std::vector<struct iovec>& iovs) {
+		if (op & WRITE) {
+			cmd_buf_.clear();
+			for (int i = 0; i < cmd.size(); i++) {
+				for (auto it2 = cmd[i].begin(); it2 != cmd[i].end(); it2++) {
+					int num1 = it2->first;
+					i32 num2 = it2->second;
+					cmd_buf_.append((const char*) &num1, sizeof(int));
+					cmd_buf_.append(": ");
+					cmd_buf_.append((const char*) &num2, sizeof(i32));
+					cmd_buf_.append("\n");
+				}
+			}
+			if (!cmd_buf_.empty()) {
+				iovs.push_back({(void*) cmd_buf_.data(), cmd_buf_.size()});
 			}
 		}
-		::close(fd);
-    //handled = true;
-  }
+		if ((op & WRITE_SPEC) && size_ * count_ > 0) {
+			iovs.push_back({buffer, size_ * count_});
+			written_ = count_;
+		}
+	}
 
 	void Read() {
 		FILE* f = fopen(file.c_str(), "rb");
@@ -135,49 +173,11 @@ class DiskEvent : public Event {
 			fclose(f);
 		}
 	}
-	
-	void FSync() {
-		int fd = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT);
-		::fsync(fd);
-		::close(fd);
-	}
 
 	void Special() {
 		func_();
 	}
-	int Write_Spec() {
-		/*int fd = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT);
-		::write(fd, buffer, size_);
-		::close(fd);*/
-
-		FILE* f = fopen(file.c_str(), "ab");
-		int written = 0;
-		if (f != NULL){
-			written = fwrite(buffer, size_, count_, f);
-			fclose(f);
-		} else {
-			Log_info("file: %s", file.c_str());
-			Log_info("error is: %s", strerror(errno)); 
-		}
-		return written;
-	}
 
-	int Handle() {
-		int result = 0;
-		if (op & WRITE) {
-			Write();
-		}
-		if (op & READ) {
-			Read();
-		}
-		if (op & FSYNC) {
-			sync = true;
-		}
-		if (op & WRITE_SPEC) {
-			result += Write_Spec();
-		}
-		return result;
-	}
   bool IsReady() {
     return handled;
   }
@@ -266,11 +266,23 @@ class TimeoutEvent : public Event {
 //    Log_debug("test timeout");
     return (Time::now() > wakeup_time_);
   }
+
+  uint64_t Deadline() override {
+    // one past, so that IsReady() holds when the timer fires.
+    return wakeup_time_ + 1;
+  }
 };
 
-class OrEvent : public Event {
+/**
+ * Base of events that are ready once enough of their children are. Children
+ * report their own readiness changes through UpdateParents(), so IsReady()
+ * is a counter comparison instead of a walk over every child.
+ */
+class CompositeEvent : public Event {
  public:
   vector<shared_ptr<Event>> events_;
+  // children that currently report ready.
+  size_t n_ready_{0};
 
   void AddEvent() {
     // empty func for recursive variadic parameters
@@ -278,34 +290,40 @@ class OrEvent : public Event {
 
   template<typename X, typename... Args>
   void AddEvent(X& x, Args&... rest) {
-    events_.push_back(std::dynamic_pointer_cast<Event>(x));
+    auto sp_ev = std::dynamic_pointer_cast<Event>(x);
+    events_.push_back(sp_ev);
+    if (sp_ev->AddParent(this)) {
+      n_ready_++;
+    }
     AddEvent(rest...);
   }
 
-  template<typename... Args>
-  OrEvent(Args&&... args) {
-    AddEvent(args...);
-  }
+  // number of ready children that makes this event ready.
+  virtual size_t Threshold() = 0;
 
-  bool IsReady() {
-    return std::any_of(events_.begin(), events_.end(), [](shared_ptr<Event> e){return e->IsReady();});
+  bool IsReady() override {
+    return n_ready_ >= Threshold();
   }
+
+  void OnChildReady(bool ready) override;
+
+  ~CompositeEvent() override;
 };
 
-class AndEvent : public Event {
+class OrEvent : public CompositeEvent {
  public:
-  vector<shared_ptr<Event>> events_;
-
-  void AddEvent() {
-    // empty func for recursive variadic parameters
+  template<typename... Args>
+  OrEvent(Args&&... args) {
+    AddEvent(args...);
   }
 
-  template<typename X, typename... Args>
-  void AddEvent(X& x, Args&... rest) {
-    events_.push_back(std::dynamic_pointer_cast<Event>(x));
-    AddEvent(rest...);
+  size_t Threshold() override {
+    return 1;
   }
+};
 
+class AndEvent : public CompositeEvent {
+ public:
   template<typename... Args>
   AndEvent(Args&&... args) {
     AddEvent(args...);
@@ -317,44 +335,22 @@ class AndEvent : public Event {
     }
   }
 
-  bool IsReady() {
-    return std::all_of(events_.begin(), events_.end(), [](shared_ptr<Event> e){return e->IsReady();});
+  size_t Threshold() override {
+    return events_.size();
   }
 };
 
-class NEvent : public Event {
+class NEvent : public CompositeEvent {
  public:
-  vector<shared_ptr<Event>> events_;
   int number;
 
-  void AddEvent() {
-    // empty func for recursive variadic parameters
-  }
-
-  template<typename X, typename... Args>
-  void AddEvent(X& x, Args&... rest) {
-    events_.push_back(std::dynamic_pointer_cast<Event>(x));
-    AddEvent(rest...);
-  }
-
   template<typename... Args>
   NEvent(Args&&... args) {
     AddEvent(args...);
   }
 
-  bool IsReady() {
-    int count = 0;
-    for(auto index = events_.begin(); index != events_.end(); index++){
-      if((*index)->IsReady()){
-        count++;
-        if(count == number){
-          return true;
-        }
-      }
-    }
-    return false;
-    
-    //return std::all_of(events_.begin(), events_.end(), [](shared_ptr<Event> e){return e->IsReady();});
+  size_t Threshold() override {
+    return number;
   }
 };
 
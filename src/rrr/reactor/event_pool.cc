@@ -0,0 +1,139 @@
+#include <atomic>
+#include <stdlib.h>
+#include "../base/all.hpp"
+#include "event_pool.h"
+
+namespace rrr {
+
+namespace {
+
+struct FreeBlock {
+  FreeBlock* next;
+  // size class, only used for blocks freed by another thread.
+  size_t cls;
+};
+
+struct ThreadPool {
+  static const size_t N_CLASSES = EventPool::MAX_POOLED_SIZE / EventPool::ALIGN;
+
+  FreeBlock* free_[N_CLASSES] = {};
+  // blocks freed by other threads, pushed by them and taken as a whole by
+  // the owner, so there is no ABA.
+  std::atomic<FreeBlock*> remote_free_{nullptr};
+  char* slab_cur_{nullptr};
+  char* slab_end_{nullptr};
+  int64_t n_in_use_{0};
+
+  void* Carve(size_t bytes) {
+    if (slab_cur_ == nullptr || slab_cur_ + bytes > slab_end_) {
+      // the tail of the old slab is simply abandoned. slabs are aligned to
+      // their size and start with the owning pool, see OwnerOf().
+      void* slab = nullptr;
+      verify(posix_memalign(&slab, EventPool::SLAB_SIZE,
+                            EventPool::SLAB_SIZE) == 0);
+      *static_cast<ThreadPool**>(slab) = this;
+      slab_cur_ = static_cast<char*>(slab) + EventPool::ALIGN;
+      slab_end_ = static_cast<char*>(slab) + EventPool::SLAB_SIZE;
+    }
+    void* p = slab_cur_;
+    slab_cur_ += bytes;
+    return p;
+  }
+
+  void PushRemote(FreeBlock* blk) {
+    auto head = remote_free_.load(std::memory_order_relaxed);
+    do {
+      blk->next = head;
+    } while (!remote_free_.compare_exchange_weak(head, blk,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+  }
+
+  void DrainRemote() {
+    if (remote_free_.load(std::memory_order_relaxed) == nullptr) {
+      return;
+    }
+    auto blk = remote_free_.exchange(nullptr, std::memory_order_acquire);
+    while (blk != nullptr) {
+      auto next = blk->next;
+      blk->next = free_[blk->cls];
+      free_[blk->cls] = blk;
+      n_in_use_--;
+      blk = next;
+    }
+  }
+};
+
+static_assert(sizeof(FreeBlock) <= EventPool::ALIGN,
+              "a free block has to fit the smallest class");
+static_assert(sizeof(ThreadPool*) <= EventPool::ALIGN,
+              "the slab header has to fit before the first block");
+
+inline ThreadPool* OwnerOf(void* p) {
+  auto slab = reinterpret_cast<uintptr_t>(p) & ~(EventPool::SLAB_SIZE - 1);
+  return *reinterpret_cast<ThreadPool**>(slab);
+}
+
+// intentionally never destroyed: blocks may be released by another thread
+// after this one exits.
+thread_local ThreadPool* pool_th_ = nullptr;
+
+inline ThreadPool& GetPool() {
+  if (pool_th_ == nullptr) {
+    pool_th_ = new ThreadPool();
+  }
+  return *pool_th_;
+}
+
+inline size_t SizeClass(size_t size) {
+  return (size + EventPool::ALIGN - 1) / EventPool::ALIGN - 1;
+}
+
+} // namespace
+
+void* EventPool::Allocate(size_t size) {
+  if (size > MAX_POOLED_SIZE) {
+    return ::operator new(size);
+  }
+  auto& pool = GetPool();
+  auto cls = SizeClass(size);
+  if (pool.free_[cls] == nullptr) {
+    pool.DrainRemote();
+  }
+  pool.n_in_use_++;
+  auto blk = pool.free_[cls];
+  if (blk != nullptr) {
+    pool.free_[cls] = blk->next;
+    return blk;
+  }
+  return pool.Carve((cls + 1) * ALIGN);
+}
+
+void EventPool::Free(void* p, size_t size) {
+  if (p == nullptr) {
+    return;
+  }
+  if (size > MAX_POOLED_SIZE) {
+    ::operator delete(p);
+    return;
+  }
+  auto owner = OwnerOf(p);
+  auto cls = SizeClass(size);
+  auto blk = static_cast<FreeBlock*>(p);
+  if (owner != pool_th_) {
+    blk->cls = cls;
+    owner->PushRemote(blk);
+    return;
+  }
+  blk->next = owner->free_[cls];
+  owner->free_[cls] = blk;
+  owner->n_in_use_--;
+}
+
+int64_t EventPool::NumInUse() {
+  auto& pool = GetPool();
+  pool.DrainRemote();
+  return pool.n_in_use_;
+}
+
+} // namespace rrr
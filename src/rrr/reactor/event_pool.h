@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace rrr {
+
+/**
+ * Per-thread slab pool for reactor events.
+ *
+ * Each reactor runs on its own thread, so the free lists are thread local and
+ * allocation needs no locking. Blocks are carved out of large slabs and
+ * sorted into size classes. A block freed by its own thread goes straight
+ * back onto that thread's free list; one freed by another thread is pushed
+ * onto a lock-free list of the owning pool, found through the slab header,
+ * which the owner drains when it next allocates. Slabs are kept for the
+ * lifetime of the process, so a pool only grows to the peak number of live
+ * events on that thread.
+ */
+class EventPool {
+ public:
+  static const size_t ALIGN = 16;
+  static const size_t MAX_POOLED_SIZE = 1024;
+  static const size_t SLAB_SIZE = 64 * 1024;
+
+  static void* Allocate(size_t size);
+  static void Free(void* p, size_t size);
+
+  // blocks of the calling thread's pool that are not freed yet, wherever
+  // they are freed.
+  static int64_t NumInUse();
+};
+
+/**
+ * Allocator for std::allocate_shared, so that the event and its control
+ * block come out of the EventPool as one block.
+ */
+template <typename T>
+class EventAllocator {
+ public:
+  typedef T value_type;
+
+  EventAllocator() = default;
+  template <typename U>
+  EventAllocator(const EventAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (n != 1) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(EventPool::Allocate(sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n != 1) {
+      ::operator delete(p);
+      return;
+    }
+    EventPool::Free(p, sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const EventAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const EventAllocator<U>&) const {
+    return false;
+  }
+};
+
+} // namespace rrr
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include "../base/all.hpp"
+
+namespace rrr {
+
+/**
+ * Hook embedded in an object that can sit on an IntrusiveList.
+ * Linking and unlinking never allocate and never touch a refcount; the
+ * object is responsible for unlinking itself before it goes away.
+ */
+template <typename T>
+struct ListHook {
+  ListHook* prev_{nullptr};
+  ListHook* next_{nullptr};
+  T* owner_{nullptr};
+
+  explicit ListHook(T* owner = nullptr) : owner_(owner) {}
+  ListHook(const ListHook&) = delete;
+  ListHook& operator=(const ListHook&) = delete;
+
+  bool Linked() const {
+    return next_ != nullptr;
+  }
+
+  void Unlink() {
+    if (!Linked()) {
+      return;
+    }
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = nullptr;
+    next_ = nullptr;
+  }
+};
+
+/**
+ * Circular doubly-linked list over ListHook members. The list does not own
+ * its elements, so an element can be removed in O(1) through its own hook
+ * without knowing which list it is on.
+ */
+template <typename T, ListHook<T> T::*Hook>
+class IntrusiveList {
+ public:
+  IntrusiveList() {
+    head_.prev_ = &head_;
+    head_.next_ = &head_;
+  }
+  IntrusiveList(const IntrusiveList&) = delete;
+  IntrusiveList& operator=(const IntrusiveList&) = delete;
+
+  ~IntrusiveList() {
+    clear();
+  }
+
+  bool empty() const {
+    return head_.next_ == &head_;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (auto h = head_.next_; h != &head_; h = h->next_) {
+      n++;
+    }
+    return n;
+  }
+
+  void push_back(T* obj) {
+    auto& hook = obj->*Hook;
+    verify(hook.owner_ == obj);
+    hook.Unlink();
+    hook.prev_ = head_.prev_;
+    hook.next_ = &head_;
+    head_.prev_->next_ = &hook;
+    head_.prev_ = &hook;
+  }
+
+  T* front() const {
+    return empty() ? nullptr : head_.next_->owner_;
+  }
+
+  T* pop_front() {
+    if (empty()) {
+      return nullptr;
+    }
+    auto h = head_.next_;
+    h->Unlink();
+    return h->owner_;
+  }
+
+  // moves every element of other to the back of this list.
+  void splice(IntrusiveList& other) {
+    if (other.empty()) {
+      return;
+    }
+    auto first = other.head_.next_;
+    auto last = other.head_.prev_;
+    other.head_.next_ = &other.head_;
+    other.head_.prev_ = &other.head_;
+    first->prev_ = head_.prev_;
+    last->next_ = &head_;
+    head_.prev_->next_ = first;
+    head_.prev_ = last;
+  }
+
+  void clear() {
+    while (pop_front() != nullptr) {
+    }
+  }
+
+ private:
+  ListHook<T> head_{};
+};
+
+} // namespace rrr
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace rrr {
+
+/**
+ * Unbounded lock-free multi-producer single-consumer queue (Vyukov style).
+ *
+ * Push() may be called from any thread and never blocks: it is one atomic
+ * exchange on the head plus a release store. Pop() and Empty() must only be
+ * called by the one thread that owns the queue. An element whose Push() is
+ * still in flight may not be visible yet; it shows up on a later Pop().
+ */
+template <typename T>
+class MpscQueue {
+  struct Node {
+    std::atomic<Node*> next_{nullptr};
+    T value_{};
+  };
+
+  // producers link new nodes after head_.
+  std::atomic<Node*> head_;
+  // consumer only; always points at a consumed (stub) node.
+  Node* tail_;
+
+ public:
+  MpscQueue() {
+    auto stub = new Node();
+    head_.store(stub, std::memory_order_relaxed);
+    tail_ = stub;
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  ~MpscQueue() {
+    T v;
+    while (Pop(v)) {
+    }
+    delete tail_;
+  }
+
+  void Push(T v) {
+    auto node = new Node();
+    node->value_ = std::move(v);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next_.store(node, std::memory_order_release);
+  }
+
+  bool Pop(T& v) {
+    Node* next = tail_->next_.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    v = std::move(next->value_);
+    next->value_ = T();
+    delete tail_;
+    tail_ = next;
+    return true;
+  }
+
+  bool Empty() const {
+    return tail_->next_.load(std::memory_order_acquire) == nullptr;
+  }
+};
+
+/**
+ * Bounded lock-free multi-producer single-consumer ring (Vyukov's bounded
+ * queue). Slots are allocated once and filled in place, so a slot type that
+ * owns a buffer, e.g. std::string, keeps its capacity across laps.
+ *
+ * TryPush() may be called from any thread and fails instead of blocking when
+ * the ring is full. PopBatch() and Empty() must only be called by the one
+ * thread that owns the ring.
+ */
+template <typename T>
+class MpscRing {
+  struct Slot {
+    std::atomic<size_t> seq_{0};
+    T value_{};
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_pos_{0};
+  // keep the consumer's index off the producers' cache line.
+  char pad_[64];
+  size_t dequeue_pos_{0};
+
+ public:
+  // capacity is rounded up to a power of two.
+  explicit MpscRing(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    slots_.reset(new Slot[n]);
+    for (size_t i = 0; i < n; i++) {
+      slots_[i].seq_.store(i, std::memory_order_relaxed);
+    }
+    mask_ = n - 1;
+  }
+
+  MpscRing(const MpscRing&) = delete;
+  MpscRing& operator=(const MpscRing&) = delete;
+
+  size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+  // fill(T&) writes the claimed slot; returns false if the ring is full.
+  template <typename F>
+  bool TryPush(F&& fill) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &slots_[pos & mask_];
+      size_t seq = slot->seq_.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(slot->value_);
+    slot->seq_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // hands up to max filled slots to consume(T&) in push order, a slot is
+  // reused as soon as consume returns. returns the number consumed.
+  template <typename F>
+  size_t PopBatch(size_t max, F&& consume) {
+    size_t n = 0;
+    while (n < max) {
+      Slot& slot = slots_[dequeue_pos_ & mask_];
+      if (slot.seq_.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+        break;
+      }
+      consume(slot.value_);
+      slot.seq_.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+      dequeue_pos_++;
+      n++;
+    }
+    return n;
+  }
+
+  bool Empty() const {
+    const Slot& slot = slots_[dequeue_pos_ & mask_];
+    return slot.seq_.load(std::memory_order_acquire) != dequeue_pos_ + 1;
+  }
+};
+
+} // namespace rrr
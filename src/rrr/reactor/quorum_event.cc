@@ -1,53 +1,66 @@
-
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include "quorum_event.h"
 
 
 namespace janus {
 
-history_t QuorumEvent::history{};
-times_t QuorumEvent::times{};
-count_t QuorumEvent::counts{};
-count_t QuorumEvent::counts_two{};
-latency_t QuorumEvent::latencies{};
+int QuorumEvent::count_two_ungrouped_ = 0;
 uint64_t QuorumEvent::count = 0;
-	
-	void QuorumEvent::recordHistory(unordered_set<std::string> ip_addrs) {
-		auto it = QuorumEvent::history.find(ip_addrs);
-		begin_time = Time::now(true);
 
-		ips_ = ip_addrs;
-		if (it == QuorumEvent::history.end()) {
-			unordered_map<std::string, int> counts = {};
-			unordered_map<std::string, vector<int>> empties = {};
-			
-			for (std::string ip_addr : ip_addrs) {
-				counts.insert(std::make_pair(ip_addr, 0));
-				std::vector<int> empty{};
-				empties.insert(std::make_pair(ip_addr, empty));
-			}
+	ReplicaGroup* ReplicaGroup::Intern(const unordered_set<std::string>& ips) {
+		static std::mutex mtx;
+		static std::map<vector<std::string>, ReplicaGroup*> groups;
+		vector<std::string> key(ips.begin(), ips.end());
+		std::sort(key.begin(), key.end());
+		verify(key.size() <= MAX_REPLICAS);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = groups.find(key);
+		if (it != groups.end()) {
+			return it->second;
+		}
+		// never freed, events and communicators keep raw pointers.
+		auto group = new ReplicaGroup();
+		group->id_ = groups.size();
+		group->ips_ = key;
+		group->history_.resize(key.size(), 0);
+		group->latencies_.resize(key.size());
+		group->time_ = Time::now();
+		groups[key] = group;
+		return group;
+	}
 
-			QuorumEvent::history.insert(std::make_pair(ip_addrs, counts));
-			QuorumEvent::counts.insert(std::make_pair(ip_addrs, 0));
-			QuorumEvent::times.insert(std::make_pair(ip_addrs, Time::now()));
-			QuorumEvent::latencies.insert(std::make_pair(ip_addrs, empties));
+	int ReplicaGroup::IndexOf(const std::string& ip) const {
+		for (int i = 0; i < ips_.size(); i++) {
+			if (ips_[i] == ip) {
+				return i;
+			}
 		}
+		return -1;
 	}
 
-	void QuorumEvent::updateDataStructs(std::string ip_addr) {
-		QuorumEvent::history[ips_][ip_addr]++;
-		QuorumEvent::counts[ips_]++;
+	void QuorumEvent::recordHistory() {
+		begin_time = Time::now(true);
+		recording_ = true;
+	}
+
+	void QuorumEvent::updateDataStructs(int replica) {
+		group_->history_[replica]++;
+		group_->count_++;
 
 		//time in us
 		int elapsed_time = Time::now(true) - begin_time;
-		QuorumEvent::latencies[ips_][ip_addr].push_back(elapsed_time);
+		group_->latencies_[replica].sample(elapsed_time);
 	}
 	
-	void QuorumEvent::verifyTransient(std::string ip_addr) {
+	void QuorumEvent::verifyTransient() {
 		int slow_nodes = 0;
 		int nodes = 0;
 
 		int curr_time = Time::now();
-		int elapsed_time_us = curr_time - times[ips_];
+		int elapsed_time_us = curr_time - group_->time_;
 
 		if (elapsed_time_us >= PRINT_INTERVAL_US) {
 			std::vector<long> medians{};
@@ -55,23 +68,20 @@ uint64_t QuorumEvent::count = 0;
 			std::vector<long> p99_9s{};
 			std::vector<std::string> ips{};
 							
-			int threshold = (int)(QuorumEvent::counts[ips_]/(QuorumEvent::history[ips_].size()));
-			for (auto it = QuorumEvent::history[ips_].begin(); it != QuorumEvent::history[ips_].end(); it++) {
-				if (it->second == 0) {
+			for (int i = 0; i < group_->ips_.size(); i++) {
+				if (group_->history_[i] == 0) {
 									
 					slow_nodes++;
-					//Log_info("Warning: the follower with address %s is slower than usual", it->first.c_str());
-					//Log_info("Warning: information is %d and %d", it->second, QuorumEvent::counts[ips_]);
+					//Log_info("Warning: the follower with address %s is slower than usual", group_->ips_[i].c_str());
 				} else {
-					std::vector<int> lats = QuorumEvent::latencies[ips_][it->first];
-					std::sort(lats.begin(), lats.end());
-					medians.push_back(lats[lats.size()/2.0]);
-					p99s.push_back(lats[lats.size()*99/100.0]);
-					p99_9s.push_back(lats[lats.size()*99.9/100.0]);
-					ips.push_back(it->first);
+					auto& lats = group_->latencies_[i];
+					medians.push_back(lats.quantile(0.5));
+					p99s.push_back(lats.quantile(0.99));
+					p99_9s.push_back(lats.quantile(0.999));
+					ips.push_back(group_->ips_[i]);
 				}
-				it->second = 0;
-				QuorumEvent::latencies[ips_][it->first].clear();
+				group_->history_[i] = 0;
+				group_->latencies_[i].clear();
 
 				nodes++;
 			}
@@ -83,25 +93,16 @@ uint64_t QuorumEvent::count = 0;
 			}
 
 			curr_time = Time::now();
-			QuorumEvent::counts[ips_] = 0;
-			QuorumEvent::times[ips_] = curr_time;
+			group_->count_ = 0;
+			group_->time_ = curr_time;
 		}
 	}
 
-	void QuorumEvent::updateHistory(std::string ip_addr) {
-		if (ip_addr != "") {
-			auto map = QuorumEvent::history.find(ips_);
-
-			if (map != QuorumEvent::history.end()) {
-				//Log_info("ip_addr here: %s", ip_addr.c_str());
-				auto ip_count = QuorumEvent::history[ips_].find(ip_addr);
-				
-				if (ip_count != map->second.end()) {
-					if (!IsReady()) {
-						updateDataStructs(ip_addr);
-						verifyTransient(ip_addr);
-					}
-				}
+	void QuorumEvent::updateHistory(int replica) {
+		if (replica >= 0 && recording_) {
+			if (!IsReady()) {
+				updateDataStructs(replica);
+				verifyTransient();
 			}
 		}
 	}
@@ -124,25 +125,28 @@ uint64_t QuorumEvent::count = 0;
 	void QuorumEvent::Finalize(int timeout, int flag) {
 		CalledFinalize();
 
-		if (QuorumEvent::counts_two[ips_] == 250000) {
-			QuorumEvent::counts_two[ips_] = 0;
+		int& n_finalized = group_ != nullptr ? group_->count_two_ : QuorumEvent::count_two_ungrouped_;
+		if (n_finalized == 250000) {
+			n_finalized = 0;
 			finalize_event->Wait(timeout);
 		} else {
-			QuorumEvent::counts_two[ips_]++;
+			n_finalized++;
 		}
 
-		if (finalize_event->status_ == TIMEOUT) {
+		if (finalize_event->status_ == TIMEOUT && group_ != nullptr) {
 			if (flag == TimeoutFlag::FLAG_FREE) {
-				for (auto it = changing_ips_.begin(); it != changing_ips_.end(); it++) {
-					//long mem_before = MemoryUtil();
-					FreeDangling(*it);
-					//long mem_after = MemoryUtil();
-					Log_info("finalizing timeout");
+				for (int i = 0; i < group_->ips_.size(); i++) {
+					if (pending_ & (1u << i)) {
+						//long mem_before = MemoryUtil();
+						FreeDangling(group_->ips_[i]);
+						//long mem_after = MemoryUtil();
+						Log_info("finalizing timeout");
+					}
 				}			
 			}
 		}
 
-		changing_ips_.clear();
+		pending_ = 0;
 	}
 
 } // namespace janus
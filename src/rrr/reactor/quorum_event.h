@@ -2,21 +2,15 @@
 
 #include <vector>
 #include <unordered_map>
-#include <boost/container_hash/hash.hpp>
-//#include <unordered_set>
+#include <unordered_set>
 //#include <fstream>
 #include <iostream>
 #include <sstream>
 #include "event.h"
+#include "event_pool.h"
+#include "../misc/stat.hpp"
 #include <chrono>
 
-template <typename Container> // we can make this generic for any container [1]
-struct container_hash {
-    std::size_t operator()(Container const& c) const {
-        return boost::hash_range(c.begin(), c.end());
-    }
-};
-
 using rrr::Event;
 using rrr::IntEvent;
 using rrr::Time;
@@ -25,15 +19,33 @@ using std::unordered_map;
 using std::unordered_set;
 
 typedef std::unordered_map<int, unordered_map<int, unordered_map<int, unordered_set<int>>>> dependencies_t;
-typedef std::unordered_map<unordered_set<std::string>, unordered_map<std::string, int>, container_hash<unordered_set<std::string>>> history_t;
-typedef std::unordered_map<unordered_set<std::string>, int, container_hash<unordered_set<std::string>>> count_t;
-typedef std::unordered_map<unordered_set<std::string>, int, container_hash<unordered_set<std::string>>> times_t;
-typedef std::unordered_map<unordered_set<std::string>, unordered_map<std::string, std::vector<int>>, container_hash<std::unordered_set<std::string>>> latency_t;
 
 #define logging 0
 
 namespace janus {
 
+/**
+ * A set of replica addresses, interned once (usually by a communicator) so
+ * that quorum events only carry a pointer to it. The slow-replica statistics
+ * are kept per group in arrays indexed by a replica's position in ips_.
+ */
+struct ReplicaGroup {
+	static const int MAX_REPLICAS = 32;
+	int32_t id_ = -1;
+	vector<std::string> ips_{};
+	// responses per replica since the last check.
+	vector<int> history_{};
+	vector<rrr::LatencySketch> latencies_{};
+	int count_ = 0;
+	int count_two_ = 0;
+	uint64_t time_ = 0;
+
+	// the same set of addresses always gives the same group.
+	static ReplicaGroup* Intern(const unordered_set<std::string>& ips);
+	// position of ip in ips_, -1 if it is not in the group.
+	int IndexOf(const std::string& ip) const;
+};
+
 class QuorumEvent : public Event {
  public:
 	static uint64_t count;
@@ -53,18 +65,16 @@ class QuorumEvent : public Event {
   // fast vote result.
   vector<uint64_t> vec_timestamp_{};
   vector<int> sites_{};
-	unordered_set<std::string> ips_{};
-	unordered_set<std::string> changing_ips_{};
+	ReplicaGroup* group_{nullptr};
+	// one bit per replica of group_ that has not answered yet.
+	uint32_t pending_{0};
+	bool recording_{false};
 	//std::vector<rrr::Client> clients_{};
   dependencies_t deps{};
 	const long PRINT_INTERVAL_US = 5*1000*1000;
 	const int FINALIZE_THRESHOLD = 100000;
 	int begin_time;
-	static history_t history;
-	static times_t times;
-	static count_t counts;
-	static count_t counts_two;
-	static latency_t latencies;
+	static int count_two_ungrouped_;
 	enum TimeoutFlag {FLAG_FREE};
   std::string log_file = "logs.txt";
 
@@ -75,37 +85,28 @@ class QuorumEvent : public Event {
   QuorumEvent(int n_total,
               int quorum,
 							rrr::DepId dep_id = {"", 0},
-							std::unordered_set<std::string> ip_addrs = {}) : Event(),
-																															n_total_(n_total),
-																															quorum_(quorum){
+							ReplicaGroup* group = nullptr) : Event(),
+																							 n_total_(n_total),
+																							 quorum_(quorum),
+																							 group_(group) {
 		if (quorum_ != n_total_) {
 			needs_finalize_ = true;
 		}
-		finalize_event = std::make_shared<IntEvent>();
+		finalize_event = std::allocate_shared<IntEvent>(rrr::EventAllocator<IntEvent>());
 		finalize_event->__debug_creator = 1;
 
 		finalize_event->target_ = n_total_;
 
-		if (ip_addrs.size() != 0) {
-			auto it = QuorumEvent::counts_two.find(ip_addrs);
-			if (it == QuorumEvent::counts_two.end()) {
-				unordered_map<std::string, int> counts = {};
-			
-				for (std::string ip_addr : ip_addrs) {
-					counts.insert(std::make_pair(ip_addr, 0));
-				}
-				QuorumEvent::counts.insert(std::make_pair(ip_addrs, 0));
-			}
-			ips_ = ip_addrs;
-			changing_ips_ = ip_addrs;
+		if (group_ != nullptr) {
+			auto n = group_->ips_.size();
+			pending_ = n >= 32 ? ~0u : (1u << n) - 1;
 		}
-
   }
 
-	void recordHistory(unordered_set<std::string> ip_addrs);
-	void updateDataStructs(std::string ip_addrs);
-	void verifyTransient(std::string ip_addr);
-	void updateHistory(std::string ip_addr);
+	void recordHistory();
+	void updateDataStructs(int replica);
+	void verifyTransient();
+	void updateHistory(int replica);
 	long MemoryUtil();
 	void Finalize(int timeout, int flag);
   void set_sites(vector<int> sites){
@@ -182,23 +183,22 @@ class QuorumEvent : public Event {
     return n_voted_no_ > (n_total_ - quorum_);
   }
 
-  void VoteYes(std::string ip_addr = "") {
-		updateHistory(ip_addr);
+  // replica is the voter's index in group_, -1 if unknown.
+  void VoteYes(int replica = -1) {
+		updateHistory(replica);
     n_voted_yes_++;
     Test();
-		if (finalize_event->status_ != TIMEOUT && ip_addr != "") {
-			auto it = changing_ips_.find(ip_addr);
-			if (it != changing_ips_.end()) changing_ips_.erase(it);
+		if (finalize_event->status_ != TIMEOUT && replica >= 0) {
+			pending_ &= ~(1u << replica);
 			finalize_event->Set(n_voted_yes_ + n_voted_no_);
 		}
   }
 
-  void VoteNo(std::string ip_addr = "") {
+  void VoteNo(int replica = -1) {
     n_voted_no_++;
     Test();
-		if (finalize_event->status_ != TIMEOUT && ip_addr != "") {
-			auto it = changing_ips_.find(ip_addr);
-			if (it != changing_ips_.end()) changing_ips_.erase(it);
+		if (finalize_event->status_ != TIMEOUT && replica >= 0) {
+			pending_ &= ~(1u << replica);
 			finalize_event->Set(n_voted_yes_ + n_voted_no_);
 		}
   }
@@ -21,10 +21,6 @@ thread_local std::shared_ptr<Coroutine> Reactor::sp_running_coro_th_{};
 std::unordered_map<std::string, std::vector<std::shared_ptr<rrr::Pollable>>> Reactor::clients_{};
 std::unordered_set<std::string> Reactor::dangling_ips_{};
 std::vector<shared_ptr<Event>> Reactor::finalize_quorum_events_{};
-//std::vector<std::shared_ptr<Event>> Reactor::disk_events_{};
-//std::vector<std::shared_ptr<Event>> Reactor::ready_disk_events_{};
-SpinLock Reactor::disk_job_;
-SpinLock Reactor::trying_job_;
 
 std::shared_ptr<Coroutine> Coroutine::CurrentCoroutine() {
   // TODO re-enable this verify
@@ -61,6 +57,20 @@ Reactor::GetDiskReactor() {
   return sp_disk_reactor_th_;
 }
 
+void Reactor::Spawn(std::function<void()> func) {
+  run_queue_.Push(std::move(func));
+}
+
+size_t Reactor::RunQueued(size_t max) {
+  size_t n = 0;
+  std::function<void()> func;
+  while (n < max && run_queue_.Pop(func)) {
+    CreateRunCoroutine(func);
+    n++;
+  }
+  return n;
+}
+
 /**
  * @param func
  * @return
@@ -108,34 +118,39 @@ void Reactor::FreeDangling(std::string ip) {
 	}
 }
 void Reactor::CheckTimeout(std::vector<std::shared_ptr<Event>>& ready_events ) {
-  auto time_now = Time::now();
-  for (auto it = timeout_events_.begin(); it != timeout_events_.end();) {
-    Event& event = **it;
+  // one coarse clock read per turn, only expired buckets are touched.
+  TimerWheel::List expired{};
+  timeout_events_.Advance(Time::now(), expired);
+  while (Event* ev = expired.pop_front()) {
+    // alive at least until the end of this turn.
+    auto sp_event = TimerWheel::Cancel(ev);
+    Event& event = *ev;
     auto status = event.status_;
     switch (status) {
       case Event::INIT:
-        verify(0);
+        // armed by Event::AddParent() for a child that nobody waits on,
+        // testing it lets its parents know.
+        if (!event.Test() && !event.parents_.empty()) {
+          timeout_events_.Schedule(&event);
+        }
+        break;
       case Event::WAIT: {
-        const auto &wakeup_time = event.wakeup_time_;
-        verify(wakeup_time > 0);
-        if (time_now > wakeup_time) {
-          if (event.IsReady()) {
-            // This is because our event mechanism is not perfect, some events
-            // don't get triggered with arbitrary condition change.
-            event.status_ = Event::READY;
-          } else {
-            event.status_ = Event::TIMEOUT;
+        verify(event.wakeup_time_ > 0);
+        if (event.IsReady()) {
+          // This is because our event mechanism is not perfect, some events
+          // don't get triggered with arbitrary condition change.
+          if (!event.notified_) {
+            event.UpdateParents(true);
           }
-          ready_events.push_back(*it);
-          it = timeout_events_.erase(it);
+          event.status_ = Event::READY;
         } else {
-          it++;
+          event.status_ = Event::TIMEOUT;
         }
+        ready_events.push_back(sp_event);
         break;
       }
       case Event::READY:
       case Event::DONE:
-        it = timeout_events_.erase(it);
         break;
       default:
         verify(0);
@@ -151,20 +166,19 @@ void Reactor::Loop(bool infinite, bool check_timeout) {
 	int print = 0;
 
   do {
-    disk_job_.lock();
-    if (ready_disk_events_.empty()) {
-      disk_job_.unlock();
-    } else {
-      auto sp_event = ready_disk_events_.front();
-      auto& event = *sp_event;
-      ready_disk_events_.pop_front();
-      disk_job_.unlock();
-      auto sp_coro = event.wp_coro_.lock();
-      event.status_ = Event::READY;
-      if (event.status_ == Event::READY) {
-        event.status_ = Event::DONE;
+    if (disk_engine_.HasCompleted()) {
+      std::list<std::shared_ptr<DiskEvent>> disk_done{};
+      disk_engine_.PopCompleted(disk_done);
+      for (auto& sp_event : disk_done) {
+        auto& event = *sp_event;
+        event.handled = true;
+        if (event.status_ == Event::WAIT) {
+          event.status_ = Event::DONE;
+          auto sp_coro = event.wp_coro_.lock();
+          verify(sp_coro);
+          ContinueCoro(sp_coro);
+        }
       }
-      ContinueCoro(sp_coro);
     }
 
     std::vector<shared_ptr<Event>> ready_events = std::move(ready_events_);
@@ -205,7 +219,7 @@ void Reactor::Loop(bool infinite, bool check_timeout) {
 //        verify(event.status_ != Event::READY);
 //      }
 //    }
-  } while (looping_ || !ready_events_.empty() || !ready_disk_events_.empty());
+  } while (looping_ || !ready_events_.empty() || disk_engine_.HasCompleted());
   verify(ready_events_.empty());
 }
 
@@ -224,75 +238,7 @@ void Reactor::Recycle(std::shared_ptr<Coroutine>& sp_coro) {
 }
 
 void Reactor::DiskLoop(){
-  auto reactor = Reactor::GetDiskReactor();
-  reactor->disk_job_.lock();
-  auto disk_events = Reactor::GetReactor()->disk_events_;
-  auto it = Reactor::GetReactor()->disk_events_.begin();
-  std::vector<std::shared_ptr<DiskEvent>> pending_disk_events_{};
-  while(it != Reactor::GetReactor()->disk_events_.end()){
-    auto disk_event = std::static_pointer_cast<DiskEvent>(*it);
-    it = Reactor::GetReactor()->disk_events_.erase(it);
-    pending_disk_events_.push_back(disk_event);
-  }
-  Reactor::GetReactor()->disk_job_.unlock();
-	
-	int total_written = 0;
-	unordered_set<std::string> sync_set{};
-	for (int i = 0; i < pending_disk_events_.size(); i++) {
-		total_written += pending_disk_events_[i]->Handle();
-		if (pending_disk_events_[i]->sync) {
-			auto it = sync_set.find(pending_disk_events_[i]->file);
-			if (it == sync_set.end()) {
-				sync_set.insert(pending_disk_events_[i]->file);
-			}
-		}
-	}
-
-	/*struct timespec begin, end;
-	clock_gettime(CLOCK_MONOTONIC, &begin);*/
-	for (auto it = sync_set.begin(); it != sync_set.end(); it++) {
-		int fd = ::open(it->c_str(), O_WRONLY | O_APPEND | O_CREAT, 0777);
-		::fsync(fd);
-		::close(fd);
-		//Log_info("reaching here");
-	}
-	/*clock_gettime(CLOCK_MONOTONIC, &end);
-	if (total_written > 0) {
-		long disk_time = (end.tv_sec - begin.tv_sec)*1000000000 + end.tv_nsec - begin.tv_nsec;
-		//Log_info("time of fsync: %d", disk_time);
-		//Log_info("total written: %d", total_written);
-
-		long total_time = 0;
-		long avg_time = 0;
-		if (disk_count >= 100) {
-			if (disk_index < 50) {
-				disk_times[disk_index] = disk_time;
-				disk_index++;
-			} else {
-				for (int i = 0; i < 49; i++) {
-					disk_times[i] = disk_times[i+1];
-					total_time += disk_times[i];
-				}
-				disk_times[49] = disk_time;
-				total_time += disk_times[49];
-				avg_time = total_time/disk_index;
-				Log_info("time of fsync: %d", avg_time);
-			}
-			disk_count = 0;
-		} else {
-			disk_count++;
-		}
-
-		if (avg_time > 7500000) {
-			Reactor::GetReactor()->slow_ = true;
-		}
-	}*/
-
-	for(int i = 0; i < pending_disk_events_.size(); i++){
-		Reactor::GetReactor()->disk_job_.lock();
-    Reactor::GetReactor()->ready_disk_events_.push_back(pending_disk_events_[i]);
-		Reactor::GetReactor()->disk_job_.unlock();
-	}
+  disk_engine_.RunOnce();
 }
 
 void Reactor::ContinueCoro(std::shared_ptr<Coroutine> sp_coro) {
@@ -311,10 +257,7 @@ void Reactor::ContinueCoro(std::shared_ptr<Coroutine> sp_coro) {
 	struct timespec begin, end;
 	clock_gettime(CLOCK_MONOTONIC, &begin);
 
-	trying_job_.lock();
 	trying_count++;
-	int trying = trying_count;
-	trying_job_.unlock();
 
 	if (sp_coro->status_ == Coroutine::INIT) {
     sp_coro->Run();
@@ -323,9 +266,7 @@ void Reactor::ContinueCoro(std::shared_ptr<Coroutine> sp_coro) {
     sp_coro->Continue();
   }
 
-	trying_job_.lock();
 	trying_count--;
-	trying_job_.unlock();
 	
 	clock_gettime(CLOCK_MONOTONIC, &end);
 	long time = (end.tv_sec - begin.tv_sec)*1000000000 + end.tv_nsec - begin.tv_nsec;
@@ -368,7 +309,8 @@ class PollMgr::PollThread {
   std::unordered_set<shared_ptr<Pollable>> pending_remove_{};
   SpinLock pending_remove_l_;
   SpinLock lock_job_;
-  static SpinLock disk_job_;
+
+  PollMgr* poll_mgr_{nullptr};
 
   pthread_t th_;
   pthread_t disk_th_;
@@ -388,6 +330,7 @@ class PollMgr::PollThread {
     struct thread_params* args2 = new struct thread_params;
     args2->thread = thiz;
     args2->reactor_th = Reactor::GetReactor();
+    thiz->poll_mgr_->RegisterPeer(Reactor::GetReactor());
 
 //    pthread_t disk_th;
 //    pthread_t finalize_th;
@@ -397,6 +340,7 @@ class PollMgr::PollThread {
     
 		Log_info("starting poll thread");
     thiz->poll_loop();
+    thiz->poll_mgr_->UnregisterPeer(Reactor::GetReactor());
 //    delete args;
 //		delete args;
     pthread_exit(nullptr);
@@ -427,9 +371,9 @@ class PollMgr::PollThread {
     PollThread* thiz =  args->thread;
     Reactor::sp_reactor_th_ = args->reactor_th;
     
+    // blocks in the engine while idle, so no spinning here.
     while(!thiz->stop_flag_){
-      Reactor::GetDiskReactor()->DiskLoop();
-      sleep(0);
+      Reactor::GetReactor()->DiskLoop();
     }
     pthread_exit(nullptr);
     return nullptr;
@@ -438,9 +382,30 @@ class PollMgr::PollThread {
   void poll_loop();
 
   void start(PollMgr* poll_mgr) {
+    poll_mgr_ = poll_mgr;
     Pthread_create(&th_, nullptr, PollMgr::PollThread::start_poll_loop, this);
   }
 
+  // runs this reactor's queued work, or steals from a busy sibling if there
+  // is none. Returns the number of coroutines started.
+  size_t RunOrSteal() {
+    auto reactor = Reactor::GetReactor();
+    size_t n = reactor->RunQueued();
+    if (n > 0 || poll_mgr_ == nullptr) {
+      return n;
+    }
+    if (poll_mgr_->n_threads_ < 2) {
+      return 0;
+    }
+    std::deque<std::function<void()>> stolen{};
+    poll_mgr_->StealFromPeers(reactor.get(), stolen);
+    reactor->n_stolen_ += stolen.size();
+    for (auto& func : stolen) {
+      reactor->CreateRunCoroutine(func);
+    }
+    return stolen.size();
+  }
+
   void TriggerJob() {
     lock_job_.lock();
     auto it = set_sp_jobs_.begin();
@@ -503,9 +468,41 @@ PollMgr::PollMgr(int n_threads /* =... */)
 PollMgr::~PollMgr() {
   delete[] poll_threads_;
   poll_threads_ = nullptr;
+  verify(peers_.empty());
   //Log_debug("rrr::PollMgr: destroyed");
 }
 
+void PollMgr::RegisterPeer(std::shared_ptr<Reactor> reactor) {
+  peers_l_.lock();
+  peers_.push_back(reactor);
+  peers_l_.unlock();
+}
+
+void PollMgr::UnregisterPeer(const std::shared_ptr<Reactor>& reactor) {
+  peers_l_.lock();
+  auto it = std::find(peers_.begin(), peers_.end(), reactor);
+  verify(it != peers_.end());
+  peers_.erase(it);
+  peers_l_.unlock();
+}
+
+void PollMgr::StealFromPeers(Reactor* thief,
+                             std::deque<std::function<void()>>& stolen) {
+  peers_l_.lock();
+  size_t n = peers_.size();
+  // start after the thief so that thieves do not all pick the same victim.
+  size_t self = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (peers_[i].get() == thief) {
+      self = i;
+    }
+  }
+  for (size_t i = 1; i < n && stolen.empty(); i++) {
+    peers_[(self + i) % n]->run_queue_.Steal(stolen);
+  }
+  peers_l_.unlock();
+}
+
 void PollMgr::PollThread::poll_loop() {
 	std::vector<struct timespec> begins;
 	long total_cpu;
@@ -525,6 +522,7 @@ void PollMgr::PollThread::poll_loop() {
 	struct timespec first_begin, first_cpu;
 	while (!stop_flag_) {
     TriggerJob();
+    RunOrSteal();
     Reactor::GetReactor()->Loop(false, true);
 		//if (num_events > 0) Log_info("number of events: %d", num_events);
 		if (!begins.empty() && num_events >= 5) {
@@ -1,14 +1,19 @@
 #pragma once
 #include <set>
+#include <unordered_set>
 #include <algorithm>
 #include <unordered_map>
 #include <list>
 #include <thread>
 #include "base/misc.hpp"
 #include "event.h"
+#include "event_pool.h"
 #include "quorum_event.h"
 #include "coroutine.h"
 #include "epoll_wrapper.h"
+#include "disk_engine.h"
+#include "timer_wheel.h"
+#include "run_queue.h"
 
 namespace rrr {
 
@@ -38,15 +43,12 @@ class Reactor {
    * A reactor needs to keep reference to all coroutines created,
    * in case it is freed by the caller after a yield.
    */
-  std::list<std::shared_ptr<Event>> all_events_{};
-  std::list<std::shared_ptr<Event>> waiting_events_{};
   std::vector<std::shared_ptr<Event>> ready_events_{};
-  std::list<std::shared_ptr<Event>> timeout_events_{};
-  std::vector<std::shared_ptr<Event>> disk_events_{};
-  std::list<std::shared_ptr<Event>> ready_disk_events_{};
+  // waiting events with a deadline; the wheel does not hold references.
+  TimerWheel timeout_events_{};
   std::vector<std::shared_ptr<Event>> network_events_{};
   std::list<std::shared_ptr<Event>> ready_network_events_{};
-  std::set<std::shared_ptr<Coroutine>> coros_{};
+  std::unordered_set<std::shared_ptr<Coroutine>> coros_{};
   std::vector<std::shared_ptr<Coroutine>> available_coros_{};
   std::unordered_map<uint64_t, std::function<void(Event&)>> processors_{};
 	static std::unordered_map<std::string, std::vector<std::shared_ptr<rrr::Pollable>>> clients_;
@@ -54,10 +56,9 @@ class Reactor {
 	static std::vector<std::shared_ptr<Event>> finalize_quorum_events_;
   bool looping_{false};
 	bool slow_{false};
-	long disk_times[50];
-	int disk_count{0};
-	int disk_index{0};
 	int slow_count{0};
+	// coroutines currently being resumed on this reactor, only touched by
+	// its own thread.
 	int trying_count{0};
   std::thread::id thread_id_{};
   int64_t n_created_coroutines_{0};
@@ -65,8 +66,11 @@ class Reactor {
   int64_t n_active_coroutines_{0};
   int64_t n_active_coroutines_2_{0};
   int64_t n_idle_coroutines_{0};
-  static SpinLock disk_job_;
-	static SpinLock trying_job_;
+  // drained by the disk thread, completions are picked up in Loop().
+  DiskEngine disk_engine_{};
+  // spawned work that has not started yet; idle poll threads steal from it.
+  RunQueue run_queue_{};
+  int64_t n_stolen_{0};
 #ifdef REUSE_CORO
 #define REUSING_CORO (true)
 #else
@@ -77,6 +81,15 @@ class Reactor {
    * @param ev. is usually allocated on coroutine stack. memory managed by user.
    */
   std::shared_ptr<Coroutine> CreateRunCoroutine(std::function<void()> func);
+  static const size_t RUN_QUEUE_BATCH = 64;
+  /**
+   * Queues func to be started in a new coroutine on this reactor, unless an
+   * idle poll thread of the same PollMgr steals it first. Only for work
+   * that does not depend on which thread it runs on.
+   */
+  void Spawn(std::function<void()> func);
+  // starts at most max queued items here, returns how many were started.
+  size_t RunQueued(size_t max = RUN_QUEUE_BATCH);
   void Loop(bool infinite = false, bool check_timeout = false);
   void CheckTimeout(std::vector<std::shared_ptr<Event>>&);
 	void FreeDangling(std::string ip);
@@ -93,7 +106,7 @@ class Reactor {
   
   template <typename Ev, typename... Args>
   static shared_ptr<Ev> CreateSpEvent(Args&&... args) {
-    auto sp_ev = make_shared<Ev>(args...);
+    auto sp_ev = std::allocate_shared<Ev>(EventAllocator<Ev>(), args...);
     sp_ev->__debug_creator = 1;
     // TODO push them into a wait queue when they actually wait.
     //events.push_back(sp_ev);
@@ -115,6 +128,11 @@ class PollMgr: public rrr::RefCounted {
     PollThread* poll_threads_;
     const int n_threads_;
 
+ private:
+    // reactors of the running poll threads, work is only stolen from these.
+    SpinLock peers_l_;
+    std::vector<std::shared_ptr<Reactor>> peers_{};
+
 protected:
     // RefCounted object uses protected dtor to prevent accidental deletion
     ~PollMgr();
@@ -134,6 +152,14 @@ public:
     // Frequent Job
     void add(std::shared_ptr<Job> sp_job);
     void remove(std::shared_ptr<Job> sp_job);
+
+    // a poll thread's reactor is a peer from the start to the end of its
+    // loop, the registry keeps it alive while a thief steals from it.
+    void RegisterPeer(std::shared_ptr<Reactor> reactor);
+    void UnregisterPeer(const std::shared_ptr<Reactor>& reactor);
+    // moves queued work of some peer other than thief into stolen.
+    void StealFromPeers(Reactor* thief,
+                        std::deque<std::function<void()>>& stolen);
 };
 
 } // namespace rrr
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include "../base/all.hpp"
+
+namespace rrr {
+
+/**
+ * Queue of not-yet-started coroutine bodies owned by one reactor.
+ *
+ * The owning poll thread pops from the front; idle poll threads steal from
+ * the back, so the oldest work stays local and a thief takes what the owner
+ * would get to last. Nothing in here has started running, so an item can be
+ * started on whichever reactor takes it.
+ */
+class RunQueue {
+ public:
+  // most items a thief takes in one go.
+  static const size_t MAX_STEAL = 32;
+
+  void Push(std::function<void()> func) {
+    l_.lock();
+    q_.push_back(std::move(func));
+    size_++;
+    l_.unlock();
+  }
+
+  bool Pop(std::function<void()>& func) {
+    if (size_ == 0) {
+      return false;
+    }
+    l_.lock();
+    if (q_.empty()) {
+      l_.unlock();
+      return false;
+    }
+    func = std::move(q_.front());
+    q_.pop_front();
+    size_--;
+    l_.unlock();
+    return true;
+  }
+
+  // moves up to half of the queue, at most MAX_STEAL items, into out.
+  size_t Steal(std::deque<std::function<void()>>& out) {
+    if (size_ == 0) {
+      return 0;
+    }
+    l_.lock();
+    size_t n = (q_.size() + 1) / 2;
+    if (n > MAX_STEAL) {
+      n = MAX_STEAL;
+    }
+    for (size_t i = 0; i < n; i++) {
+      out.push_back(std::move(q_.back()));
+      q_.pop_back();
+    }
+    size_ -= n;
+    l_.unlock();
+    return n;
+  }
+
+  // lock-free hint, only exact under the lock.
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  SpinLock l_;
+  std::deque<std::function<void()>> q_{};
+  std::atomic<size_t> size_{0};
+};
+
+} // namespace rrr
@@ -0,0 +1,122 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include "../base/all.hpp"
+#include "stack_pool.h"
+
+namespace rrr {
+
+size_t StackPool::stack_size_ = StackPool::DEFAULT_STACK_SIZE;
+bool StackPool::guard_page_ = true;
+size_t StackPool::preallocate_ = 0;
+
+namespace {
+
+// set by the first mapping; after that the stack layout is fixed.
+std::atomic<bool> stacks_mapped_{false};
+
+struct FreeStacks {
+  std::vector<boost::context::stack_context> stacks_{};
+};
+
+// never destroyed, a stack may be released after its thread is gone.
+thread_local FreeStacks* free_stacks_th_ = nullptr;
+
+inline size_t PageSize() {
+  static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+} // namespace
+
+static size_t MappedSize(size_t stack_size, bool guard) {
+  return stack_size + (guard ? PageSize() : 0);
+}
+
+static boost::context::stack_context MapStack(size_t size, bool guard) {
+  stacks_mapped_ = true;
+  size_t total = MappedSize(size, guard);
+  void* p = ::mmap(nullptr, total, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  verify(p != MAP_FAILED);
+  if (guard) {
+    // stacks grow down, so the guard page sits at the lowest address.
+    verify(::mprotect(p, PageSize(), PROT_NONE) == 0);
+  }
+  boost::context::stack_context sctx;
+  sctx.size = size;
+  sctx.sp = static_cast<char*>(p) + total;
+  return sctx;
+}
+
+static void UnmapStack(boost::context::stack_context& sctx, bool guard) {
+  size_t total = MappedSize(sctx.size, guard);
+  ::munmap(static_cast<char*>(sctx.sp) - total, total);
+}
+
+static bool CanConfigure() {
+  if (stacks_mapped_) {
+    Log_info("coroutine stacks already in use, keeping the current layout");
+    return false;
+  }
+  return true;
+}
+
+void StackPool::SetStackSize(size_t size) {
+  if (CanConfigure()) {
+    // round up to whole pages.
+    stack_size_ = (size + PageSize() - 1) / PageSize() * PageSize();
+  }
+}
+
+void StackPool::SetGuardPage(bool guard) {
+  if (CanConfigure()) {
+    guard_page_ = guard;
+  }
+}
+
+void StackPool::SetPreallocate(size_t n) {
+  preallocate_ = n < MAX_FREE_STACKS ? n : MAX_FREE_STACKS;
+}
+
+size_t StackPool::StackSize() {
+  return stack_size_;
+}
+
+static FreeStacks& GetFreeStacks() {
+  if (free_stacks_th_ == nullptr) {
+    free_stacks_th_ = new FreeStacks();
+  }
+  return *free_stacks_th_;
+}
+
+boost::context::stack_context StackPool::Allocate() {
+  if (free_stacks_th_ == nullptr) {
+    auto& fs = GetFreeStacks();
+    for (size_t i = 0; i < preallocate_; i++) {
+      fs.stacks_.push_back(MapStack(stack_size_, guard_page_));
+    }
+  }
+  auto& stacks = GetFreeStacks().stacks_;
+  if (stacks.empty()) {
+    return MapStack(stack_size_, guard_page_);
+  }
+  auto sctx = stacks.back();
+  stacks.pop_back();
+  return sctx;
+}
+
+void StackPool::Deallocate(boost::context::stack_context& sctx) {
+  auto& stacks = GetFreeStacks().stacks_;
+  if (stacks.size() >= MAX_FREE_STACKS) {
+    UnmapStack(sctx, guard_page_);
+    return;
+  }
+  stacks.push_back(sctx);
+}
+
+size_t StackPool::NumFree() {
+  return GetFreeStacks().stacks_.size();
+}
+
+} // namespace rrr
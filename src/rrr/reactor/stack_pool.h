@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <boost/context/stack_context.hpp>
+
+namespace rrr {
+
+/**
+ * Per-thread pool of coroutine stacks.
+ *
+ * Stacks are mmap'd with a configurable size, optionally with a PROT_NONE
+ * guard page below them so that an overflow faults instead of silently
+ * corrupting a neighbour. Released stacks go onto a free list and are handed
+ * out again in O(1), so creating a coroutine on the RPC path does not touch
+ * the heap or the page tables. The settings are process wide and only take
+ * effect before the first stack is mapped.
+ */
+class StackPool {
+ public:
+  static const size_t DEFAULT_STACK_SIZE = 128 * 1024;
+  // free stacks kept per thread, the rest are unmapped.
+  static const size_t MAX_FREE_STACKS = 4096;
+
+  static void SetStackSize(size_t size);
+  static void SetGuardPage(bool guard);
+  // stacks mapped ahead of time when a thread first uses its pool.
+  static void SetPreallocate(size_t n);
+  static size_t StackSize();
+
+  static boost::context::stack_context Allocate();
+  static void Deallocate(boost::context::stack_context& sctx);
+
+  // free stacks in the calling thread's pool.
+  static size_t NumFree();
+
+ private:
+  static size_t stack_size_;
+  static bool guard_page_;
+  static size_t preallocate_;
+};
+
+/**
+ * StackAllocator handed to boost::coroutines2; it only forwards to the
+ * calling thread's StackPool.
+ */
+class PooledStack {
+ public:
+  boost::context::stack_context allocate() {
+    return StackPool::Allocate();
+  }
+
+  void deallocate(boost::context::stack_context& sctx) {
+    StackPool::Deallocate(sctx);
+  }
+};
+
+} // namespace rrr
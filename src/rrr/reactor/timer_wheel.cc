@@ -0,0 +1,93 @@
+#include "../base/all.hpp"
+#include "timer_wheel.h"
+
+namespace rrr {
+
+static const uint64_t SLOT_MASK = TimerWheel::SLOTS - 1;
+// deltas beyond the top level are parked there and re-hashed when it turns.
+static const uint64_t MAX_DELTA =
+    (1ULL << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+
+TimerWheel::TimerWheel() : cur_tick_(Time::now() / TICK_US) {
+}
+
+TimerWheel::~TimerWheel() {
+  for (int l = 0; l < LEVELS; l++) {
+    for (int s = 0; s < SLOTS; s++) {
+      while (Event* ev = buckets_[l][s].front()) {
+        Cancel(ev);
+      }
+    }
+  }
+}
+
+std::shared_ptr<Event> TimerWheel::Cancel(Event* ev) {
+  ev->timeout_hook_.Unlink();
+  return std::move(ev->sp_wheel_ref_);
+}
+
+void TimerWheel::Schedule(Event* ev) {
+  if (!ev->sp_wheel_ref_) {
+    ev->sp_wheel_ref_ = ev->shared_from_this();
+  }
+  uint64_t tick = (ev->wakeup_time_ + TICK_US - 1) / TICK_US;
+  if (tick < cur_tick_) {
+    // already due, expire it on the next tick processed.
+    tick = cur_tick_;
+  }
+  uint64_t delta = tick - cur_tick_;
+  if (delta > MAX_DELTA) {
+    delta = MAX_DELTA;
+    tick = cur_tick_ + delta;
+  }
+  int level = 0;
+  while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+    level++;
+  }
+  auto slot = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+  buckets_[level][slot].push_back(ev);
+}
+
+void TimerWheel::Cascade(int level) {
+  if (level >= LEVELS) {
+    return;
+  }
+  auto slot = (cur_tick_ >> (SLOT_BITS * level)) & SLOT_MASK;
+  if (slot == 0) {
+    Cascade(level + 1);
+  }
+  List pending{};
+  pending.splice(buckets_[level][slot]);
+  while (Event* ev = pending.pop_front()) {
+    Schedule(ev);
+  }
+}
+
+void TimerWheel::Advance(uint64_t now_us, List& expired) {
+  uint64_t now_tick = now_us / TICK_US;
+  if (now_tick < cur_tick_) {
+    return;
+  }
+  if (now_tick - cur_tick_ > (uint64_t) SLOTS * SLOTS) {
+    // after a long stall, re-hashing everything beats walking every tick.
+    List pending{};
+    for (int l = 0; l < LEVELS; l++) {
+      for (int s = 0; s < SLOTS; s++) {
+        pending.splice(buckets_[l][s]);
+      }
+    }
+    cur_tick_ = now_tick;
+    while (Event* ev = pending.pop_front()) {
+      Schedule(ev);
+    }
+  }
+  while (cur_tick_ <= now_tick) {
+    if ((cur_tick_ & SLOT_MASK) == 0) {
+      Cascade(1);
+    }
+    expired.splice(buckets_[0][cur_tick_ & SLOT_MASK]);
+    cur_tick_++;
+  }
+}
+
+} // namespace rrr
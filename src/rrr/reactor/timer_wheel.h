@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include "intrusive_list.h"
+#include "event.h"
+
+namespace rrr {
+
+/**
+ * Hierarchical timing wheel for events waiting with a deadline.
+ *
+ * Deadlines are rounded up to TICK_US and hashed into LEVELS wheels of SLOTS
+ * buckets each; level l covers deltas below SLOTS^(l+1) ticks. Scheduling is
+ * O(1), and cancelling is just unlinking the event's timeout_hook_. The wheel
+ * holds a strong reference to every event it links until the event expires
+ * or is cancelled, so an event released by another thread cannot go away
+ * under Advance(). Advance() only touches the buckets of the ticks that
+ * passed, re-hashing a bucket of a higher level into the lower levels when
+ * its turn comes.
+ */
+class TimerWheel {
+ public:
+  typedef IntrusiveList<Event, &Event::timeout_hook_> List;
+
+  static const uint64_t TICK_US = 1000;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+  static const int LEVELS = 4;
+
+  TimerWheel();
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+  ~TimerWheel();
+
+  // schedules ev, which must be owned by a shared_ptr, to expire at
+  // ev->wakeup_time_ (microseconds).
+  void Schedule(Event* ev);
+  // moves every event whose deadline is not after now_us to expired; they
+  // keep the wheel's reference until passed to Cancel().
+  void Advance(uint64_t now_us, List& expired);
+  // takes ev off the wheel, or off the expired list, and hands back the
+  // wheel's reference so that the caller decides where ev may be destroyed.
+  static std::shared_ptr<Event> Cancel(Event* ev);
+
+ private:
+  uint64_t cur_tick_{0};
+  List buckets_[LEVELS][SLOTS];
+
+  void Cascade(int level);
+};
+
+} // namespace rrr
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <functional>
+
+#include "base/all.hpp"
+
+namespace rrr {
+
+struct BatchStats {
+    // packets completed by end_request()/end_reply()
+    uint64_t n_packets = 0;
+    // times the poll thread was asked to send
+    uint64_t n_flushes = 0;
+};
+
+/**
+ * Decides when the packets queued in a connection's out buffer are handed to
+ * the poll thread. With batching off every packet is flushed right away. With
+ * batching on, packets are held until max_bytes are pending or the oldest one
+ * has waited max_delay_us (checked by a BatchFlushJob), whichever is first.
+ *
+ * Not thread safe, the owner guards it with its out_l_.
+ */
+class OutputBatcher {
+    size_t max_bytes_ = 0;
+    uint64_t max_delay_us_ = 0;
+    uint64_t tm_first_ = 0;
+    size_t n_pending_ = 0;
+    BatchStats stats_;
+
+public:
+    // max_bytes == 0 turns batching off.
+    void set(size_t max_bytes, uint64_t max_delay_us) {
+        max_bytes_ = max_bytes;
+        max_delay_us_ = max_delay_us;
+    }
+
+    bool enabled() const {
+        return max_bytes_ > 0;
+    }
+
+    // a packet was queued, out_size bytes are pending now. Returns true if
+    // the caller should enable write events.
+    bool add(size_t out_size) {
+        stats_.n_packets++;
+        n_pending_++;
+        if (!enabled() || out_size >= max_bytes_) {
+            return flush();
+        }
+        if (n_pending_ == 1) {
+            tm_first_ = Time::now();
+        }
+        return false;
+    }
+
+    bool due() const {
+        return n_pending_ > 0 && Time::now() - tm_first_ >= max_delay_us_;
+    }
+
+    // returns true if anything was held back.
+    bool flush() {
+        if (n_pending_ == 0) {
+            return false;
+        }
+        n_pending_ = 0;
+        stats_.n_flushes++;
+        return true;
+    }
+
+    // the out buffer was drained by the poll thread.
+    void drained() {
+        n_pending_ = 0;
+    }
+
+    const BatchStats& stats() const {
+        return stats_;
+    }
+};
+
+/**
+ * Polled by the PollMgr on every loop, flushes batches whose delay is up.
+ */
+class BatchFlushJob : public Job {
+    std::function<bool()> due_;
+    std::function<void()> flush_;
+
+public:
+    bool done_ = false;
+
+    BatchFlushJob(const std::function<bool()>& due,
+                  const std::function<void()>& flush)
+        : due_(due), flush_(flush) { }
+
+    bool Ready() override {
+        return !done_ && due_();
+    }
+
+    void Work() override {
+        flush_();
+    }
+
+    bool Done() override {
+        return done_;
+    }
+};
+
+} // namespace rrr
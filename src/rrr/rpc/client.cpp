@@ -87,12 +87,21 @@ void Client::set_valid(bool valid) {
 	out_.valid_id = valid;
 }
 
+void Client::collect_new_futures() {
+  Future* fu = nullptr;
+  while (new_fu_q_.Pop(fu)) {
+    pending_fu_[fu->xid_] = fu;
+  }
+}
+
 void Client::invalidate_pending_futures() {
 	list<Future*> futures;
   pending_fu_l_.lock();
+  collect_new_futures();
   for (auto& it: pending_fu_) {
     futures.push_back(it.second);
   }
+  n_pending_fu_ -= pending_fu_.size();
   pending_fu_.clear();
   pending_fu_l_.unlock();
 
@@ -114,6 +123,9 @@ void Client::close() {
     ::close(sock_);
   }
   status_ = CLOSED;
+  if (sp_flush_job_) {
+    sp_flush_job_->done_ = true;
+  }
   invalidate_pending_futures();
 }
 
@@ -219,6 +231,9 @@ void Client::handle_free() {
     }
   }*/
 
+	pending_fu_l_.lock();
+	collect_new_futures();
+	pending_fu_l_.unlock();
 	if (pending_fu_.size() == 0) return;
 
 	list<Future*> futures;
@@ -238,6 +253,7 @@ void Client::handle_free() {
 			if (j == size) break;
 			futures.push_back(it->second);
 			it = pending_fu_.erase(it);
+			n_pending_fu_--;
 			j++;
 		}
 
@@ -287,6 +303,7 @@ void Client::handle_write() {
 	out_.write_to_fd(sock_);
 
   if (out_.empty()) {
+    batcher_.drained();
     pollmgr_->update_mode(shared_from_this(), Pollable::READ);
   }
   out_l_.unlock();
@@ -359,6 +376,11 @@ iters = 20;
       pending_fu_l_.lock();
       unordered_map<i64, Future*>::iterator
         it = pending_fu_.find(v_reply_xid.get());
+      if (it == pending_fu_.end()) {
+        // the request may still sit in the handoff queue.
+        collect_new_futures();
+        it = pending_fu_.find(v_reply_xid.get());
+      }
       if(it != pending_fu_.end()){
         Future* fu = it->second;
         verify(fu->xid_ == v_reply_xid.get());
@@ -393,6 +415,7 @@ iters = 20;
 
         pending_fu_.erase(it);
         pending_fu_l_.unlock();
+        n_pending_fu_--;
 
 				fu->error_code_ = v_error_code.get();
         fu->reply_.read_from_marshal(in_,
@@ -482,6 +505,54 @@ iters = 20;
   //Log_info("Duration of handle_read() is: %d", duration);
 }*/
 
+void Client::set_batching(size_t max_bytes, uint64_t max_delay_us) {
+  out_l_.lock();
+  batcher_.set(max_bytes, max_delay_us);
+  out_l_.unlock();
+  if (!batcher_.enabled()) {
+    flush();
+    return;
+  }
+  if (sp_flush_job_ == nullptr && status_ == CONNECTED) {
+    std::weak_ptr<Client> wp_client =
+        std::dynamic_pointer_cast<Client>(shared_from_this());
+    sp_flush_job_ = std::make_shared<BatchFlushJob>(
+        [wp_client] () {
+          auto sp_client = wp_client.lock();
+          return sp_client && sp_client->batch_due();
+        },
+        [wp_client] () {
+          auto sp_client = wp_client.lock();
+          if (sp_client) {
+            sp_client->flush();
+          }
+        });
+    pollmgr_->add(sp_flush_job_);
+  }
+}
+
+void Client::flush() {
+  out_l_.lock();
+  if (batcher_.flush() && status_ == CONNECTED) {
+    pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+  }
+  out_l_.unlock();
+}
+
+bool Client::batch_due() {
+  out_l_.lock();
+  bool due = batcher_.due();
+  out_l_.unlock();
+  return due;
+}
+
+BatchStats Client::batch_stats() {
+  out_l_.lock();
+  BatchStats stats = batcher_.stats();
+  out_l_.unlock();
+  return stats;
+}
+
 int Client::poll_mode() {
   int mode = Pollable::READ;
   out_l_.lock();
@@ -502,20 +573,27 @@ Future* Client::begin_request(i32 rpc_id, const FutureAttr& attr /* =... */) {
     return nullptr;
   }
 
+  if ((max_pending_ > 0 && n_pending_fu_ >= (int64_t) max_pending_) ||
+      (max_out_bytes_ > 0 && out_.content_size() >= max_out_bytes_)) {
+    // the peer is behind, fail fast instead of queueing more for it.
+    n_shed_++;
+    return nullptr;
+  }
+
   Future* fu = new Future(xid_counter_.next(), attr);
-  pending_fu_l_.lock();
-  pending_fu_[fu->xid_] = fu;
-  pending_fu_l_.unlock();
+  // the ref is owned by pending_fu_ once the reader picks it up.
+  new_fu_q_.Push(fu);
+  int64_t n_pending = ++n_pending_fu_;
 
-	if (!client_ && pending_fu_.size() > 0 && host() == "10.0.0.14") {
+	if (!client_ && n_pending > 0 && host() == "10.0.0.14") {
 		if (first_print) {
 			first_print = false;
 			pending_begin_time = Time::now();
-			Log_info("pending size is %d for %s", pending_fu_.size(), host().c_str());
+			Log_info("pending size is %d for %s", n_pending, host().c_str());
 		} else {
 			int elapsed_time_us = Time::now() - pending_begin_time;
 			if (elapsed_time_us >= 1*1000*1000) {
-				Log_info("pending size is %d for %s", pending_fu_.size(), host().c_str());
+				Log_info("pending size is %d for %s", n_pending, host().c_str());
 				/*Log_info("out content size is: %d", out_.content_size());
 				Log_info("out count is: %d", out_count);
 				Log_info("write count is: %d", write_count);
@@ -524,23 +602,26 @@ Future* Client::begin_request(i32 rpc_id, const FutureAttr& attr /* =... */) {
 			}
 		}
 	}
-	
-	struct timespec begin;
-	clock_gettime(CLOCK_MONOTONIC, &begin);
-	//rpc_starts[fu->xid_] = begin;
 
   // check if the client gets closed in the meantime
   if (status_ != CONNECTED) {
-    pending_fu_l_.lock(5000);
-    unordered_map<i64, Future*>::iterator it = pending_fu_.find(fu->xid_);
-    if (it != pending_fu_.end()) {
-      it->second->release();
+    pending_fu_l_.lock();
+    collect_new_futures();
+    auto it = pending_fu_.find(fu->xid_);
+    bool taken_back = (it != pending_fu_.end());
+    if (taken_back) {
       pending_fu_.erase(it);
+      n_pending_fu_--;
     }
     pending_fu_l_.unlock();
-
-    //Log_info("NOT CONNECTED 2");
-    return nullptr;
+    if (taken_back) {
+      // never sent, so it must never complete either.
+      fu->release();
+      //Log_info("NOT CONNECTED 2");
+      return nullptr;
+    }
+    // close() already completed it with ENOTCONN, hand it out like a sent
+    // request so that its callback is the only failure the caller sees.
   }
 
   bmark_ = out_.set_bookmark(sizeof(i32)); // will fill packet size later
@@ -559,6 +640,8 @@ Future* Client::begin_request(i32 rpc_id, const FutureAttr& attr /* =... */) {
 
 void Client::end_request() {
   //auto start = chrono::steady_clock::now();
+  // nothing was written if begin_request() gave no future
+  bool written = (bmark_ != nullptr);
   // set reply size in packet
   if (bmark_ != nullptr) {
     i32 request_size = out_.get_and_reset_write_cnt();
@@ -590,9 +673,11 @@ void Client::end_request() {
 	out_.found_dep = false;
 	out_.valid_id = false;
 
-  // always enable write events since the code above gauranteed there
-  // will be some data to send
-  pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+  // enable write events since the code above gauranteed there will be some
+  // data to send, unless the batcher holds it back for a while
+  if (written && batcher_.add(out_.content_size())) {
+    pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+  }
 
   out_l_.unlock();
 			
@@ -602,6 +687,20 @@ void Client::end_request() {
   //Log_info("The Time for end_request is: %d");
 }
 
+void Client::set_flow_control(size_t max_pending, size_t max_out_bytes) {
+  out_l_.lock();
+  max_pending_ = max_pending;
+  max_out_bytes_ = max_out_bytes;
+  out_l_.unlock();
+}
+
+uint64_t Client::n_shed() {
+  out_l_.lock();
+  auto n = n_shed_;
+  out_l_.unlock();
+  return n;
+}
+
 ClientPool::ClientPool(PollMgr* pollmgr /* =? */,
                        int parallel_connections /* =? */)
     : parallel_connections_(parallel_connections) {
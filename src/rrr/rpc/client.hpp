@@ -2,10 +2,13 @@
 
 #include <unordered_map>
 #include <chrono>
+#include <atomic>
 
 #include "misc/marshal.hpp"
 #include "reactor/epoll_wrapper.h"
 #include "reactor/reactor.h"
+#include "reactor/mpsc_queue.h"
+#include "batching.hpp"
 
 namespace rrr {
 
@@ -135,18 +138,34 @@ public:
     Marshal::bookmark* bmark_;
 
     Counter xid_counter_;
+    // new requests are handed to the reader through new_fu_q_ without
+    // locking; pending_fu_ itself is only touched by the reading side, which
+    // holds pending_fu_l_ (uncontended except on close/free).
+    MpscQueue<Future*> new_fu_q_;
     std::unordered_map<i64, Future*> pending_fu_;
-		std::unordered_map<i64, struct timespec> rpc_starts;
+    std::atomic<int64_t> n_pending_fu_{0};
 
     SpinLock pending_fu_l_;
-		SpinLock read_l_;
     SpinLock out_l_;
 
+    // guarded by out_l_
+    OutputBatcher batcher_;
+    std::shared_ptr<BatchFlushJob> sp_flush_job_;
+
+    // flow control budgets, 0 means unlimited. guarded by out_l_
+    size_t max_pending_ = 0;
+    size_t max_out_bytes_ = 0;
+    uint64_t n_shed_ = 0;
+
     // reentrant, could be called multiple times before releasing
     void close();
 
     void invalidate_pending_futures();
 
+    // moves futures queued by begin_request() into pending_fu_, the caller
+    // holds pending_fu_l_.
+    void collect_new_futures();
+
 
 public:
 	 bool client_;
@@ -196,6 +215,33 @@ public:
     }
 
 		void set_valid(bool valid);
+
+    /**
+     * Coalesce requests: hold them in out_ until max_bytes are pending or the
+     * oldest one has waited max_delay_us, then send them together. Pass
+     * max_bytes = 0 to turn it off again. Call after connect().
+     */
+    void set_batching(size_t max_bytes, uint64_t max_delay_us);
+
+    // send whatever is held back by batching now.
+    void flush();
+
+    /**
+     * Bound what this connection holds for a peer that does not keep up: at
+     * most max_pending requests waiting for replies and max_out_bytes not yet
+     * written to the socket. A request past either budget is shed right away,
+     * begin_request() returns nullptr as it does for a closed connection.
+     * 0 means unlimited.
+     */
+    void set_flow_control(size_t max_pending, size_t max_out_bytes);
+
+    // requests shed so far.
+    uint64_t n_shed();
+
+    bool batch_due();
+
+    BatchStats batch_stats();
+
     int connect(const char* addr, bool client = true);
 
     void close_and_release() {
@@ -90,13 +90,46 @@ ServerConnection::ServerConnection(Server* server, int socket)
         : server_(server), socket_(socket), bmark_(nullptr), status_(CONNECTED) {
     // increase number of open connections
     server_->sconns_ctr_.next(1);
+    batcher_.set(server_->batch_bytes_, server_->batch_delay_us_);
 }
 
 ServerConnection::~ServerConnection() {
+    for (auto req : req_pool_) {
+        delete req;
+    }
     // decrease number of open connections
     server_->sconns_ctr_.next(-1);
 }
 
+Request* ServerConnection::get_request() {
+    Request* req = nullptr;
+    req_pool_l_.lock();
+    if (!req_pool_.empty()) {
+        req = req_pool_.back();
+        req_pool_.pop_back();
+    }
+    req_pool_l_.unlock();
+    if (req == nullptr) {
+        req = new Request;
+    }
+    return req;
+}
+
+void ServerConnection::put_request(Request* req) {
+    // a request left with unread arguments still holds on to chunks.
+    if (!req->m.empty()) {
+        delete req;
+        return;
+    }
+    req_pool_l_.lock();
+    if (req_pool_.size() < REQ_POOL_SIZE) {
+        req_pool_.push_back(req);
+        req = nullptr;
+    }
+    req_pool_l_.unlock();
+    delete req;
+}
+
 int ServerConnection::run_async(const std::function<void()>& f) {
 //  verify(0);
 //  return 0;
@@ -129,13 +162,46 @@ void ServerConnection::end_reply() {
         bmark_ = nullptr;
     }
 
-    // always enable write events since the code above gauranteed there
-    // will be some data to send
-    server_->pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+    // enable write events since the code above gauranteed there will be
+    // some data to send, unless the batcher holds it back for a while
+    if (batcher_.add(out_.content_size())) {
+        server_->pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+    }
 
     out_l_.unlock();
 }
 
+void ServerConnection::flush() {
+    out_l_.lock();
+    if (batcher_.flush() && status_ == CONNECTED) {
+        server_->pollmgr_->update_mode(shared_from_this(), Pollable::READ | Pollable::WRITE);
+    }
+    out_l_.unlock();
+}
+
+void ServerConnection::set_batching(size_t max_bytes, uint64_t max_delay_us) {
+    out_l_.lock();
+    batcher_.set(max_bytes, max_delay_us);
+    out_l_.unlock();
+    if (max_bytes == 0) {
+        flush();
+    }
+}
+
+bool ServerConnection::batch_due() {
+    out_l_.lock();
+    bool due = batcher_.due();
+    out_l_.unlock();
+    return due;
+}
+
+BatchStats ServerConnection::batch_stats() {
+    out_l_.lock();
+    BatchStats stats = batcher_.stats();
+    out_l_.unlock();
+    return stats;
+}
+
 
 //compute the latency of every rpc to each connection and send it to the application
 //application can then compare the rpc with expected latency
@@ -167,7 +233,7 @@ bool ServerConnection::handle_read() {
             // consume the packet size
             verify(in_.read(&packet_size, sizeof(i32)) == sizeof(i32));
 
-            Request* req = new Request;
+            Request* req = get_request();
             verify(req->m.read_from_marshal(in_, packet_size) == (size_t) packet_size);
 
             v64 v_xid;
@@ -191,7 +257,7 @@ bool ServerConnection::handle_read() {
             // rpc id not provided
             begin_reply(req, EINVAL);
             end_reply();
-            delete req;
+            put_request(req);
             continue;
         }
 
@@ -204,12 +270,16 @@ bool ServerConnection::handle_read() {
 
         auto it = server_->handlers_.find(rpc_id);
 	//Log_info("RPC ID is: %d", rpc_id);
-        if (it != server_->handlers_.end()) {
-            // the handler should delete req, and release server_connection refcopy.
+        if (it != server_->handlers_.end() &&
+            server_->fast_handlers_.count(rpc_id) > 0) {
+            // does not yield, no coroutine needed.
+            it->second(req, this);
+        } else if (it != server_->handlers_.end()) {
+            // the handler should put back req, and release server_connection refcopy.
             auto x = dynamic_pointer_cast<ServerConnection>(shared_from_this());
             auto y = it->second;
 						//Log_info("CreateRunning: %x", rpc_id);
-            Coroutine::CreateRun([y, req, x, this, rpc_id] () {
+            std::function<void()> run_handler = [y, req, x, this, rpc_id] () {
 //              verify(x);
               verify(x->connected());
 
@@ -243,7 +313,14 @@ bool ServerConnection::handle_read() {
                 //ev->Wait(1); // timeout after 100 ms
 //#endif
 //              f(r, c);
-            });
+            };
+            if (server_->work_stealing_ &&
+                server_->thread_safe_handlers_.count(rpc_id) > 0) {
+              // may be started by another poll thread of the same PollMgr.
+              Reactor::GetReactor()->Spawn(run_handler);
+            } else {
+              Coroutine::CreateRun(run_handler);
+            }
         } else {
             rpc_id_missing_l_s.lock();
             bool surpress_warning = false;
@@ -258,7 +335,7 @@ bool ServerConnection::handle_read() {
             }
             begin_reply(req, ENOENT);
             end_reply();
-            delete req;
+            put_request(req);
         }
     }
   // This is a workaround, the Loop call should really happen
@@ -284,6 +361,7 @@ void ServerConnection::handle_write() {
     out_l_.lock();
     out_.write_to_fd(socket_);
     if (out_.empty()) {
+        batcher_.drained();
         server_->pollmgr_->update_mode(shared_from_this(), Pollable::READ);
     }
     out_l_.unlock();
@@ -355,6 +433,11 @@ Server::~Server() {
         verify(server_sock_ == -1 && status_ == STOPPED);
     }
 
+    if (sp_flush_job_) {
+        sp_flush_job_->done_ = true;
+        pollmgr_->remove(sp_flush_job_);
+    }
+
     sconns_l_.lock();
     vector<shared_ptr<ServerConnection>> sconns(sconns_.begin(), sconns_.end());
     // NOTE: do NOT clear sconns_ here, because when running the following
@@ -366,7 +449,9 @@ Server::~Server() {
         it->close();
     }
     sconns.clear();
-    sp_server_listener_->close();
+    for (auto& listener : listeners_) {
+        listener->close();
+    }
 
 
     // make sure all open connections are closed
@@ -391,6 +476,54 @@ Server::~Server() {
     //Log_debug("rrr::Server: destroyed");
 }
 
+void Server::set_batching(size_t max_bytes, uint64_t max_delay_us) {
+    sconns_l_.lock();
+    batch_bytes_ = max_bytes;
+    batch_delay_us_ = max_delay_us;
+    vector<shared_ptr<ServerConnection>> sconns(sconns_.begin(), sconns_.end());
+    sconns_l_.unlock();
+    for (auto& sconn : sconns) {
+        sconn->set_batching(max_bytes, max_delay_us);
+    }
+    if (max_bytes > 0 && sp_flush_job_ == nullptr) {
+        // a single job polls all connections of this server.
+        auto due_sconns = [this] () {
+            vector<shared_ptr<ServerConnection>> due;
+            sconns_l_.lock();
+            for (auto& sconn : sconns_) {
+                if (sconn->batch_due()) {
+                    due.push_back(sconn);
+                }
+            }
+            sconns_l_.unlock();
+            return due;
+        };
+        sp_flush_job_ = std::make_shared<BatchFlushJob>(
+            [due_sconns] () {
+                return !due_sconns().empty();
+            },
+            [due_sconns] () {
+                for (auto& sconn : due_sconns()) {
+                    sconn->flush();
+                }
+            });
+        pollmgr_->add(sp_flush_job_);
+    }
+}
+
+BatchStats Server::batch_stats() {
+    BatchStats total;
+    sconns_l_.lock();
+    vector<shared_ptr<ServerConnection>> sconns(sconns_.begin(), sconns_.end());
+    sconns_l_.unlock();
+    for (auto& sconn : sconns) {
+        auto stats = sconn->batch_stats();
+        total.n_packets += stats.n_packets;
+        total.n_flushes += stats.n_flushes;
+    }
+    return total;
+}
+
 struct start_server_loop_args_type {
     Server* server;
     struct addrinfo* gai_result;
@@ -471,6 +604,7 @@ bool ServerListener::handle_read() {
 #endif
     if (clnt_socket >= 0) {
       Log_debug("server@%s got new client, fd=%d", this->addr_.c_str(), clnt_socket);
+      n_accepted_++;
       verify(set_nonblocking(clnt_socket, true) == 0);
 
       auto sconn = std::make_shared<ServerConnection>(server_, clnt_socket);
@@ -489,7 +623,7 @@ void ServerListener::close() {
   ::close(server_sock_);
 }
 
-ServerListener::ServerListener(Server* server, string addr) {
+ServerListener::ServerListener(Server* server, string addr, bool reuse_port) {
   server_ = server;
   addr_ = addr;
   size_t idx = addr.find(":");
@@ -536,6 +670,9 @@ ServerListener::ServerListener(Server* server, string addr) {
     const int yes = 1;
     verify(setsockopt(server_sock_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == 0);
     verify(setsockopt(server_sock_, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) == 0);
+    if (reuse_port) {
+      verify(setsockopt(server_sock_, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == 0);
+    }
 
     if (::bind(server_sock_, rp->ai_addr, rp->ai_addrlen) == 0) {
       break;
@@ -569,8 +706,25 @@ int Server::start(const char* bind_addr) {
   string addr(bind_addr);
   Log_info("bind address is: %s", bind_addr);
   addr_ = addr;
-  sp_server_listener_ = std::make_unique<ServerListener>(this, addr);
-  pollmgr_->add(sp_server_listener_);
+#ifdef USE_IPC
+  // a unix socket path can only be bound once.
+  n_listeners_ = 1;
+#endif
+  if (pollmgr_->n_threads_ > 1 || n_listeners_ > 1) {
+    // connections, and so handlers, would be spread over the poll threads.
+    for (auto& it : handlers_) {
+      if (thread_safe_handlers_.count(it.first) == 0) {
+        Log_fatal("rrr::Server: rpc 0x%x is not thread safe, it cannot be "
+                  "served by %d poll threads and %d listeners",
+                  it.first, pollmgr_->n_threads_, n_listeners_);
+      }
+    }
+  }
+  for (int i = 0; i < n_listeners_; i++) {
+    auto listener = std::make_shared<ServerListener>(this, addr, n_listeners_ > 1);
+    listeners_.push_back(listener);
+    pollmgr_->add(listener);
+  }
   return 0;
 
   addr_ = addr;
@@ -655,19 +809,35 @@ int Server::start(const char* bind_addr) {
     return 0;
 }
 
-int Server::reg(i32 rpc_id, const std::function<void(Request*, ServerConnection*)>& func) {
+int Server::reg(Service* svc) {
+    reg_thread_safe_ = svc->thread_safe();
+    int ret = svc->__reg_to__(this);
+    reg_thread_safe_ = false;
+    return ret;
+}
+
+int Server::reg(i32 rpc_id, const std::function<void(Request*, ServerConnection*)>& func,
+                bool fast /* =? */, bool thread_safe /* =? */) {
     // disallow duplicate rpc_id
     if (handlers_.find(rpc_id) != handlers_.end()) {
         return EEXIST;
     }
 
     handlers_[rpc_id] = func;
+    if (fast) {
+        fast_handlers_.insert(rpc_id);
+    }
+    if (thread_safe || reg_thread_safe_) {
+        thread_safe_handlers_.insert(rpc_id);
+    }
 
     return 0;
 }
 
 void Server::unreg(i32 rpc_id) {
     handlers_.erase(rpc_id);
+    fast_handlers_.erase(rpc_id);
+    thread_safe_handlers_.erase(rpc_id);
 }
 
 } // namespace rrr
@@ -5,6 +5,7 @@
 #include <pthread.h>
 #include <memory>
 #include <chrono>
+#include <atomic>
 
 #include <sys/socket.h>
 #include <netdb.h>
@@ -12,6 +13,7 @@
 #include "misc/marshal.hpp"
 #include "reactor/epoll_wrapper.h"
 #include "reactor/reactor.h"
+#include "batching.hpp"
 
 // for getaddrinfo() used in Server::start()
 //struct addrinfo;
@@ -37,6 +39,9 @@ class Service {
 public:
     virtual ~Service() {}
     virtual int __reg_to__(Server*) = 0;
+    // true if every handler may run on any poll thread, concurrently with
+    // the others; only such handlers are ever stolen by another poll thread.
+    virtual bool thread_safe() { return false; }
 };
 
 class ServerListener: public Pollable {
@@ -50,6 +55,8 @@ class ServerListener: public Pollable {
   struct addrinfo* p_svr_addr_{nullptr};
 
   int server_sock_{0};
+  // connections accepted on this socket.
+  std::atomic<uint64_t> n_accepted_{0};
   int poll_mode() {
     return Pollable::READ;
   }
@@ -68,7 +75,9 @@ class ServerListener: public Pollable {
 	void handle_free() {verify(0);}
   void close();
   int fd() {return server_sock_;}
-  ServerListener(Server* s, std::string addr);
+  // with reuse_port, several listeners can bind the same address and the
+  // kernel spreads incoming connections over them.
+  ServerListener(Server* s, std::string addr, bool reuse_port = false);
 //protected:
   virtual ~ServerListener() {
     if (p_gai_result_ != nullptr) {
@@ -85,6 +94,8 @@ class ServerConnection: public Pollable {
 
     Marshal in_, out_;
     SpinLock out_l_;
+    // guarded by out_l_
+    OutputBatcher batcher_;
 
     Server* server_;
     int socket_;
@@ -106,6 +117,12 @@ class ServerConnection: public Pollable {
     static std::unordered_set<i32> rpc_id_missing_s;
     static SpinLock rpc_id_missing_l_s;
 
+    // finished requests kept for reuse, requests may be put back from any
+    // thread that replies.
+    SpinLock req_pool_l_;
+    std::vector<Request*> req_pool_;
+    static const size_t REQ_POOL_SIZE = 64;
+
 
 public:
 	int count = 0;
@@ -137,6 +154,20 @@ public:
 
     void end_reply();
 
+    // requests come from and go back to a small per-connection pool, a
+    // request must not be used after put_request().
+    Request* get_request();
+    void put_request(Request* req);
+
+    // send whatever is held back by batching now.
+    void flush();
+
+    void set_batching(size_t max_bytes, uint64_t max_delay_us);
+
+    bool batch_due();
+
+    BatchStats batch_stats();
+
     // helper function, do some work in background
     int run_async(const std::function<void()>& f);
 
@@ -179,6 +210,23 @@ class DeferredReply: public NoCopy {
 //    std::weak_ptr<ServerConnection> wp_sconn_;
     std::shared_ptr<ServerConnection> sp_sconn_{};
 
+ protected:
+
+    /**
+     * For generated stubs: a subclass holds all the arguments of one call,
+     * so the call costs a single pooled allocation that reply() frees.
+     */
+    DeferredReply(rrr::Request* req, ServerConnection* sconn)
+        : req_(req), sconn_(sconn) {
+      sp_sconn_ = std::dynamic_pointer_cast<ServerConnection>(sconn->shared_from_this());
+      verify(sp_sconn_);
+    }
+
+    // writes the output arguments, between begin_reply() and end_reply().
+    virtual void marshal_reply(ServerConnection* sconn) {
+      marshal_reply_();
+    }
+
  public:
 
     DeferredReply(rrr::Request* req, ServerConnection* sconn,
@@ -189,9 +237,11 @@ class DeferredReply: public NoCopy {
       verify(x);
     }
 
-    ~DeferredReply() {
-        cleanup_();
-        delete req_;
+    virtual ~DeferredReply() {
+        if (cleanup_) {
+          cleanup_();
+        }
+        sp_sconn_->put_request(req_);
         req_ = nullptr;
         sp_sconn_.reset();
     }
@@ -208,7 +258,7 @@ class DeferredReply: public NoCopy {
       auto sconn = sp_sconn_;
       if (sconn && sconn->connected()) {
         sconn->begin_reply(req_);
-        marshal_reply_();
+        marshal_reply(sconn.get());
         sconn->end_reply();
       } else {
         // server connection has close. What would happen if no reply?
@@ -219,12 +269,24 @@ class DeferredReply: public NoCopy {
       // BUG here, this is deleted twice????
       delete this;
     }
+
+    static void* operator new(size_t n) {
+      size_t capacity;
+      return BufferPool::Allocate(n, &capacity);
+    }
+    static void operator delete(void* p, size_t n) {
+      BufferPool::Deallocate((char*) p, BufferPool::Capacity(n));
+    }
 };
 
 class Server: public NoCopy {
     friend class ServerConnection;
  public:
     std::unordered_map<i32, std::function<void(Request*, ServerConnection*)>> handlers_;
+    // rpc ids whose handlers run inline on the poll thread.
+    std::unordered_set<i32> fast_handlers_;
+    // rpc ids whose handlers may run on any poll thread.
+    std::unordered_set<i32> thread_safe_handlers_;
     PollMgr* pollmgr_;
     ThreadPool* threadpool_;
     int server_sock_;
@@ -233,13 +295,20 @@ class Server: public NoCopy {
 
     SpinLock sconns_l_;
     std::unordered_set<shared_ptr<ServerConnection>> sconns_{};
-    std::shared_ptr<ServerListener> sp_server_listener_{};
+    std::vector<std::shared_ptr<ServerListener>> listeners_{};
+    int n_listeners_{1};
 
     enum {
         NEW, RUNNING, STOPPING, STOPPED
     } status_;
 
     pthread_t loop_th_;
+    bool work_stealing_{false};
+    // set while a thread safe Service registers its handlers.
+    bool reg_thread_safe_{false};
+    size_t batch_bytes_{0};
+    uint64_t batch_delay_us_{0};
+    std::shared_ptr<BatchFlushJob> sp_flush_job_{};
 
     static void* start_server_loop(void* arg);
     void server_loop(struct addrinfo* svr_addr);
@@ -252,10 +321,40 @@ public:
 
     int start(const char* bind_addr);
 
-    int reg(Service* svc) {
-        return svc->__reg_to__(this);
+    /**
+     * Accept on n SO_REUSEPORT sockets instead of one, must be called
+     * before start(). Together with a PollMgr of n threads this spreads
+     * both accepting and the connections, which PollMgr already pins to
+     * one poll thread each, over all threads. Handlers of a connection run
+     * on its poll thread, so start() refuses more than one listener or poll
+     * thread unless every registered handler is thread safe.
+     */
+    void set_listeners(int n) {
+        verify(n > 0);
+        n_listeners_ = n;
     }
 
+    /**
+     * Let idle poll threads of the same PollMgr run this server's handlers.
+     * Only handlers registered as thread safe are ever stolen, the others
+     * keep running on their connection's poll thread; replies are always
+     * sent on the request's connection.
+     */
+    void enable_work_stealing(bool enable = true) {
+        work_stealing_ = enable;
+    }
+
+    /**
+     * Coalesce replies on every connection of this server, see
+     * Client::set_batching(). max_bytes = 0 turns it off.
+     */
+    void set_batching(size_t max_bytes, uint64_t max_delay_us);
+
+    // summed over the open connections.
+    BatchStats batch_stats();
+
+    int reg(Service* svc);
+
     /**
      * The svc_func need to do this:
      *
@@ -269,25 +368,25 @@ public:
      *     server_connection->end_reply();
      *
      *     // cleanup resource
-     *     delete request;
-     *     server_connection->release();
+     *     server_connection->put_request(request);
      *  }
+     *
+     * A fast handler is called right on the poll thread instead of in a new
+     * coroutine, so it must never block or yield, and it cannot create an
+     * Event (or wait on one) as there is no coroutine to wake up.
+     *
+     * A thread safe handler may be stolen by another poll thread, see
+     * enable_work_stealing().
      */
-    int reg(i32 rpc_id, const std::function<void(Request*, ServerConnection*)>& func);
+    int reg(i32 rpc_id, const std::function<void(Request*, ServerConnection*)>& func,
+            bool fast = false, bool thread_safe = false);
 
     template<class S>
-    int reg(i32 rpc_id, S* svc, void (S::*svc_func)(Request*, ServerConnection*)) {
-
-        // disallow duplicate rpc_id
-        if (handlers_.find(rpc_id) != handlers_.end()) {
-            return EEXIST;
-        }
-
-        handlers_[rpc_id] = [svc, svc_func] (Request* req, ServerConnection* sconn) {
+    int reg(i32 rpc_id, S* svc, void (S::*svc_func)(Request*, ServerConnection*),
+            bool fast = false) {
+        return reg(rpc_id, [svc, svc_func] (Request* req, ServerConnection* sconn) {
             (svc->*svc_func)(req, sconn);
-        };
-
-        return 0;
+        }, fast);
     }
 
     void unreg(i32 rpc_id);
@@ -10,6 +10,7 @@
 #include "misc/rand.hpp"
 #include "misc/marshal.hpp"
 #include "misc/recorder.hpp"
+#include "misc/segment_log.hpp"
 #include "misc/cpuinfo.hpp"
 #include "misc/netinfo.hpp"
 #include "misc/io.hpp"
@@ -18,6 +19,7 @@
 #include "reactor/coroutine.h"
 #include "reactor/event.h"
 #include "reactor/epoll_wrapper.h"
+#include "reactor/stack_pool.h"
 
 #include "rpc/utils.hpp"
 #include "rpc/client.hpp"
@@ -5,6 +5,17 @@
 #include <iostream>
 
 #include "rrr/rrr.hpp"
+#include "rrr/reactor/quorum_event.h"
+#include "deptran/lease.h"
+#include "deptran/config.h"
+#include "deptran/frame.h"
+#include "deptran/fpga_raft/server.h"
+#include "deptran/fpga_raft/commo.h"
+#include "deptran/fpga_raft/service.h"
+#include "deptran/paxos/commo.h"
+#include "deptran/paxos/coordinator.h"
+#include "deptran/paxos/server.h"
+#include "deptran/paxos/service.h"
 
 using namespace std;
 using namespace rrr;
@@ -135,6 +146,1168 @@ TEST(CoroutineTest, wait_die_lock) {
   ASSERT_EQ(y, 1);
 }
 
+TEST(CoroutineTest, event_pool) {
+  auto before = EventPool::NumInUse();
+  int64_t during = 0;
+  Coroutine::CreateRun([&] () {
+    auto sp_e1 = Reactor::CreateSpEvent<IntEvent>();
+    auto sp_e2 = Reactor::CreateSpEvent<IntEvent>();
+    during = EventPool::NumInUse();
+  });
+  ASSERT_EQ(during, before + 2);
+  ASSERT_EQ(EventPool::NumInUse(), before);
+}
+
+TEST(CoroutineTest, event_cross_thread_release) {
+  auto before = EventPool::NumInUse();
+  std::shared_ptr<IntEvent> sp_e;
+  bool woken = false;
+  Coroutine::CreateRun([&] () {
+    sp_e = Reactor::CreateSpEvent<IntEvent>();
+    auto sp = sp_e;
+    sp->Wait(1000 * 1000);
+    woken = true;
+  });
+  // the timer wheel keeps a waiting event alive.
+  ASSERT_EQ(sp_e->sp_wheel_ref_, sp_e);
+  sp_e->Set(1);
+  while (!woken) {
+    Reactor::GetReactor()->Loop(false, true);
+  }
+  // woken early, the timer is cancelled and its reference dropped.
+  ASSERT_FALSE(sp_e->timeout_hook_.Linked());
+  ASSERT_EQ(sp_e.use_count(), 1);
+  ASSERT_EQ(EventPool::NumInUse(), before + 1);
+  // released on another thread, the block still goes back to this pool.
+  std::thread th([&sp_e] () { sp_e.reset(); });
+  th.join();
+  ASSERT_EQ(EventPool::NumInUse(), before);
+}
+
+TEST(CoroutineTest, wait_timeout) {
+  bool timed_out = false;
+  auto coro1 = Coroutine::CreateRun([&] () {
+    auto sp_e = Reactor::CreateSpEvent<IntEvent>();
+    sp_e->Wait(10 * 1000);
+    timed_out = (sp_e->status_ == Event::TIMEOUT);
+  });
+  ASSERT_FALSE(timed_out);
+  while (!timed_out) {
+    Reactor::GetReactor()->Loop(false, true);
+  }
+}
+
+TEST(CoroutineTest, timeout_event_wakeup) {
+  bool woken = false;
+  auto coro1 = Coroutine::CreateRun([&] () {
+    auto sp_e = Reactor::CreateSpEvent<TimeoutEvent>(5 * 1000);
+    sp_e->Wait();
+    woken = (sp_e->status_ == Event::DONE);
+  });
+  while (!woken) {
+    Reactor::GetReactor()->Loop(false, true);
+  }
+}
+
+TEST(CoroutineTest, stack_pool) {
+  auto sctx = StackPool::Allocate();
+  ASSERT_EQ(sctx.size, StackPool::StackSize());
+  auto n_free = StackPool::NumFree();
+  StackPool::Deallocate(sctx);
+  ASSERT_EQ(StackPool::NumFree(), n_free + 1);
+  auto sctx2 = StackPool::Allocate();
+  ASSERT_EQ(sctx2.sp, sctx.sp);
+  StackPool::Deallocate(sctx2);
+}
+
+TEST(CoroutineTest, run_queue) {
+  auto reactor = Reactor::GetReactor();
+  vector<int> order;
+  for (int i = 0; i < 4; i++) {
+    reactor->Spawn([&order, i] () { order.push_back(i); });
+  }
+  std::deque<std::function<void()>> stolen;
+  ASSERT_EQ(reactor->run_queue_.Steal(stolen), 2);
+  ASSERT_EQ(reactor->RunQueued(), 2);
+  ASSERT_EQ(order, vector<int>({0, 1}));
+  // a thief takes from the back.
+  stolen.front()();
+  ASSERT_EQ(order.back(), 3);
+}
+
+TEST(CoroutineTest, marshal_write_ref) {
+  Marshal src;
+  std::string big(4 * 1024, 'x');
+  src << big;
+  Marshal m1, m2;
+  m1.write_ref(src);
+  m2.write_ref(src);
+  ASSERT_EQ(src.content_size(), m1.content_size());
+  // the shared chunk is sealed, so later writes must not touch it.
+  int32_t tail = 7;
+  m1 << tail;
+  std::string s1, s2;
+  int32_t t1 = 0;
+  m1 >> s1 >> t1;
+  m2 >> s2;
+  ASSERT_EQ(s1, big);
+  ASSERT_EQ(s2, big);
+  ASSERT_EQ(t1, tail);
+  ASSERT_TRUE(m2.empty());
+}
+
+TEST(CoroutineTest, output_batcher) {
+  OutputBatcher batcher;
+  ASSERT_TRUE(batcher.add(16));
+  batcher.set(64, 1000 * 1000);
+  ASSERT_FALSE(batcher.add(16));
+  ASSERT_FALSE(batcher.add(32));
+  ASSERT_FALSE(batcher.due());
+  // crossing the size bound flushes all held packets at once.
+  ASSERT_TRUE(batcher.add(64));
+  ASSERT_FALSE(batcher.flush());
+  ASSERT_EQ(batcher.stats().n_packets, 4);
+  ASSERT_EQ(batcher.stats().n_flushes, 2);
+  batcher.set(64, 0);
+  ASSERT_FALSE(batcher.add(8));
+  ASSERT_TRUE(batcher.due());
+}
+
+TEST(CoroutineTest, mpsc_queue) {
+  MpscQueue<int> q;
+  const int n_threads = 4, n_per_thread = 10000;
+  vector<std::thread> producers;
+  for (int t = 0; t < n_threads; t++) {
+    producers.emplace_back([&q, t] () {
+      for (int i = 0; i < n_per_thread; i++) {
+        q.Push(t * n_per_thread + i);
+      }
+    });
+  }
+  vector<int> last(n_threads, -1);
+  int n_popped = 0, v = 0;
+  while (n_popped < n_threads * n_per_thread) {
+    if (q.Pop(v)) {
+      // per producer order is kept.
+      ASSERT_GT(v % n_per_thread, last[v / n_per_thread]);
+      last[v / n_per_thread] = v % n_per_thread;
+      n_popped++;
+    }
+  }
+  for (auto& th : producers) {
+    th.join();
+  }
+  ASSERT_TRUE(q.Empty());
+}
+
+TEST(CoroutineTest, mpsc_ring) {
+  MpscRing<int> ring(6);
+  ASSERT_EQ(ring.Capacity(), 8);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_TRUE(ring.TryPush([i] (int& slot) { slot = i; }));
+  }
+  ASSERT_FALSE(ring.TryPush([] (int& slot) { slot = -1; }));
+  vector<int> got;
+  ASSERT_EQ(ring.PopBatch(3, [&got] (int& slot) { got.push_back(slot); }), 3);
+  ASSERT_EQ(got, vector<int>({0, 1, 2}));
+  ASSERT_EQ(ring.PopBatch(100, [] (int&) {}), 5);
+  ASSERT_TRUE(ring.Empty());
+  const int n_threads = 4, n_per_thread = 10000;
+  vector<std::thread> producers;
+  for (int t = 0; t < n_threads; t++) {
+    producers.emplace_back([&ring, t] () {
+      for (int i = 0; i < n_per_thread; i++) {
+        int v = t * n_per_thread + i;
+        while (!ring.TryPush([v] (int& slot) { slot = v; })) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  vector<int> last(n_threads, -1);
+  int n_popped = 0;
+  while (n_popped < n_threads * n_per_thread) {
+    n_popped += ring.PopBatch(16, [&last] (int& v) {
+      // per producer order is kept.
+      ASSERT_GT(v % n_per_thread, last[v / n_per_thread]);
+      last[v / n_per_thread] = v % n_per_thread;
+    });
+  }
+  for (auto& th : producers) {
+    th.join();
+  }
+  ASSERT_TRUE(ring.Empty());
+}
+
+TEST(CoroutineTest, latency_sketch) {
+  LatencySketch sketch;
+  ASSERT_EQ(sketch.quantile(0.5), 0);
+  for (int i = 1; i <= 10000; i++) {
+    sketch.sample(i);
+  }
+  ASSERT_EQ(sketch.count(), 10000);
+  auto within = [] (int64_t got, int64_t want) {
+    return got >= want - want / LatencySketch::SUB &&
+        got <= want + want / LatencySketch::SUB;
+  };
+  ASSERT_TRUE(within(sketch.quantile(0.5), 5000));
+  ASSERT_TRUE(within(sketch.quantile(0.99), 9900));
+  ASSERT_TRUE(within(sketch.quantile(0.999), 9990));
+  sketch.clear();
+  sketch.sample(7);
+  ASSERT_EQ(sketch.quantile(0.999), 7);
+}
+
+TEST(CoroutineTest, replica_group_intern) {
+  auto g = janus::ReplicaGroup::Intern({"10.9.0.2", "10.9.0.1", "10.9.0.3"});
+  // the same set in another order is the same group.
+  ASSERT_EQ(janus::ReplicaGroup::Intern({"10.9.0.3", "10.9.0.1", "10.9.0.2"}), g);
+  ASSERT_EQ(g->ips_, vector<std::string>({"10.9.0.1", "10.9.0.2", "10.9.0.3"}));
+  ASSERT_EQ(g->IndexOf("10.9.0.3"), 2);
+  ASSERT_EQ(g->IndexOf("10.9.0.4"), -1);
+  auto sub = janus::ReplicaGroup::Intern({"10.9.0.1", "10.9.0.2"});
+  ASSERT_NE(sub, g);
+  ASSERT_NE(sub->id_, g->id_);
+  ASSERT_EQ(sub->history_.size(), 2u);
+  ASSERT_EQ(sub->latencies_.size(), 2u);
+  // votes clear the voter's bit and count against its slot in the group.
+  Coroutine::CreateRun([&] () {
+    auto e = Reactor::CreateSpEvent<janus::QuorumEvent>(3, 2, DepId{"", 0}, g);
+    ASSERT_EQ(e->pending_, 7u);
+    e->recordHistory();
+    e->VoteYes(g->IndexOf("10.9.0.2"));
+    ASSERT_EQ(e->pending_, 5u);
+    ASSERT_EQ(g->history_, vector<int>({0, 1, 0}));
+    ASSERT_FALSE(e->Yes());
+    e->VoteNo(0);
+    ASSERT_EQ(e->pending_, 4u);
+    e->VoteYes(2);
+    ASSERT_TRUE(e->Yes());
+    ASSERT_EQ(e->pending_, 0u);
+  });
+}
+
+TEST(CoroutineTest, composite_event) {
+  shared_ptr<IntEvent> a, b;
+  bool woken = false;
+  Coroutine::CreateRun([&] () {
+    a = Reactor::CreateSpEvent<IntEvent>();
+    b = Reactor::CreateSpEvent<IntEvent>();
+    auto sp_e = Reactor::CreateSpEvent<AndEvent>(a, b);
+    sp_e->Wait();
+    woken = (sp_e->status_ == Event::DONE);
+  });
+  a->Set(1);
+  Reactor::GetReactor()->Loop();
+  ASSERT_FALSE(woken);
+  b->Set(1);
+  Reactor::GetReactor()->Loop();
+  ASSERT_TRUE(woken);
+  // a child that gets ready by time alone still wakes its parent.
+  bool timed = false;
+  Coroutine::CreateRun([&] () {
+    auto never = Reactor::CreateSpEvent<NeverEvent>();
+    auto sp_t = Reactor::CreateSpEvent<TimeoutEvent>(5 * 1000);
+    auto sp_e = Reactor::CreateSpEvent<OrEvent>(sp_t, never);
+    sp_e->Wait();
+    timed = (sp_e->status_ == Event::DONE);
+  });
+  while (!timed) {
+    Reactor::GetReactor()->Loop(false, true);
+  }
+}
+
+TEST(CoroutineTest, buffer_pool) {
+  size_t cap = 0;
+  char* p = BufferPool::Allocate(100, &cap);
+  ASSERT_EQ(cap, 128u);
+  auto n_free = BufferPool::NumFree(100);
+  BufferPool::Deallocate(p, cap);
+  ASSERT_EQ(BufferPool::NumFree(100), n_free + 1);
+  // served from the free list of its class.
+  ASSERT_EQ(BufferPool::Allocate(128, &cap), p);
+  BufferPool::Deallocate(p, cap);
+  char* big = BufferPool::Allocate(BufferPool::MAX_CLASS_SIZE + 1, &cap);
+  ASSERT_EQ(cap, BufferPool::MAX_CLASS_SIZE + 1);
+  BufferPool::Deallocate(big, cap);
+
+  // chunks grow from a small first one.
+  Marshal m;
+  std::string s(20000, 'y');
+  int32_t i = 42, j = 0;
+  m << i << s;
+  std::string t;
+  m >> j >> t;
+  ASSERT_EQ(j, i);
+  ASSERT_EQ(t, s);
+  ASSERT_TRUE(m.empty());
+}
+
+TEST(CoroutineTest, marshal_args) {
+  static_assert(wire_pod_run<uint64_t, i32, std::string, i64>::count == 2,
+                "the run stops at the string");
+  static_assert(wire_pod_run<uint64_t, i32, std::string, i64>::size == 12,
+                "packed, no padding");
+  static_assert(!is_wire_pod<i64>::value, "i64 goes through operator<<");
+  uint64_t a = 1ull << 40;
+  i32 b = -3;
+  std::string c = "xyz";
+  i64 d = 7;
+  // same bytes as field by field.
+  Marshal m1, m2;
+  m1 << pack_args(a, b, c, d);
+  m2 << a << b << c << d;
+  ASSERT_EQ(m1.content_size(), m2.content_size());
+  std::string s1(m1.content_size(), 0), s2(m2.content_size(), 0);
+  m1.peek(&s1[0], s1.size());
+  m2.peek(&s2[0], s2.size());
+  ASSERT_EQ(s1, s2);
+  uint64_t a2 = 0;
+  i32 b2 = 0;
+  std::string c2;
+  i64 d2 = 0;
+  m1 >> tie_args(a2, b2, c2, d2);
+  ASSERT_EQ(a2, a);
+  ASSERT_EQ(b2, b);
+  ASSERT_EQ(c2, c);
+  ASSERT_EQ(d2, d);
+  ASSERT_TRUE(m1.empty());
+}
+
+TEST(CoroutineTest, reuseport_listeners) {
+  const i32 rpc_id = 0x7001;
+  auto svr_pm = new PollMgr(2);
+  auto server = new Server(svr_pm);
+  server->set_listeners(2);
+  server->reg(rpc_id, [] (Request* req, ServerConnection* sconn) {
+    i32 x = 0;
+    req->m >> x;
+    sconn->begin_reply(req);
+    *sconn << x + 1;
+    sconn->end_reply();
+    sconn->put_request(req);
+  }, false, true);
+  ASSERT_EQ(server->start("127.0.0.1:18931"), 0);
+
+  auto cl_pm = new PollMgr(1);
+  std::vector<std::shared_ptr<Client>> clients;
+  std::vector<Future*> futures;
+  for (i32 i = 0; i < 16; i++) {
+    auto cl = std::make_shared<Client>(cl_pm);
+    ASSERT_EQ(cl->connect("127.0.0.1:18931"), 0);
+    auto fu = cl->begin_request(rpc_id);
+    ASSERT_NE(fu, nullptr);
+    *cl << i;
+    cl->end_request();
+    clients.push_back(cl);
+    futures.push_back(fu);
+  }
+  for (i32 i = 0; i < 16; i++) {
+    ASSERT_EQ(futures[i]->get_error_code(), 0);
+    i32 r = 0;
+    futures[i]->get_reply() >> r;
+    ASSERT_EQ(r, i + 1);
+    futures[i]->release();
+    clients[i]->close_and_release();
+  }
+  // the kernel spread the connections over both sockets.
+  ASSERT_EQ(server->listeners_.size(), 2u);
+  ASSERT_GT(server->listeners_[0]->n_accepted_, 0u);
+  ASSERT_GT(server->listeners_[1]->n_accepted_, 0u);
+  ASSERT_EQ(server->listeners_[0]->n_accepted_ +
+            server->listeners_[1]->n_accepted_, 16u);
+  delete server;
+  cl_pm->release();
+}
+
+TEST(CoroutineTest, fast_handler) {
+  const i32 fast_id = 0x7002, slow_id = 0x7003;
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  bool fast_in_coro = true;
+  server->reg(fast_id, [&fast_in_coro] (Request* req, ServerConnection* sconn) {
+    // replies inline on the poll thread.
+    fast_in_coro = (bool) Reactor::sp_running_coro_th_;
+    i32 x = 0;
+    req->m >> x;
+    sconn->begin_reply(req);
+    *sconn << x + 1;
+    sconn->end_reply();
+    sconn->put_request(req);
+  }, true);
+  server->reg(slow_id, [] (Request* req, ServerConnection* sconn) {
+    // a normal handler has a coroutine to wait in.
+    auto sp_e = Reactor::CreateSpEvent<TimeoutEvent>(1000);
+    sp_e->Wait();
+    i32 x = 0;
+    req->m >> x;
+    sconn->begin_reply(req);
+    *sconn << x + 2;
+    sconn->end_reply();
+    sconn->put_request(req);
+  });
+  ASSERT_EQ(server->start("127.0.0.1:18932"), 0);
+
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18932"), 0);
+  i32 x = 10;
+  auto fu_slow = cl->begin_request(slow_id);
+  *cl << x;
+  cl->end_request();
+  auto fu_fast = cl->begin_request(fast_id);
+  *cl << x;
+  cl->end_request();
+  i32 r_fast = 0, r_slow = 0;
+  ASSERT_EQ(fu_fast->get_error_code(), 0);
+  fu_fast->get_reply() >> r_fast;
+  ASSERT_EQ(fu_slow->get_error_code(), 0);
+  fu_slow->get_reply() >> r_slow;
+  ASSERT_EQ(r_fast, 11);
+  ASSERT_EQ(r_slow, 12);
+  ASSERT_FALSE(fast_in_coro);
+  fu_fast->release();
+  fu_slow->release();
+  cl->close_and_release();
+  delete server;
+  cl_pm->release();
+}
+
+TEST(CoroutineTest, client_close_pending) {
+  const i32 hold_id = 0x7004;
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  // never answered.
+  server->reg(hold_id, [] (Request* req, ServerConnection* sconn) {
+    sconn->put_request(req);
+  }, true);
+  ASSERT_EQ(server->start("127.0.0.1:18935"), 0);
+
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18935"), 0);
+  std::atomic<int> n_failed{0};
+  FutureAttr fuattr;
+  fuattr.callback = [&n_failed] (Future* fu) {
+    if (fu->get_error_code() != 0) {
+      n_failed++;
+    }
+  };
+  auto fu = cl->begin_request(hold_id, fuattr);
+  cl->end_request();
+  ASSERT_NE(fu, nullptr);
+  cl->close_and_release();
+  // the pending request fails once, with the connection.
+  fu->wait();
+  ASSERT_EQ(fu->get_error_code(), ENOTCONN);
+  ASSERT_EQ(n_failed, 1);
+  // one after the close is refused and never completes.
+  auto fu_late = cl->begin_request(hold_id, fuattr);
+  cl->end_request();
+  ASSERT_EQ(fu_late, nullptr);
+  cl->close_and_release();
+  ASSERT_EQ(n_failed, 1);
+  fu->release();
+  delete server;
+  cl_pm->release();
+}
+
+TEST(CoroutineTest, client_flow_control) {
+  const i32 slow_id = 0x7005;
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  // answers after a while, so the request stays pending.
+  server->reg(slow_id, [] (Request* req, ServerConnection* sconn) {
+    auto sp_e = Reactor::CreateSpEvent<TimeoutEvent>(100 * 1000);
+    sp_e->Wait();
+    sconn->begin_reply(req);
+    sconn->end_reply();
+    sconn->put_request(req);
+  });
+  ASSERT_EQ(server->start("127.0.0.1:18938"), 0);
+
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18938"), 0);
+  cl->set_flow_control(1, 0);
+  auto fu = cl->begin_request(slow_id);
+  cl->end_request();
+  ASSERT_NE(fu, nullptr);
+  // the window is full, more is shed instead of queued.
+  auto fu_shed = cl->begin_request(slow_id);
+  cl->end_request();
+  ASSERT_EQ(fu_shed, nullptr);
+  ASSERT_EQ(cl->n_shed(), 1u);
+  // so are the generated stubs, the sync one reports it as not connected.
+  janus::FpgaRaftProxy proxy(cl.get());
+  DepId di = { "dep", -1 };
+  ASSERT_EQ(proxy.async_Heartbeat(1, 0, di), nullptr);
+  uint64_t term = 0, index = 0, disk_us = 0;
+  ASSERT_EQ(proxy.Heartbeat(1, 0, di, &term, &index, &disk_us), ENOTCONN);
+  ASSERT_EQ(cl->n_shed(), 3u);
+  // the reply opens the window again.
+  fu->wait();
+  ASSERT_EQ(fu->get_error_code(), 0);
+  fu->release();
+  fu = cl->begin_request(slow_id);
+  cl->end_request();
+  ASSERT_NE(fu, nullptr);
+  fu->wait();
+  ASSERT_EQ(fu->get_error_code(), 0);
+  ASSERT_EQ(cl->n_shed(), 3u);
+  fu->release();
+  cl->close_and_release();
+  delete server;
+  cl_pm->release();
+}
+
+TEST(CoroutineTest, segment_log) {
+  std::string dir = "/tmp/segment_log_test_" + std::to_string(getpid());
+  const char* data;
+  size_t len;
+  {
+    SegmentLog log(dir, 4096);
+    ASSERT_EQ(log.Open(), 0);
+    for (int i = 1; i <= 400; i++) {
+      std::string s = "entry-" + std::to_string(i);
+      log.Append(i, s.data(), s.size());
+    }
+    // a later record for a slot wins.
+    log.Append(7, "again", 5);
+    log.Sync();
+    ASSERT_GT(log.NumSegments(), 1);
+    ASSERT_TRUE(log.Read(7, &data, &len));
+    ASSERT_EQ(std::string(data, len), "again");
+    log.TruncateBefore(300);
+    ASSERT_FALSE(log.Read(7, &data, &len));
+  }
+  {
+    SegmentLog log(dir, 4096);
+    ASSERT_GT(log.Open(), 100);
+    ASSERT_EQ(log.EndSlot(), 401);
+    ASSERT_TRUE(log.Read(400, &data, &len));
+    ASSERT_EQ(std::string(data, len), "entry-400");
+    // tear the last record.
+    const_cast<char*>(data)[0] ^= 1;
+  }
+  {
+    SegmentLog log(dir, 4096);
+    log.Open();
+    ASSERT_EQ(log.EndSlot(), 400);
+    ASSERT_TRUE(log.Read(399, &data, &len));
+    ASSERT_EQ(std::string(data, len), "entry-399");
+    // tear a record of an earlier segment.
+    ASSERT_GT(log.NumSegments(), 1);
+    ASSERT_TRUE(log.Read(305, &data, &len));
+    const_cast<char*>(data)[0] ^= 1;
+  }
+  {
+    SegmentLog log(dir, 4096);
+    log.Open();
+    // nothing after the torn record survives, not even in later segments.
+    ASSERT_EQ(log.EndSlot(), 305);
+    ASSERT_FALSE(log.Read(399, &data, &len));
+    ASSERT_EQ(log.NumSegments(), 1);
+  }
+  ASSERT_EQ(system(("rm -rf " + dir).c_str()), 0);
+}
+
+TEST(CoroutineTest, disk_engine_renamed_file) {
+  std::string file = "/tmp/disk_engine_test_" + std::to_string(getpid());
+  std::string moved = file + ".old";
+  DiskEngine engine;
+  char a = 'a', b = 'b';
+  std::shared_ptr<DiskEvent> ev_a, ev_b;
+  // events are created in a coroutine.
+  Coroutine::CreateRun([&] () {
+    ev_a = std::make_shared<DiskEvent>(file, &a, 1, 1, DiskEvent::WRITE_SPEC);
+    ev_b = std::make_shared<DiskEvent>(file, &b, 1, 1,
+                                       DiskEvent::WRITE_SPEC | DiskEvent::FSYNC);
+  });
+  engine.Submit(ev_a);
+  ASSERT_EQ(engine.RunOnce(0), 1u);
+  ASSERT_EQ(rename(file.c_str(), moved.c_str()), 0);
+  // the fd cached for the old file is not reused.
+  engine.Submit(ev_b);
+  ASSERT_EQ(engine.RunOnce(0), 1u);
+  auto read_all = [] (const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  };
+  ASSERT_EQ(read_all(file), "b");
+  ASSERT_EQ(read_all(moved), "a");
+  unlink(file.c_str());
+  unlink(moved.c_str());
+}
+
+TEST(CoroutineTest, leader_lease) {
+  janus::LeaderLease lease;
+  lease.Grant();
+  lease.OnQuorum(janus::LeaderLease::Now());
+  ASSERT_FALSE(lease.Granted());
+  ASSERT_FALSE(lease.Valid());
+
+  lease.SetDuration(100 * 1000);
+  lease.Grant();
+  ASSERT_TRUE(lease.Granted());
+  // one follower and the leader are a majority of 3.
+  auto sent_at = janus::LeaderLease::Now();
+  lease.OnAck(1, sent_at, 3);
+  ASSERT_TRUE(lease.Valid());
+  lease.Revoke();
+  ASSERT_FALSE(lease.Valid());
+  // but not of 5, the lease runs from the older of the two acks.
+  lease.OnAck(1, sent_at - 50 * 1000, 5);
+  ASSERT_FALSE(lease.Valid());
+  lease.OnAck(2, sent_at, 5);
+  ASSERT_TRUE(lease.Valid());
+
+  usleep(100 * 1000);
+  ASSERT_FALSE(lease.Granted());
+  ASSERT_FALSE(lease.Valid());
+  // an ack to an older message does not bring it back.
+  lease.OnAck(2, sent_at, 5);
+  ASSERT_FALSE(lease.Valid());
+}
+
+// the replication servers read their settings from the global config,
+// which is otherwise loaded from yaml.
+struct TestConfig : janus::Config {
+  static janus::Config* Get() {
+    if (config_s == nullptr) {
+      config_s = new TestConfig();
+    }
+    return config_s;
+  }
+};
+
+// a replica of partition 0 named after its log directory, locale 0 leads.
+struct TestSite {
+  janus::Config::SiteInfo info;
+  janus::Frame frame;
+  TestSite(uint32_t id, int mode, const std::string& name)
+      : info(id), frame(mode) {
+    info.name = name;
+    info.locale_id = id;
+    frame.site_info_ = &info;
+  }
+};
+
+// runs f in a coroutine and turns the disk thread and the reactor until it
+// returns, for code that waits on log writes.
+static void RunWithDisk(const std::function<void()>& f) {
+  bool done = false;
+  Coroutine::CreateRun([&] () {
+    f();
+    done = true;
+  });
+  auto reactor = Reactor::GetReactor();
+  while (!done) {
+    reactor->disk_engine_.RunOnce(1000);
+    reactor->Loop();
+  }
+}
+
+// polls pred under the server's lock, for state changed by rpc handlers.
+static bool WaitUntil(janus::TxLogServer& sched,
+                      const std::function<bool()>& pred) {
+  for (int i = 0; i < 500; i++) {
+    {
+      std::lock_guard<std::recursive_mutex> lock(sched.mtx_);
+      if (pred()) {
+        return true;
+      }
+    }
+    usleep(10 * 1000);
+  }
+  return false;
+}
+
+TEST(CoroutineTest, paxos_bulk_accept) {
+  auto config = TestConfig::Get();
+  config->repl_log_dir_ = "";
+  TestSite site(1, MODE_MULTI_PAXOS, "acceptor");
+  janus::PaxosServer acceptor(&site.frame);
+  // the commands are told apart by their size.
+  vector<size_t> applied;
+  acceptor.RegLearnerAction([&applied] (janus::Marshallable& cmd) {
+    applied.push_back(dynamic_cast<janus::BulkPaxosCmd&>(cmd).cmds_.size());
+  });
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  janus::MultiPaxosServiceImpl service(&acceptor);
+  server->reg(&service);
+  ASSERT_EQ(server->start("127.0.0.1:18936"), 0);
+
+  // never freed, a communicator expects to own connected clients.
+  auto commo = new janus::MultiPaxosCommo(nullptr);
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18936"), 0);
+  auto proxy = new janus::ClassicProxy(cl.get());
+  commo->rpc_par_proxies_[0] = {{1, proxy}};
+  commo->leader_cache_[0] = {1, proxy};
+  // one acceptor is the whole partition.
+  config->replica_groups_.emplace_back(0);
+  config->replica_groups_[0].replicas.push_back(&site.info);
+
+  janus::CoordinatorMultiPaxos coo(0, 0, nullptr, 0);
+  coo.commo_ = commo;
+  coo.par_id_ = 0;
+  coo.loc_id_ = 0;
+  slotid_t slot_hint = 1;
+  coo.slot_hint_ = &slot_hint;
+  coo.slot_id_ = slot_hint++;
+  auto sp_bulk = std::make_shared<janus::BulkPaxosCmd>();
+  for (size_t i = 1; i <= 3; i++) {
+    auto sp_cmd = std::make_shared<janus::BulkPaxosCmd>();
+    sp_cmd->cmds_.resize(i, std::make_shared<janus::BulkPaxosCmd>());
+    sp_bulk->cmds_.push_back(sp_cmd);
+  }
+  // the coordinator waits for the quorum on the thread that gets the
+  // replies, as it does on a server.
+  std::atomic<bool> committed{false};
+  cl_pm->add(std::make_shared<OneTimeJob>([&] () {
+    shared_ptr<janus::Marshallable> cmd = sp_bulk;
+    coo.Submit(cmd, [&committed] () { committed = true; });
+  }));
+  ASSERT_TRUE(WaitUntil(acceptor, [&] () {
+    return committed && acceptor.max_executed_slot_ == 3;
+  }));
+  // the batch took slots 1 to 3, the next one is 4.
+  ASSERT_EQ(slot_hint, 4);
+  ASSERT_EQ(applied, vector<size_t>({1, 2, 3}));
+  ASSERT_EQ(acceptor.GetInstance(2)->max_ballot_accepted_, coo.curr_ballot_);
+
+  // an older ballot loses the slots promised to a newer one only.
+  ballot_t max_ballot = 0;
+  uint64_t coro_id = 0;
+  RunWithDisk([&] () {
+    vector<shared_ptr<janus::Marshallable>> cmds(2, sp_bulk);
+    acceptor.OnBulkAccept(3, 0, cmds, &max_ballot, &coro_id, [] () {});
+  });
+  ASSERT_EQ(max_ballot, coo.curr_ballot_);
+  auto sp_kept = std::dynamic_pointer_cast<janus::BulkPaxosCmd>(
+      acceptor.GetInstance(3)->accepted_cmd_);
+  ASSERT_EQ(sp_kept->cmds_.size(), 3u);
+  ASSERT_EQ(acceptor.GetInstance(4)->accepted_cmd_, sp_bulk);
+
+  config->replica_groups_.clear();
+  cl->close_and_release();
+  delete server;
+  cl_pm->release();
+}
+
+TEST(CoroutineTest, fpga_raft_append_batch) {
+  std::string dir = "/tmp/fpga_raft_test_" + std::to_string(getpid());
+  TestConfig::Get()->repl_log_dir_ = dir;
+  TestSite site(1, MODE_FPGA_RAFT, "follower");
+  janus::FpgaRaftServer follower(&site.frame);
+  uint64_t ok = 0, term = 0, index = 0;
+  auto append = [&] (uint64_t leader_term, uint64_t prev, uint64_t prev_term,
+                     vector<uint64_t> terms) {
+    vector<shared_ptr<janus::Marshallable>> cmds;
+    for (size_t i = 0; i < terms.size(); i++) {
+      cmds.push_back(std::make_shared<janus::BulkPaxosCmd>());
+    }
+    RunWithDisk([&] () {
+      follower.OnAppendEntriesBatch(0, leader_term, prev, prev_term, 0, terms,
+                                    cmds, &ok, &term, &index, [] () {});
+    });
+  };
+  append(1, 0, 0, {1, 1});
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(index, 2u);
+  // a batch that overtook the one before it gets what is contiguous.
+  append(1, 3, 1, {1});
+  ASSERT_EQ(ok, 0u);
+  ASSERT_EQ(index, 2u);
+  // a retried batch does not cut the log short.
+  append(1, 0, 0, {1});
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(index, 2u);
+  // a new leader whose entry 2 is from its own term.
+  append(2, 2, 2, {2});
+  ASSERT_EQ(ok, 0u);
+  ASSERT_EQ(term, 2u);
+  ASSERT_EQ(index, 1u);
+  append(2, 1, 1, {2, 2});
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(index, 3u);
+  ASSERT_EQ(follower.GetFpgaRaftInstance(2)->term, 2u);
+  // the next leader never had entry 3, it goes with the entry before it.
+  append(3, 1, 1, {3});
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(index, 2u);
+  ASSERT_EQ(follower.GetFpgaRaftInstance(2)->term, 3u);
+  // a deposed leader is turned away.
+  append(2, 2, 2, {2});
+  ASSERT_EQ(ok, 0u);
+  ASSERT_EQ(term, 3u);
+  ASSERT_EQ(index, 2u);
+  ASSERT_EQ(system(("rm -rf " + dir).c_str()), 0);
+}
+
+TEST(CoroutineTest, fpga_raft_append_window) {
+  std::string dir = "/tmp/fpga_raft_test_" + std::to_string(getpid());
+  auto config = TestConfig::Get();
+  config->repl_log_dir_ = dir;
+  config->repl_append_window_ = 2;
+  config->repl_append_max_entries_ = 1;
+  TestSite site(0, MODE_FPGA_RAFT, "leader");
+  janus::FpgaRaftServer leader(&site.frame);
+  config->repl_append_window_ = 0;
+  config->repl_append_max_entries_ = 64;
+  // never freed, a communicator expects to own connected clients. Without
+  // a proxy for follower 1 the appends to it go nowhere and the test
+  // answers them.
+  auto commo = new janus::FpgaRaftCommo(nullptr);
+  commo->rpc_par_proxies_[0] = {{0, nullptr}};
+  leader.commo_ = commo;
+  leader.currentTerm = 1;
+  auto& pg = leader.progress_[1];
+  pg.next_index = 1;
+  auto append = [&] () {
+    RunWithDisk([&] () {
+      shared_ptr<janus::Marshallable> cmd = std::make_shared<janus::BulkPaxosCmd>();
+      leader.AppendLocal(cmd, 0, 0);
+    });
+  };
+  append();
+  append();
+  append();
+  ASSERT_EQ(pg.n_inflight, 2u);
+  ASSERT_EQ(pg.next_index, 3u);
+  // replies in reverse order, the window moves on the first.
+  leader.OnAppendEntriesReply(1, 0, 0, 2, true, 1, 2);
+  ASSERT_EQ(pg.match_index, 2u);
+  ASSERT_EQ(pg.n_inflight, 2u);
+  ASSERT_EQ(pg.next_index, 4u);
+  leader.OnAppendEntriesReply(1, 0, 0, 1, true, 1, 1);
+  ASSERT_EQ(pg.match_index, 2u);
+  ASSERT_EQ(pg.n_inflight, 1u);
+  // a failed rpc rewinds, the resend waits for the next append.
+  leader.OnAppendEntriesReply(1, 0, 0, 3, false, 0, 0);
+  ASSERT_EQ(pg.epoch, 1u);
+  ASSERT_EQ(pg.n_inflight, 0u);
+  ASSERT_EQ(pg.next_index, 3u);
+  append();
+  ASSERT_EQ(pg.n_inflight, 2u);
+  ASSERT_EQ(pg.next_index, 5u);
+  // entry 4 overtook entry 3 and was refused, resend from 3.
+  leader.OnAppendEntriesReply(1, 1, 0, 4, false, 1, 2);
+  ASSERT_EQ(pg.epoch, 2u);
+  ASSERT_EQ(pg.n_inflight, 2u);
+  ASSERT_EQ(pg.next_index, 4u);
+  // entry 3 of the old epoch still counts once it is in.
+  leader.OnAppendEntriesReply(1, 1, 0, 3, true, 1, 3);
+  ASSERT_EQ(pg.match_index, 3u);
+  ASSERT_EQ(pg.n_inflight, 2u);
+  ASSERT_EQ(pg.next_index, 5u);
+  leader.OnAppendEntriesReply(1, 2, 0, 3, true, 1, 3);
+  leader.OnAppendEntriesReply(1, 2, 0, 4, true, 1, 4);
+  ASSERT_EQ(pg.n_inflight, 0u);
+  ASSERT_EQ(pg.match_index, 4u);
+  ASSERT_EQ(leader.quorum_index_, 4u);
+  ASSERT_EQ(system(("rm -rf " + dir).c_str()), 0);
+}
+
+TEST(CoroutineTest, fpga_raft_install_snapshot) {
+  std::string dir = "/tmp/fpga_raft_test_" + std::to_string(getpid());
+  auto config = TestConfig::Get();
+  config->repl_log_dir_ = dir;
+  TestSite follower_site(1, MODE_FPGA_RAFT, "follower");
+  janus::FpgaRaftServer follower(&follower_site.frame);
+  std::string restored;
+  follower.RegSnapshotAction([] (Marshal& m) {}, [&restored] (Marshal& m) {
+    restored.resize(m.content_size());
+    m.read(&restored[0], restored.size());
+  });
+  RunWithDisk([&] () {
+    vector<shared_ptr<janus::Marshallable>> cmds(5);
+    for (auto& sp_cmd : cmds) {
+      sp_cmd = std::make_shared<janus::BulkPaxosCmd>();
+    }
+    uint64_t ok = 0, term = 0, index = 0;
+    follower.OnAppendEntriesBatch(0, 1, 0, 0, 0, {1, 1, 1, 1, 1}, cmds,
+                                  &ok, &term, &index, [] () {});
+  });
+  ASSERT_EQ(follower.lastLogIndex, 5u);
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  janus::FpgaRaftServiceImpl service(&follower);
+  server->reg(&service);
+  ASSERT_EQ(server->start("127.0.0.1:18939"), 0);
+
+  // the leader keeps no log on disk, its snapshot goes out in 7 byte chunks.
+  config->repl_log_dir_ = "";
+  TestSite leader_site(0, MODE_FPGA_RAFT, "leader");
+  janus::FpgaRaftServer leader(&leader_site.frame);
+  const std::string state = "0123456789abcdefghij";
+  leader.RegSnapshotAction([&state] (Marshal& m) {
+    m.write(state.data(), state.size());
+  }, [] (Marshal& m) {});
+  leader.snapshot_chunk_ = 7;
+  leader.currentTerm = 1;
+  for (uint64_t i = 1; i <= 3; i++) {
+    leader.GetFpgaRaftInstance(i)->term = 1;
+  }
+  leader.lastLogIndex = 3;
+  leader.executeIndex = 3;
+  leader.TakeSnapshot();
+  ASSERT_EQ(leader.min_active_slot_, 3);
+  // never freed, a communicator expects to own connected clients. Site 2
+  // is not connected and site 3 has no proxy at all.
+  auto commo = new janus::FpgaRaftCommo(nullptr);
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18939"), 0);
+  commo->rpc_par_proxies_[0] = {{0, nullptr},
+                                {1, new janus::ClassicProxy(cl.get())},
+                                {2, new janus::ClassicProxy(new Client(cl_pm))}};
+  leader.commo_ = commo;
+  leader.SendSnapshot(1, 0);
+  ASSERT_TRUE(WaitUntil(leader, [&] () {
+    return !leader.progress_[1].in_snapshot;
+  }));
+  // the chunks were put back together, the entries after the snapshot are
+  // from the same term and stay.
+  ASSERT_TRUE(WaitUntil(follower, [&] () {
+    return follower.min_active_slot_ == 3;
+  }));
+  ASSERT_EQ(restored, state);
+  ASSERT_EQ(follower.lastLogIndex, 5u);
+  ASSERT_EQ(follower.executeIndex, 3u);
+  ASSERT_EQ(follower.commitIndex, 3u);
+
+  // a chunk after a lost one is refused.
+  uint64_t term = 0;
+  bool_t ok = 1;
+  RunWithDisk([&] () {
+    follower.OnInstallSnapshot(2, 4, 2, 5, "56789", 1, &term, &ok, [] () {});
+  });
+  ASSERT_EQ(ok, 0);
+  // a snapshot from another history drops the entries after it.
+  RunWithDisk([&] () {
+    follower.OnInstallSnapshot(2, 4, 2, 0, state.substr(0, 5), 0,
+                               &term, &ok, [] () {});
+    follower.OnInstallSnapshot(2, 4, 2, 5, state.substr(5), 1,
+                               &term, &ok, [] () {});
+  });
+  ASSERT_EQ(ok, 1);
+  ASSERT_EQ(term, 2u);
+  ASSERT_EQ(restored, state);
+  ASSERT_EQ(follower.min_active_slot_, 4);
+  ASSERT_EQ(follower.lastLogIndex, 4u);
+  ASSERT_EQ(follower.GetFpgaRaftInstance(4)->term, 2u);
+
+  // a follower the snapshot cannot reach is retried by the next append.
+  leader.SendSnapshot(2, 0);
+  ASSERT_FALSE(leader.progress_[2].in_snapshot);
+  leader.SendSnapshot(3, 0);
+  ASSERT_FALSE(leader.progress_[3].in_snapshot);
+  // so is one the entries after it cannot reach.
+  leader.GetFpgaRaftInstance(4)->term = 1;
+  leader.GetFpgaRaftInstance(4)->log_ = std::make_shared<janus::BulkPaxosCmd>();
+  leader.lastLogIndex = 4;
+  leader.CatchUp(2, 3);
+  ASSERT_EQ(leader.progress_[2].n_inflight, 0u);
+
+  cl->close_and_release();
+  delete server;
+  cl_pm->release();
+  ASSERT_EQ(system(("rm -rf " + dir).c_str()), 0);
+}
+
+// keeps the first append waiting and answers it with the second one.
+struct HoldingRaftService : public janus::FpgaRaftServiceImpl {
+  rrr::DeferredReply* held = nullptr;
+  uint64_t* held_ok = nullptr;
+  vector<uint64_t> terms;
+  size_t n_cmds = 0;
+  DepId dep_id;
+  vector<void*> defers;
+  HoldingRaftService() : janus::FpgaRaftServiceImpl(nullptr) {}
+  void AppendEntriesBatch(const ballot_t& ballot,
+                          const uint64_t& leaderCurrentTerm,
+                          const uint64_t& leaderPrevLogIndex,
+                          const uint64_t& leaderPrevLogTerm,
+                          const uint64_t& leaderCommitIndex,
+                          const vector<uint64_t>& entryTerms,
+                          const DepId& dep_id,
+                          const janus::MarshallDeputy& cmds,
+                          uint64_t *followerAppendOK,
+                          uint64_t *followerCurrentTerm,
+                          uint64_t *followerLastLogIndex,
+                          rrr::DeferredReply* defer) override {
+    terms = entryTerms;
+    this->dep_id = dep_id;
+    n_cmds = std::dynamic_pointer_cast<janus::BulkPaxosCmd>(
+        cmds.sp_data_)->cmds_.size();
+    defers.push_back(defer);
+    *followerCurrentTerm = leaderCurrentTerm;
+    *followerLastLogIndex = leaderPrevLogIndex + entryTerms.size();
+    if (held == nullptr && defers.size() == 1) {
+      held = defer;
+      held_ok = followerAppendOK;
+      return;
+    }
+    *followerAppendOK = 1;
+    defer->reply();
+    if (held != nullptr) {
+      // the outputs live in the deferred reply until it is sent.
+      *held_ok = 1;
+      held->reply();
+      held = nullptr;
+    }
+  }
+};
+
+TEST(CoroutineTest, defer_reply) {
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  HoldingRaftService service;
+  server->reg(&service);
+  ASSERT_EQ(server->start("127.0.0.1:18940"), 0);
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18940"), 0);
+  janus::FpgaRaftProxy proxy(cl.get());
+  DepId di = { "dep", -1 };
+  auto sp_bulk = std::make_shared<janus::BulkPaxosCmd>();
+  sp_bulk->cmds_.resize(3, std::make_shared<janus::BulkPaxosCmd>());
+  janus::MarshallDeputy md(sp_bulk);
+  auto fu = proxy.async_AppendEntriesBatch(0, 2, 4, 1, 0, {1, 2, 2}, di, md);
+  ASSERT_NE(fu, nullptr);
+  // the second append answers both.
+  uint64_t ok = 0, term = 0, index = 0;
+  ASSERT_EQ(proxy.AppendEntriesBatch(0, 2, 7, 2, 0, {2}, di, md,
+                                     &ok, &term, &index), 0);
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(term, 2u);
+  ASSERT_EQ(index, 8u);
+  ASSERT_EQ(service.terms, vector<uint64_t>({2}));
+  ASSERT_EQ(service.n_cmds, 3u);
+  ASSERT_EQ(service.dep_id.first, "dep");
+  ASSERT_EQ(service.dep_id.second, -1);
+  fu->wait();
+  ASSERT_EQ(fu->get_error_code(), 0);
+  ok = term = index = 0;
+  fu->get_reply() >> ok >> term >> index;
+  ASSERT_EQ(ok, 1u);
+  ASSERT_EQ(term, 2u);
+  ASSERT_EQ(index, 7u);
+  fu->release();
+  // a replied call goes back to the pool, the next one reuses it.
+  ASSERT_EQ(proxy.AppendEntriesBatch(0, 2, 8, 2, 0, {2}, di, md,
+                                     &ok, &term, &index), 0);
+  ASSERT_EQ(service.defers.size(), 3u);
+  ASSERT_TRUE(service.defers[2] == service.defers[0] ||
+              service.defers[2] == service.defers[1]);
+  cl->close_and_release();
+  delete server;
+  cl_pm->release();
+}
+
+// counts what a communicator reports, every send must be settled once.
+struct CountingDetector : public janus::SlowDetector {
+  std::atomic<int> n_send{0};
+  std::atomic<int> n_reply{0};
+  std::atomic<int> n_fail{0};
+  void OnSend(siteid_t site) override { n_send++; }
+  void OnReply(siteid_t site, uint64_t latency_us) override { n_reply++; }
+  void OnFail(siteid_t site) override { n_fail++; }
+  void OnCpu(siteid_t site, double util) override {}
+  void OnDisk(siteid_t site, uint64_t latency_us) override {}
+  double Score(siteid_t site) override { return 0; }
+};
+
+TEST(CoroutineTest, slow_detector_balance) {
+  janus::EwmaSlowDetector ewma;
+  ewma.OnSend(1);
+  ewma.OnSend(1);
+  // nothing heard back yet, the backlog alone counts.
+  ASSERT_DOUBLE_EQ(ewma.Score(1), 1.125);
+  ewma.OnReply(1, 100);
+  ASSERT_EQ(ewma.Get(1).n_outstanding, 1);
+  ewma.OnFail(1);
+  // a stray failure does not go below zero.
+  ewma.OnFail(1);
+  ASSERT_EQ(ewma.Get(1).n_outstanding, 0);
+  ASSERT_DOUBLE_EQ(ewma.Score(1), 100);
+  ASSERT_DOUBLE_EQ(ewma.Score(2), 0);
+
+  // a replica far behind the median of its partition is slow.
+  // never freed, a communicator expects to own connected clients.
+  TestConfig::Get();
+  auto commo = new janus::FpgaRaftCommo(nullptr);
+  auto sp_ewma = std::make_shared<janus::EwmaSlowDetector>();
+  commo->SetSlowDetector(sp_ewma);
+  commo->rpc_par_proxies_[0] = {{0, nullptr}, {1, nullptr}, {2, nullptr}};
+  sp_ewma->OnReply(0, 100);
+  sp_ewma->OnReply(1, 120);
+  sp_ewma->OnReply(2, 100);
+  sp_ewma->OnDisk(2, 1000);
+  ASSERT_FALSE(commo->IsSlowReplica(0, 1));
+  ASSERT_TRUE(commo->IsSlowReplica(0, 2));
+
+  // the follower answers the first append and sits on the rest.
+  auto svr_pm = new PollMgr(1);
+  auto server = new Server(svr_pm);
+  std::atomic<int> n_recv{0};
+  server->reg(janus::FpgaRaftService::APPENDENTRIESBATCH,
+              [&n_recv] (Request* req, ServerConnection* sconn) {
+    if (n_recv++ == 0) {
+      sconn->begin_reply(req);
+      *sconn << (uint64_t) 1 << (uint64_t) 1 << (uint64_t) 1;
+      sconn->end_reply();
+    }
+    sconn->put_request(req);
+  }, true);
+  ASSERT_EQ(server->start("127.0.0.1:18937"), 0);
+  auto cl_pm = new PollMgr(1);
+  auto cl = std::make_shared<Client>(cl_pm);
+  ASSERT_EQ(cl->connect("127.0.0.1:18937"), 0);
+  auto sp_count = std::make_shared<CountingDetector>();
+  commo->SetSlowDetector(sp_count);
+  commo->rpc_par_proxies_[0] = {{1, new janus::ClassicProxy(cl.get())}};
+  std::atomic<int> n_ok{0};
+  std::atomic<int> n_failed{0};
+  auto send = [&] () {
+    auto sp_cmd = std::make_shared<janus::BulkPaxosCmd>();
+    commo->SendAppendEntriesBatch(1, 0, 0, 1, 0, 0, 0, {1}, sp_cmd,
+        [&] (bool ok, uint64_t term, uint64_t index) {
+      ok ? n_ok++ : n_failed++;
+    });
+  };
+  send();
+  for (int i = 0; i < 500 && n_ok == 0; i++) {
+    usleep(10 * 1000);
+  }
+  ASSERT_EQ(n_ok, 1);
+  ASSERT_EQ(sp_count->n_reply, 1);
+  // the held append fails with the connection.
+  send();
+  for (int i = 0; i < 500 && n_recv < 2; i++) {
+    usleep(10 * 1000);
+  }
+  cl->close_and_release();
+  for (int i = 0; i < 500 && n_failed == 0; i++) {
+    usleep(10 * 1000);
+  }
+  ASSERT_EQ(n_failed, 1);
+  // one sent after the close is refused on the spot.
+  send();
+  ASSERT_EQ(n_failed, 2);
+  ASSERT_EQ(n_ok, 1);
+  ASSERT_EQ(sp_count->n_send, 3);
+  ASSERT_EQ(sp_count->n_reply, 1);
+  ASSERT_EQ(sp_count->n_fail, 2);
+  delete server;
+  cl_pm->release();
+}
+
 TEST(CoroutineTest, timeout) {
   auto coro1 = Coroutine::CreateRun([](){
     auto t1 = Time::now();